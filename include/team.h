@@ -64,6 +64,8 @@ int team_get_mcast_rejoin_interval(struct team_handle *th, uint32_t *interval);
 int team_set_mcast_rejoin_interval(struct team_handle *th, uint32_t interval);
 int team_get_active_port(struct team_handle *th, uint32_t *ifindex);
 int team_set_active_port(struct team_handle *th, uint32_t ifindex);
+int team_switch_active_port(struct team_handle *th, uint32_t old_ifindex,
+			    uint32_t new_ifindex);
 int team_get_bpf_hash_func(struct team_handle *th, struct sock_fprog *fp);
 int team_set_bpf_hash_func(struct team_handle *th, const struct sock_fprog *fp);
 int team_set_port_enabled(struct team_handle *th,
@@ -202,6 +204,9 @@ int32_t team_get_option_value_s32(struct team_option *option);
 /* option setters */
 int team_set_option_value_u32(struct team_handle *th,
 			      struct team_option *option, uint32_t val);
+int team_set_option_values_u32(struct team_handle *th,
+			       struct team_option **options,
+			       const uint32_t *vals, unsigned int count);
 int team_set_option_value_string(struct team_handle *th,
 				 struct team_option *option, const char *str);
 int team_set_option_value_binary(struct team_handle *th,
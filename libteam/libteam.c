@@ -1216,6 +1216,55 @@ int team_set_active_port(struct team_handle *th, uint32_t ifindex)
 	return team_set_option_value_u32(th, option, ifindex);
 }
 
+/**
+ * @param th		libteam library context
+ * @param old_ifindex	interface index of port to be disabled or zero
+ * @param new_ifindex	interface index of new active port
+ *
+ * @details Enable port identified by new_ifindex, set it as new active port
+ *	    and disable port identified by old_ifindex, all in a single
+ *	    netlink transaction. Note this is possible only if team is in
+ *	    "activebackup" mode.
+ *
+ * @return Zero on success or negative number in case of an error.
+ **/
+TEAM_EXPORT
+int team_switch_active_port(struct team_handle *th, uint32_t old_ifindex,
+			    uint32_t new_ifindex)
+{
+	struct team_option_set_item items[3];
+	unsigned int items_count = 0;
+	bool enable = true;
+	bool disable = false;
+
+	items[items_count].option = team_get_option(th, "np!", "enabled",
+						    new_ifindex);
+	if (!items[items_count].option)
+		return -ENOENT;
+	items[items_count].data = &enable;
+	items[items_count].data_len = 0;
+	items[items_count++].opt_type = TEAM_OPTION_TYPE_BOOL;
+
+	items[items_count].option = team_get_option(th, "n!", "activeport");
+	if (!items[items_count].option)
+		return -ENOENT;
+	items[items_count].data = &new_ifindex;
+	items[items_count].data_len = 0;
+	items[items_count++].opt_type = TEAM_OPTION_TYPE_U32;
+
+	if (old_ifindex && old_ifindex != new_ifindex) {
+		items[items_count].option = team_get_option(th, "np!",
+							    "enabled",
+							    old_ifindex);
+		if (!items[items_count].option)
+			return -ENOENT;
+		items[items_count].data = &disable;
+		items[items_count].data_len = 0;
+		items[items_count++].opt_type = TEAM_OPTION_TYPE_BOOL;
+	}
+	return set_option_values(th, items, items_count);
+}
+
 /**
  * @param th		libteam library context
  * @param fp		where current BPF instruction set will be stored
@@ -35,6 +35,8 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
+#include <unistd.h>
 #include <netlink/netlink.h>
 #include <netlink/genl/genl.h>
 #include <netlink/genl/ctrl.h>
@@ -694,19 +696,18 @@ static int local_set_option_value(struct team_handle *th,
 	return 0;
 }
 
-static int set_option_value(struct team_handle *th, struct team_option *option,
-			    const void *data, int data_len, int opt_type)
+static int put_option_item(struct nl_msg *msg,
+			   struct team_option_set_item *item)
 {
-	struct nl_msg *msg;
-	struct nlattr *option_list;
+	struct team_option *option = item->option;
+	const void *data = item->data;
 	struct nlattr *option_item;
 	int nla_type;
-	int err;
 
-	if (option->initialized && option->type != opt_type)
+	if (option->initialized && option->type != item->opt_type)
 		return -EINVAL;
 
-	switch (opt_type) {
+	switch (item->opt_type) {
 	case TEAM_OPTION_TYPE_U32:
 		nla_type = NLA_U32;
 		break;
@@ -726,16 +727,6 @@ static int set_option_value(struct team_handle *th, struct team_option *option,
 		return -EINVAL;
 	}
 
-	msg = nlmsg_alloc();
-	if (!msg)
-		return -ENOMEM;
-
-	genlmsg_put(msg, NL_AUTO_PID, th->nl_sock_seq, th->family, 0, 0,
-		    TEAM_CMD_OPTIONS_SET, 0);
-	NLA_PUT_U32(msg, TEAM_ATTR_TEAM_IFINDEX, th->ifindex);
-	option_list = nla_nest_start(msg, TEAM_ATTR_LIST_OPTION);
-	if (!option_list)
-		goto nla_put_failure;
 	option_item = nla_nest_start(msg, TEAM_ATTR_ITEM_OPTION);
 	if (!option_item)
 		goto nla_put_failure;
@@ -755,7 +746,8 @@ static int set_option_value(struct team_handle *th, struct team_option *option,
 			NLA_PUT_STRING(msg, TEAM_ATTR_OPTION_DATA, (char *) data);
 			break;
 		case NLA_BINARY:
-			NLA_PUT(msg, TEAM_ATTR_OPTION_DATA, data_len, (char *) data);
+			NLA_PUT(msg, TEAM_ATTR_OPTION_DATA, item->data_len,
+				(char *) data);
 			break;
 		case NLA_FLAG:
 			if (*((bool *) data))
@@ -768,6 +760,66 @@ static int set_option_value(struct team_handle *th, struct team_option *option,
 			goto nla_put_failure;
 	}
 	nla_nest_end(msg, option_item);
+	return 0;
+
+nla_put_failure:
+	return -ENOBUFS;
+}
+
+static size_t option_item_size(struct team_option_set_item *item)
+{
+	size_t data_len;
+
+	switch (item->opt_type) {
+	case TEAM_OPTION_TYPE_STRING:
+		data_len = strlen(item->data) + 1;
+		break;
+	case TEAM_OPTION_TYPE_BINARY:
+		data_len = item->data_len;
+		break;
+	default:
+		data_len = sizeof(__u32);
+	}
+	return nla_total_size(0) + /* TEAM_ATTR_ITEM_OPTION */
+	       nla_total_size(strlen(item->option->id.name) + 1) +
+	       nla_total_size(sizeof(__u32)) * 2 + /* port and array index */
+	       nla_total_size(sizeof(__u8)) +
+	       nla_total_size(data_len);
+}
+
+/*
+ * Sets values of multiple options in a single netlink message. Kernel
+ * applies them in the given order.
+ */
+int set_option_values(struct team_handle *th,
+		      struct team_option_set_item *items,
+		      unsigned int items_count)
+{
+	struct nl_msg *msg;
+	struct nlattr *option_list;
+	size_t msg_size = getpagesize(); /* libnl default */
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < items_count; i++)
+		msg_size += option_item_size(&items[i]);
+	msg = nlmsg_alloc_size(msg_size);
+	if (!msg)
+		return -ENOMEM;
+
+	genlmsg_put(msg, NL_AUTO_PID, th->nl_sock_seq, th->family, 0, 0,
+		    TEAM_CMD_OPTIONS_SET, 0);
+	NLA_PUT_U32(msg, TEAM_ATTR_TEAM_IFINDEX, th->ifindex);
+	option_list = nla_nest_start(msg, TEAM_ATTR_LIST_OPTION);
+	if (!option_list)
+		goto nla_put_failure;
+	for (i = 0; i < items_count; i++) {
+		err = put_option_item(msg, &items[i]);
+		if (err) {
+			nlmsg_free(msg);
+			return err;
+		}
+	}
 	nla_nest_end(msg, option_list);
 
 	err = send_and_recv(th, msg, NULL, NULL);
@@ -775,15 +827,33 @@ static int set_option_value(struct team_handle *th, struct team_option *option,
 		return err;
 	}
 
-	err = local_set_option_value(th, &option->id, opt_type,
-				     data, data_len);
-	return err;
+	for (i = 0; i < items_count; i++) {
+		err = local_set_option_value(th, &items[i].option->id,
+					     items[i].opt_type, items[i].data,
+					     items[i].data_len);
+		if (err)
+			return err;
+	}
+	return 0;
 
 nla_put_failure:
 	nlmsg_free(msg);
 	return -ENOBUFS;
 }
 
+static int set_option_value(struct team_handle *th, struct team_option *option,
+			    const void *data, int data_len, int opt_type)
+{
+	struct team_option_set_item item = {
+		.option = option,
+		.data = data,
+		.data_len = data_len,
+		.opt_type = opt_type,
+	};
+
+	return set_option_values(th, &item, 1);
+}
+
 /**
  * @param th		libteam library context
  * @param option	option structure
@@ -801,6 +871,42 @@ int team_set_option_value_u32(struct team_handle *th,
 				TEAM_OPTION_TYPE_U32);
 }
 
+/**
+ * @param th		libteam library context
+ * @param options	array of option structures
+ * @param vals		array of values to be set
+ * @param count		number of options
+ *
+ * @details Set multiple 32-bit number type options at once. All values are
+ *	    passed to kernel in a single message.
+ *
+ * @return Zero on success or negative number in case of an error.
+ **/
+TEAM_EXPORT
+int team_set_option_values_u32(struct team_handle *th,
+			       struct team_option **options,
+			       const uint32_t *vals, unsigned int count)
+{
+	struct team_option_set_item *items;
+	unsigned int i;
+	int err;
+
+	if (!count)
+		return 0;
+	items = malloc(sizeof(*items) * count);
+	if (!items)
+		return -ENOMEM;
+	for (i = 0; i < count; i++) {
+		items[i].option = options[i];
+		items[i].data = &vals[i];
+		items[i].data_len = 0;
+		items[i].opt_type = TEAM_OPTION_TYPE_U32;
+	}
+	err = set_option_values(th, items, count);
+	free(items);
+	return err;
+}
+
 /**
  * @param th		libteam library context
  * @param option	option structure
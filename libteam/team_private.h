@@ -116,6 +116,15 @@ int ifinfo_link(struct team_handle *th, uint32_t ifindex,
 		struct team_ifinfo **p_ifinfo);
 void ifinfo_unlink(struct team_ifinfo *ifinfo);
 int get_options_handler(struct nl_msg *msg, void *arg);
+struct team_option_set_item {
+	struct team_option *option;
+	const void *data;
+	int data_len;
+	int opt_type;
+};
+int set_option_values(struct team_handle *th,
+		      struct team_option_set_item *items,
+		      unsigned int items_count);
 int option_list_alloc(struct team_handle *th);
 int option_list_init(struct team_handle *th);
 void option_list_free(struct team_handle *th);
@@ -0,0 +1,453 @@
+#! /usr/bin/env python
+"""
+LACP runner convergence test. Runs teamd lacp runner over veth pairs against
+simulated LACP partners and measures convergence.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+"""
+
+import sys
+import os
+import getopt
+import subprocess
+import socket
+import select
+import struct
+import random
+import json
+import time
+
+def usage():
+    """
+    Print usage of this app
+    """
+    print("Usage: team_lacp_sim_test.py [OPTION...]")
+    print("")
+    print("  -h, --help                         print this message")
+    print("  -n, --port-count=LIST              comma separated team sizes (default 2,16,64,256)")
+    print("  -P, --policy=LIST                  comma separated agg_select_policy names (default all)")
+    print("  -s, --scenario=LIST                comma separated scenarios (default all)")
+    print("  -S, --seed=NUMBER                  random seed used for PDU loss (default 1)")
+    print("  -o, --output=FILE                  write results as JSON to FILE")
+    print("")
+    print("Scenarios: %s" % ", ".join(SCENARIOS))
+    sys.exit()
+
+class CmdExecFailedException(Exception):
+    def __init__(self, retval):
+        self.__retval = retval
+
+    def __str__(self):
+        return "Command execution failed: %s" % self.__retval
+
+def print_output(out_type, string):
+    print("%s:\n"
+          "----------------------------\n"
+          "%s"
+          "----------------------------" % (out_type, string))
+
+def cmd_exec(cmd, cleaner=False, quiet=False):
+    cmd = cmd.rstrip(" ")
+    if not cleaner and not quiet:
+        print("# \"%s\"" % cmd)
+    subp = subprocess.Popen(cmd, shell=True, stdout=subprocess.PIPE,
+                            stderr=subprocess.PIPE)
+    (data_stdout, data_stderr) = subp.communicate()
+
+    if subp.returncode and not cleaner:
+        if data_stdout:
+            print_output("Stdout", data_stdout)
+        if data_stderr:
+            print_output("Stderr", data_stderr)
+        raise CmdExecFailedException(subp.returncode)
+    return data_stdout.rstrip()
+
+ETH_P_SLOW = 0x8809
+SLOW_ADDR = b"\x01\x80\xc2\x00\x00\x02"
+LACPDU_LEN = 124
+
+INFO_STATE_LACP_ACTIVITY = 0x01
+INFO_STATE_LACP_TIMEOUT = 0x02
+INFO_STATE_AGGREGATION = 0x04
+INFO_STATE_SYNCHRONIZATION = 0x08
+INFO_STATE_COLLECTING = 0x10
+INFO_STATE_DISTRIBUTING = 0x20
+
+LACP_PERIODIC_SHORT = 1.0
+LACP_PERIODIC_LONG = 30.0
+
+# system_priority, system, key, port_priority, port, state
+LACPDU_INFO = struct.Struct("!H6sHHHB")
+LACPDU_INFO_NULL = (0, b"\0" * 6, 0, 0, 0, 0)
+
+def lacpdu_pack(src, actor, partner):
+    return (SLOW_ADDR + src + struct.pack("!HBB", ETH_P_SLOW, 1, 1) +
+            struct.pack("!BB", 1, 0x14) + LACPDU_INFO.pack(*actor) +
+            b"\0" * 3 +
+            struct.pack("!BB", 2, 0x14) + LACPDU_INFO.pack(*partner) +
+            b"\0" * 3 +
+            struct.pack("!BBH", 3, 0x10, 0) + b"\0" * 12 +
+            struct.pack("!BB", 0, 0) + b"\0" * 50)
+
+def lacpdu_unpack(buf):
+    if len(buf) < LACPDU_LEN:
+        return None
+    (ether_type, subtype) = struct.unpack_from("!HB", buf, 12)
+    if ether_type != ETH_P_SLOW or subtype != 1:
+        return None
+    return (LACPDU_INFO.unpack_from(buf, 18), LACPDU_INFO.unpack_from(buf, 38))
+
+class LacpPartner:
+    """
+    Simulated LACP partner sitting on the peer end of a veth pair.
+    """
+    def __init__(self, sim, ifname, port_nr):
+        self._sim = sim
+        self._ifname = ifname
+        self._port_nr = port_nr
+        self._hwaddr = struct.pack("!BBHH", 0x02, 0x1a, 0xc9, port_nr & 0xffff)
+        self.system = b"\x02\x1a\xc9\x00\x00\x01"
+        self.key = 1
+        self.sync = True
+        self.fast = True
+        self.loss = 0.0
+        self._teamd_info = None
+        self._teamd_view = None
+        self._next_tx = 0.0
+        self._sock = socket.socket(socket.AF_PACKET, socket.SOCK_RAW,
+                                   socket.htons(ETH_P_SLOW))
+        self._sock.bind((ifname, ETH_P_SLOW))
+
+    def fileno(self):
+        return self._sock.fileno()
+
+    def close(self):
+        self._sock.close()
+
+    def _actor_info(self):
+        state = INFO_STATE_LACP_ACTIVITY | INFO_STATE_AGGREGATION
+        if self.fast:
+            state |= INFO_STATE_LACP_TIMEOUT
+        if self.sync and self._teamd_info:
+            state |= (INFO_STATE_SYNCHRONIZATION | INFO_STATE_COLLECTING |
+                      INFO_STATE_DISTRIBUTING)
+        return (0xffff, self.system, self.key, 0xff, self._port_nr, state)
+
+    def _periodic_time(self):
+        if not self._teamd_info or \
+           self._teamd_info[5] & INFO_STATE_LACP_TIMEOUT:
+            return LACP_PERIODIC_SHORT
+        return LACP_PERIODIC_LONG
+
+    def kick(self):
+        self._next_tx = 0.0
+
+    def tx_due(self, now):
+        return now >= self._next_tx
+
+    def next_tx(self):
+        return self._next_tx
+
+    def send(self, now):
+        self._next_tx = now + self._periodic_time()
+        if self._sim.rng.random() < self.loss:
+            return
+        partner = self._teamd_info or LACPDU_INFO_NULL
+        self._sock.send(lacpdu_pack(self._hwaddr, self._actor_info(), partner))
+        self._sim.pdu_count += 1
+
+    def recv(self, now):
+        buf = self._sock.recv(2048)
+        self._sim.pdu_count += 1
+        if self._sim.rng.random() < self.loss:
+            return
+        info = lacpdu_unpack(buf)
+        if not info:
+            return
+        (self._teamd_info, self._teamd_view) = info
+        if self._teamd_view != self._actor_info():
+            # Need To Transmit, teamd has stale info about us.
+            self._next_tx = min(self._next_tx, now)
+
+class LacpSimTest:
+    def __init__(self):
+        self._team_dev_name = "testlacpx"
+        self._port_counts = [2, 16, 64, 256]
+        self._policies = ["lacp_prio", "lacp_prio_stable", "bandwidth",
+                          "count", "port_config"]
+        self._scenarios = list(SCENARIOS)
+        self._seed = 1
+        self._output = None
+        self._results = []
+        self._poll_interval = 0.1
+        self._settle_time = 3.0
+        self._converge_timeout = 90.0
+
+    def set_port_counts(self, port_counts):
+        self._port_counts = port_counts
+
+    def set_policies(self, policies):
+        self._policies = policies
+
+    def set_scenarios(self, scenarios):
+        self._scenarios = scenarios
+
+    def set_seed(self, seed):
+        self._seed = seed
+
+    def set_output(self, output):
+        self._output = output
+
+    def _port_name(self, i):
+        return "lst%d" % i
+
+    def _peer_name(self, i):
+        return "lsp%d" % i
+
+    def _setup(self, port_count, policy):
+        self.rng = random.Random(self._seed)
+        self.pdu_count = 0
+        self._partners = []
+        self._enabled = {}
+        self._churn = 0
+        for i in range(port_count):
+            cmd_exec("ip link add %s type veth peer name %s" %
+                     (self._port_name(i), self._peer_name(i)), quiet=True)
+            cmd_exec("ip link set %s up" % self._peer_name(i), quiet=True)
+            self._partners.append(LacpPartner(self, self._peer_name(i), i + 1))
+        config = {
+            "device": self._team_dev_name,
+            "runner": {"name": "lacp", "active": True, "fast_rate": True,
+                       "agg_select_policy": policy},
+            "ports": dict((self._port_name(i), {})
+                          for i in range(port_count)),
+        }
+        self._started = time.time()
+        cmd_exec("teamd -d -t %s -c '%s'" % (self._team_dev_name,
+                                              json.dumps(config)))
+        cmd_exec("ip link set %s up" % self._team_dev_name)
+        dump = self._state_dump()
+        self._teamd_pid = dump["setup"]["pid"]
+
+    def _cleanup(self, port_count):
+        for partner in self._partners:
+            partner.close()
+        cmd_exec("teamd -t %s -k" % self._team_dev_name, cleaner=True)
+        for i in range(port_count):
+            cmd_exec("ip link del %s" % self._peer_name(i), cleaner=True)
+
+    def _state_dump(self):
+        out = cmd_exec("teamdctl %s state dump" % self._team_dev_name,
+                       quiet=True)
+        return json.loads(out)
+
+    def _cpu_time(self):
+        f = open("/proc/%d/stat" % self._teamd_pid)
+        fields = f.read().rsplit(")", 1)[1].split()
+        f.close()
+        return (int(fields[11]) + int(fields[12])) / \
+               float(os.sysconf("SC_CLK_TCK"))
+
+    def _poll(self, now):
+        """
+        Sample which ports are enabled and count enable/disable churns.
+        Returns time of last change or None.
+        """
+        dump = self._state_dump()
+        changed = None
+        for (port_name, port) in dump.get("ports", {}).items():
+            runner = port.get("runner", {})
+            enabled = runner.get("selected", False) and \
+                      runner.get("aggregator", {}).get("selected", False)
+            if self._enabled.get(port_name, False) != enabled:
+                if port_name in self._enabled:
+                    self._churn += 1
+                self._enabled[port_name] = enabled
+                changed = now
+        return changed
+
+    def _run(self, duration, poll=True):
+        """
+        Run partners for duration seconds, or until the set of enabled
+        ports does not change for settle time in case duration is None.
+        Returns time of last change.
+        """
+        now = time.time()
+        last_change = now
+        end = now + (duration if duration else self._converge_timeout)
+        next_poll = now
+        while now < end:
+            wakeup = min([p.next_tx() for p in self._partners] + [end])
+            if poll:
+                wakeup = min(wakeup, next_poll)
+            readable = select.select(self._partners, [], [],
+                                     max(wakeup - now, 0))[0]
+            now = time.time()
+            for partner in readable:
+                partner.recv(now)
+            for partner in self._partners:
+                if partner.tx_due(now):
+                    partner.send(now)
+            if poll and now >= next_poll:
+                next_poll = now + self._poll_interval
+                changed = self._poll(now)
+                if changed:
+                    last_change = changed
+                elif not duration and \
+                     now - last_change >= self._settle_time and \
+                     any(self._enabled.values()):
+                    break
+        return last_change
+
+    def _converge(self, name):
+        self._churn = 0
+        start = time.time()
+        last_change = self._run(None)
+        return {"step": name,
+                "converge_ms": int((last_change - start) * 1000),
+                "churn": self._churn}
+
+    def _partners_set(self, partners, **kwargs):
+        for partner in partners:
+            for (attr, value) in kwargs.items():
+                setattr(partner, attr, value)
+            partner.kick()
+
+    def _half(self):
+        return self._partners[:(len(self._partners) + 1) // 2]
+
+    def _scenario_bringup(self):
+        self._churn = 0
+        last_change = self._run(None)
+        dump = self._state_dump()
+        ttd = [port["runner"].get("time_to_distributing", -1)
+               for port in dump.get("ports", {}).values()]
+        ttd = [t for t in ttd if t >= 0]
+        return [{"step": "bringup",
+                 "converge_ms": int((last_change - self._started) * 1000),
+                 "churn": self._churn,
+                 "time_to_distributing_max_ms": max(ttd) if ttd else -1,
+                 "time_to_distributing_avg_ms":
+                    sum(ttd) // len(ttd) if ttd else -1}]
+
+    def _scenario_key_change(self):
+        self._partners_set(self._partners, key=2)
+        return [self._converge("key_change")]
+
+    def _scenario_sync_loss(self):
+        self._partners_set(self._half(), sync=False)
+        res = [self._converge("sync_lost")]
+        self._partners_set(self._half(), sync=True)
+        res.append(self._converge("sync_restored"))
+        return res
+
+    def _scenario_pdu_loss(self):
+        self._churn = 0
+        self._partners_set(self._partners, loss=0.3)
+        self._run(20.0)
+        churn = self._churn
+        self._partners_set(self._partners, loss=0.0)
+        res = self._converge("pdu_loss_recovered")
+        res["churn"] += churn
+        return [res]
+
+    def _scenario_slow_rate(self):
+        self._partners_set(self._partners, fast=False)
+        self._run(2.0, poll=False)
+        self._partners_set(self._partners, key=3)
+        res = [self._converge("slow_rate_key_change")]
+        self._partners_set(self._partners, fast=True)
+        return res
+
+    def _scenario_agg_split(self):
+        self._partners_set(self._half(), system=b"\x02\x1a\xc9\x00\x00\x02")
+        res = [self._converge("agg_split")]
+        self._partners_set(self._half(), system=b"\x02\x1a\xc9\x00\x00\x01")
+        res.append(self._converge("agg_join"))
+        return res
+
+    def _scenario_steady(self):
+        # State dumps are not polled here so they are not accounted.
+        pdu_count = self.pdu_count
+        cpu_time = self._cpu_time()
+        self._run(10.0, poll=False)
+        pdus = self.pdu_count - pdu_count
+        cpu_us = (self._cpu_time() - cpu_time) * 1000000
+        return [{"step": "steady", "pdus": pdus,
+                 "cpu_us_per_pdu": round(cpu_us / pdus, 2) if pdus else -1}]
+
+    def _run_one(self, port_count, policy):
+        print("POLICY %s PORTS %d" % (policy, port_count))
+        self._setup(port_count, policy)
+        try:
+            for scenario in ["bringup"] + \
+                            [s for s in self._scenarios if s != "bringup"]:
+                for res in getattr(self, "_scenario_%s" % scenario)():
+                    res.update({"policy": policy, "port_count": port_count})
+                    print("  %s" % " ".join(["%s=%s" % (k, res[k])
+                                             for k in sorted(res)]))
+                    self._results.append(res)
+        finally:
+            self._cleanup(port_count)
+
+    def run(self):
+        for policy in self._policies:
+            for port_count in self._port_counts:
+                self._run_one(port_count, policy)
+        if self._output:
+            f = open(self._output, "w")
+            json.dump(self._results, f, indent=4, sort_keys=True)
+            f.close()
+
+SCENARIOS = ["bringup", "key_change", "sync_loss", "pdu_loss", "slow_rate",
+             "agg_split", "steady"]
+
+def main():
+    try:
+        opts, args = getopt.getopt(
+            sys.argv[1:],
+            "hn:P:s:S:o:",
+            ["help", "port-count=", "policy=", "scenario=", "seed=",
+             "output="]
+        )
+    except getopt.GetoptError as err:
+        print(str(err))
+        usage()
+
+    stest = LacpSimTest()
+
+    for opt, arg in opts:
+        if opt in ("-h", "--help"):
+            usage()
+        elif opt in ("-n", "--port-count"):
+            stest.set_port_counts([int(n) for n in arg.split(",")])
+        elif opt in ("-P", "--policy"):
+            stest.set_policies(arg.split(","))
+        elif opt in ("-s", "--scenario"):
+            scenarios = arg.split(",")
+            for scenario in scenarios:
+                if scenario not in SCENARIOS:
+                    print("Unknown scenario \"%s\"" % scenario)
+                    usage()
+            stest.set_scenarios(scenarios)
+        elif opt in ("-S", "--seed"):
+            stest.set_seed(int(arg))
+        elif opt in ("-o", "--output"):
+            stest.set_output(arg)
+
+    stest.run()
+
+if __name__ == "__main__":
+    main()
@@ -120,6 +120,9 @@ struct teamd_context {
 	struct list_item		event_watch_list;
 	struct list_item		state_ops_list;
 	struct list_item		state_val_list;
+	struct list_item		lw_psr_group_list;
+	struct list_item		lw_psr_phys_list;
+	struct lw_ap_shared *		lw_ap_shared;
 	uint32_t			ifindex;
 	struct team_ifinfo *		ifinfo;
 	char *				hwaddr;
@@ -163,6 +166,12 @@ struct teamd_port {
 	char *				ifname;
 	struct team_port *		team_port;
 	struct team_ifinfo *		team_ifinfo;
+	struct timespec			link_changed_ts; /* last link watch
+							  * state change */
+	/* Aggregated state of port link watches, kept by link watch code */
+	bool				link_up;
+	unsigned int			link_watch_count;
+	unsigned int			link_watch_up_count;
 };
 
 struct teamd_runner {
@@ -330,8 +339,15 @@ static inline bool teamd_port_present(struct teamd_context *ctx,
 	return team_is_port_present(ctx->th, tdport->team_port);
 }
 
-bool teamd_link_watch_port_up(struct teamd_context *ctx,
-			      struct teamd_port *tdport);
+/* Port is considered up if it has no link watch or any of them is up */
+static inline bool teamd_link_watch_port_up(struct teamd_context *ctx,
+					    struct teamd_port *tdport)
+{
+	return !tdport || tdport->link_up;
+}
+
+unsigned int teamd_link_watch_port_rtt(struct teamd_context *ctx,
+				       struct teamd_port *tdport);
 void teamd_link_watches_set_forced_active(struct teamd_context *ctx,
 					  bool forced_active);
 int teamd_link_watch_init(struct teamd_context *ctx);
@@ -348,6 +364,8 @@ int teamd_balancer_init(struct teamd_context *ctx, struct teamd_balancer **ptb);
 void teamd_balancer_fini(struct teamd_balancer *tb);
 int teamd_balancer_port_added(struct teamd_balancer *tb,
 			      struct teamd_port *tdport);
+int teamd_balancer_port_disabled(struct teamd_balancer *tb,
+				 struct teamd_port *tdport);
 void teamd_balancer_port_removed(struct teamd_balancer *tb,
 				 struct teamd_port *tdport);
 
@@ -366,8 +384,12 @@ int teamd_getsockname_hwaddr(int sock, struct sockaddr_ll *addr,
 int teamd_sendto(int sockfd, const void *buf, size_t len, int flags,
 		 const struct sockaddr *dest_addr, socklen_t addrlen);
 int teamd_send(int sockfd, const void *buf, size_t len, int flags);
+int teamd_sendmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen,
+		   int flags, unsigned int *calls_p);
 int teamd_recvfrom(int sockfd, void *buf, size_t len, int flags,
 		   struct sockaddr *src_addr, socklen_t addrlen);
+int teamd_recvmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen,
+		   int flags);
 
 /* Various helpers */
 static inline void ms_to_timespec(struct timespec *ts, int ms)
@@ -386,6 +408,18 @@ static inline bool timespec_is_zero(struct timespec *ts)
 	return !ts->tv_sec && !ts->tv_nsec;
 }
 
+static inline long timespec_diff_ms(struct timespec *ts1, struct timespec *ts2)
+{
+	return (ts1->tv_sec - ts2->tv_sec) * 1000 +
+	       (ts1->tv_nsec - ts2->tv_nsec) / 1000000;
+}
+
+static inline long timespec_diff_us(struct timespec *ts1, struct timespec *ts2)
+{
+	return (ts1->tv_sec - ts2->tv_sec) * 1000000 +
+	       (ts1->tv_nsec - ts2->tv_nsec) / 1000;
+}
+
 #define TEAMD_ENOENT(err) (err == -ENOENT || err == -ENODEV)
 
 #endif /* _TEAMD_H_ */
@@ -21,16 +21,31 @@
 #include <string.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
 #include <private/list.h>
 #include <private/misc.h>
 #include <team.h>
 
 #include "teamd.h"
 #include "teamd_config.h"
+#include "teamd_state.h"
+#include "teamd_bpf_chef.h"
+#include "teamd_balancer_log.h"
 
 struct tb_stats {
 	uint64_t last_bytes;
 	uint64_t curr_bytes;
+	uint64_t last_packets;
+	uint64_t curr_packets;
 	bool initialized;
 };
 
@@ -38,6 +53,11 @@ struct tb_hash_info {
 	uint8_t hash;
 	struct tb_stats stats;
 	struct teamd_port *tdport;
+	unsigned int idle_age; /* consecutive near-zero delta intervals */
+	unsigned int remap_count;
+	uint64_t flow_bitmap; /* sampled flows in current interval */
+	unsigned int flows; /* sampled flows in last interval */
+	bool elephant;
 	struct {
 		bool processed;
 	} rebalance;
@@ -48,19 +68,113 @@ struct tb_port_info {
 	struct tb_stats stats;
 	struct teamd_port *tdport;
 	struct {
-		uint64_t bytes;
+		uint64_t load;
+		unsigned int latency_weight; /* percent */
 		bool unusable;
+		bool elephant;
 	} rebalance;
 };
 
 #define HASH_COUNT 256
 
+enum tb_remap_policy {
+	TB_REMAP_POLICY_GREEDY,
+	TB_REMAP_POLICY_IDLE_AWARE,
+};
+
+static const char *tb_remap_policy_names[] = {
+	[TB_REMAP_POLICY_GREEDY] = "greedy",
+	[TB_REMAP_POLICY_IDLE_AWARE] = "idle_aware",
+};
+
+#define TB_DFLT_IDLE_INTERVALS 3
+#define TB_DFLT_IDLE_BYTES 1500
+#define TB_DFLT_BUSY_IMBALANCE 50
+
+enum tb_metric {
+	TB_METRIC_BYTES,
+	TB_METRIC_PACKETS,
+	TB_METRIC_COMBINED,
+};
+
+static const char *tb_metric_names[] = {
+	[TB_METRIC_BYTES] = "bytes",
+	[TB_METRIC_PACKETS] = "packets",
+	[TB_METRIC_COMBINED] = "combined",
+};
+
+#define TB_DFLT_BYTE_WEIGHT 1
+#define TB_DFLT_PACKET_WEIGHT 100
+
+#define TB_DFLT_LOG_RECORD_COUNT 128
+#define TB_MAX_LOG_RECORD_COUNT 4096
+
+#define TB_DFLT_ADAPTIVE_INTERVAL false
+#define TB_DFLT_MIN_BALANCING_INTERVAL 10
+#define TB_DFLT_MAX_BALANCING_INTERVAL 300
+#define TB_DFLT_STABLE_THRESHOLD 10
+
+#define TB_DFLT_LATENCY_AWARE false
+#define TB_LATENCY_WEIGHT_MAX 400 /* percent */
+
+#define TB_SAMPLER_SNAPLEN_MIN 128 /* enough for flow tuple */
+#define TB_SAMPLER_SNAPLEN_MAX 1024
+#define TB_CMS_DEPTH 4
+#define TB_CMS_WIDTH_BITS 10
+#define TB_CMS_WIDTH (1 << TB_CMS_WIDTH_BITS)
+#define TB_TOP_FLOWS_MAX 32
+#define TB_DFLT_SAMPLE_RATE 0 /* sampler disabled */
+#define TB_DFLT_TOP_FLOWS 8
+
+struct tb_flow {
+	uint64_t key;
+	uint8_t hash;
+	uint64_t bytes; /* estimated, decays every interval */
+	char desc[2 * INET6_ADDRSTRLEN + 32];
+};
+
+/*
+ * Samples outgoing packets of team device to find out how many flows
+ * share each hash and which flows are the heaviest. Byte counts of flows
+ * are estimated by count-min sketch.
+ */
+struct tb_sampler {
+	int sock;
+	unsigned int rate;
+	unsigned int snaplen;
+	unsigned int top_count;
+	struct sock_fprog hash_fprog; /* copy of team bpf_hash_func */
+	uint64_t cms[TB_CMS_DEPTH][TB_CMS_WIDTH];
+	struct tb_flow top[TB_TOP_FLOWS_MAX];
+};
+
 struct teamd_balancer {
 	struct teamd_context *ctx;
 	bool tx_balancing_enabled;
 	uint32_t balancing_interval;
+	enum tb_remap_policy remap_policy;
+	unsigned int idle_intervals;
+	uint64_t idle_bytes;
+	unsigned int busy_imbalance; /* percent */
+	enum tb_metric metric;
+	uint64_t byte_weight;
+	uint64_t packet_weight;
+	struct {
+		bool enabled;
+		uint32_t min_interval;
+		uint32_t max_interval;
+		unsigned int stable_threshold; /* percent */
+		uint64_t last_rate; /* bytes per tenth of a second */
+	} adaptive;
+	bool latency_aware;
 	struct tb_hash_info hash_info[HASH_COUNT];
 	struct list_item port_info_list;
+	struct tb_sampler sampler;
+	struct {
+		struct tb_log_header *header;
+		size_t size;
+		struct tb_log_record *record; /* being written */
+	} log;
 };
 
 static struct tb_port_info *get_tb_port_info(struct teamd_balancer *tb,
@@ -80,9 +194,23 @@ static uint64_t tb_stats_get_delta(struct tb_stats *stats)
 	return stats->curr_bytes - stats->last_bytes;
 }
 
+static uint64_t tb_stats_get_packets_delta(struct tb_stats *stats)
+{
+	return stats->curr_packets - stats->last_packets;
+}
+
+/* Load used for balancing decisions, according to configured metric */
+static uint64_t tb_stats_get_cost(struct teamd_balancer *tb,
+				  struct tb_stats *stats)
+{
+	return tb->byte_weight * tb_stats_get_delta(stats) +
+	       tb->packet_weight * tb_stats_get_packets_delta(stats);
+}
+
 static void tb_stats_update_last(struct tb_stats *stats)
 {
 	stats->last_bytes = stats->curr_bytes;
+	stats->last_packets = stats->curr_packets;
 }
 
 static void tb_stats_update(struct tb_stats *stats,
@@ -106,6 +234,26 @@ static void tb_stats_all_update_last(struct teamd_balancer *tb)
 		tb_stats_update_last(&tb->hash_info[i].stats);
 }
 
+static void tb_idle_age_update(struct teamd_balancer *tb)
+{
+	struct tb_hash_info *tbhi;
+	int i;
+
+	for (i = 0; i < HASH_COUNT; i++) {
+		tbhi = &tb->hash_info[i];
+		if (tb_stats_get_delta(&tbhi->stats) > tb->idle_bytes)
+			tbhi->idle_age = 0;
+		else if (tbhi->idle_age < UINT_MAX)
+			tbhi->idle_age++;
+	}
+}
+
+static bool tb_hash_is_idle(struct teamd_balancer *tb,
+			    struct tb_hash_info *tbhi)
+{
+	return tbhi->idle_age >= tb->idle_intervals;
+}
+
 static void tb_stats_update_hash(struct teamd_balancer *tb,
 				 uint8_t hash, uint64_t bytes)
 {
@@ -128,6 +276,23 @@ static void tb_hash_to_port_map_update(struct teamd_balancer *tb,
 	tb->hash_info[hash].tdport = tdport;
 }
 
+/*
+ * Load is scaled by latency weight so ports with longer probe round trip
+ * get proportionally less traffic. Among equally loaded ports the one with
+ * lower latency wins. Without latency awareness all weights are equal.
+ */
+static bool tb_port_load_lower(struct tb_port_info *tbpi1,
+			       struct tb_port_info *tbpi2)
+{
+	uint64_t load1 = tbpi1->rebalance.load * tbpi1->rebalance.latency_weight;
+	uint64_t load2 = tbpi2->rebalance.load * tbpi2->rebalance.latency_weight;
+
+	if (load1 != load2)
+		return load1 < load2;
+	return tbpi1->rebalance.latency_weight <
+	       tbpi2->rebalance.latency_weight;
+}
+
 static struct tb_port_info *tb_get_least_loaded_port(struct teamd_balancer *tb)
 {
 	struct tb_port_info *tbpi;
@@ -136,8 +301,7 @@ static struct tb_port_info *tb_get_least_loaded_port(struct teamd_balancer *tb)
 	list_for_each_node_entry(tbpi, &tb->port_info_list, list) {
 		if (tbpi->rebalance.unusable)
 			continue;
-		if (!best_tbpi ||
-		    tbpi->rebalance.bytes < best_tbpi->rebalance.bytes)
+		if (!best_tbpi || tb_port_load_lower(tbpi, best_tbpi))
 			best_tbpi = tbpi;
 	}
 	return best_tbpi;
@@ -149,89 +313,929 @@ static struct tb_hash_info *tb_get_biggest_unprocessed_hash(struct teamd_balance
 	struct tb_hash_info *best_tbhi = NULL;
 	int i;
 
-	for (i = 0; i < HASH_COUNT; i++) {
-		tbhi = &tb->hash_info[i];
-		if (tbhi->rebalance.processed)
-			continue;
-		if (!best_tbhi || tb_stats_get_delta(&tbhi->stats) >
-				  tb_stats_get_delta(&best_tbhi->stats))
-			best_tbhi = tbhi;
+	for (i = 0; i < HASH_COUNT; i++) {
+		tbhi = &tb->hash_info[i];
+		if (tbhi->rebalance.processed)
+			continue;
+		if (!best_tbhi || tb_stats_get_cost(tb, &tbhi->stats) >
+				  tb_stats_get_cost(tb, &best_tbhi->stats))
+			best_tbhi = tbhi;
+	}
+	return best_tbhi;
+}
+
+/*
+ * Weight of a port is its probe round trip time relative to the lowest
+ * one among the ports, capped. Ports without measurement are neutral.
+ */
+static void tb_latency_weights_update(struct teamd_balancer *tb)
+{
+	struct tb_port_info *tbpi;
+	unsigned int min_rtt = 0;
+	uint64_t weight;
+	unsigned int rtt;
+
+	list_for_each_node_entry(tbpi, &tb->port_info_list, list) {
+		rtt = teamd_link_watch_port_rtt(tb->ctx, tbpi->tdport);
+		if (rtt && (!min_rtt || rtt < min_rtt))
+			min_rtt = rtt;
+	}
+	if (!min_rtt)
+		return;
+	list_for_each_node_entry(tbpi, &tb->port_info_list, list) {
+		rtt = teamd_link_watch_port_rtt(tb->ctx, tbpi->tdport);
+		if (!rtt)
+			continue;
+		weight = (uint64_t) rtt * 100 / min_rtt;
+		if (weight > TB_LATENCY_WEIGHT_MAX)
+			weight = TB_LATENCY_WEIGHT_MAX;
+		tbpi->rebalance.latency_weight = weight;
+	}
+}
+
+static void tb_clear_rebalance_data(struct teamd_balancer *tb)
+{
+	struct tb_port_info *tbpi;
+	int i;
+
+	list_for_each_node_entry(tbpi, &tb->port_info_list, list) {
+		tbpi->rebalance.load = 0;
+		tbpi->rebalance.latency_weight = 100;
+		tbpi->rebalance.unusable = false;
+		tbpi->rebalance.elephant = false;
+	}
+	for (i = 0; i < HASH_COUNT; i++) {
+		tb->hash_info[i].rebalance.processed = false;
+	}
+	if (tb->latency_aware)
+		tb_latency_weights_update(tb);
+}
+
+static int tb_hash_to_port_remap(struct team_handle *th,
+				 struct tb_hash_info *tbhi,
+				 struct tb_port_info *tbpi)
+{
+	struct team_option *option;
+	struct teamd_port *new_tdport = tbpi->tdport;
+	uint8_t hash = tbhi->hash;
+	int err;
+
+	if (tbhi->tdport == new_tdport)
+		return 0;
+
+	option = team_get_option(th, "na", "lb_tx_hash_to_port_mapping", hash);
+	if (!option)
+		return -ENOENT;
+	err = team_set_option_value_u32(th, option, new_tdport->ifindex);
+	if (err)
+		return err;
+	tbhi->remap_count++;
+	teamd_log_dbg("Remapped hash \"%u\" (delta %" PRIu64 ", idle age %u) to port %s.",
+		      hash, tb_stats_get_delta(&tbhi->stats), tbhi->idle_age,
+		      new_tdport->ifname);
+	return 0;
+}
+
+/*
+ * Returns the spread between the most and the least loaded enabled port
+ * in percent of the most loaded one.
+ */
+static unsigned int tb_port_imbalance(struct teamd_balancer *tb)
+{
+	struct tb_port_info *tbpi;
+	uint64_t min_load = UINT64_MAX;
+	uint64_t max_load = 0;
+	uint64_t load;
+	bool enabled;
+	int err;
+
+	list_for_each_node_entry(tbpi, &tb->port_info_list, list) {
+		err = teamd_port_enabled(tb->ctx, tbpi->tdport, &enabled);
+		if (err || !enabled)
+			continue;
+		load = tb_stats_get_cost(tb, &tbpi->stats);
+		if (load < min_load)
+			min_load = load;
+		if (load > max_load)
+			max_load = load;
+	}
+	if (!max_load)
+		return 0;
+	return (max_load - min_load) * 100 / max_load;
+}
+
+/*
+ * Keep hashes which carry traffic on their current port so their flows
+ * are not reordered. Only their load is accounted so the idle hashes get
+ * distributed around them.
+ */
+static void tb_pin_busy_hashes(struct teamd_balancer *tb)
+{
+	struct tb_hash_info *tbhi;
+	struct tb_port_info *tbpi;
+	int i;
+
+	for (i = 0; i < HASH_COUNT; i++) {
+		tbhi = &tb->hash_info[i];
+		if (!tbhi->tdport || tb_hash_is_idle(tb, tbhi))
+			continue;
+		tbpi = get_tb_port_info(tb, tbhi->tdport);
+		if (!tbpi)
+			continue;
+		tbpi->rebalance.load += tb_stats_get_cost(tb, &tbhi->stats);
+		if (tbhi->elephant)
+			tbpi->rebalance.elephant = true;
+		tbhi->rebalance.processed = true;
+	}
+}
+
+/*
+ * Hash carrying a single elephant flow cannot be split, moving it around
+ * would only move the hot spot. Keep one such hash per port in place and
+ * balance the rest around it.
+ */
+static void tb_pin_elephant_hashes(struct teamd_balancer *tb)
+{
+	struct tb_hash_info *tbhi;
+	struct tb_port_info *tbpi;
+	int i;
+
+	for (i = 0; i < HASH_COUNT; i++) {
+		tbhi = &tb->hash_info[i];
+		if (!tbhi->elephant || !tbhi->tdport ||
+		    tbhi->rebalance.processed)
+			continue;
+		tbpi = get_tb_port_info(tb, tbhi->tdport);
+		if (!tbpi || tbpi->rebalance.elephant)
+			continue;
+		tbpi->rebalance.load += tb_stats_get_cost(tb, &tbhi->stats);
+		tbpi->rebalance.elephant = true;
+		tbhi->rebalance.processed = true;
+	}
+}
+
+static bool tb_log_header_valid(struct tb_log_header *header,
+				uint32_t record_count)
+{
+	return header->magic == TB_LOG_MAGIC &&
+	       header->version == TB_LOG_VERSION &&
+	       header->record_size == sizeof(struct tb_log_record) &&
+	       header->record_count == record_count;
+}
+
+static int tb_log_open(struct teamd_balancer *tb, const char *path,
+		       uint32_t record_count)
+{
+	struct tb_log_header *header;
+	size_t size = tb_log_size(record_count);
+	int err = 0;
+	int fd;
+
+	fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd == -1) {
+		teamd_log_err("Failed to open decision log \"%s\".", path);
+		return -errno;
+	}
+	if (ftruncate(fd, size) == -1) {
+		teamd_log_err("Failed to resize decision log \"%s\".", path);
+		err = -errno;
+		goto close_fd;
+	}
+	header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (header == MAP_FAILED) {
+		teamd_log_err("Failed to map decision log \"%s\".", path);
+		err = -errno;
+		goto close_fd;
+	}
+
+	/* Continue in existing log if it has the same layout */
+	if (!tb_log_header_valid(header, record_count)) {
+		memset(header, 0, sizeof(*header));
+		header->magic = TB_LOG_MAGIC;
+		header->version = TB_LOG_VERSION;
+		header->record_size = sizeof(struct tb_log_record);
+		header->record_count = record_count;
+	}
+	tb->log.header = header;
+	tb->log.size = size;
+	teamd_log_info("Logging balancer decisions to \"%s\".", path);
+
+close_fd:
+	close(fd);
+	return err;
+}
+
+static void tb_log_close(struct teamd_balancer *tb)
+{
+	if (!tb->log.header)
+		return;
+	munmap(tb->log.header, tb->log.size);
+	tb->log.header = NULL;
+}
+
+static void tb_log_record_begin(struct teamd_balancer *tb, uint32_t flags)
+{
+	struct tb_log_header *header = tb->log.header;
+	struct tb_log_record *record;
+	struct tb_log_port *log_port;
+	struct tb_log_hash *log_hash;
+	struct tb_hash_info *tbhi;
+	struct tb_port_info *tbpi;
+	struct timespec now;
+	bool enabled;
+	int i;
+
+	if (!header)
+		return;
+	record = tb_log_record_slot(header, header->seq);
+	memset(record, 0, sizeof(*record));
+	clock_gettime(CLOCK_REALTIME, &now);
+	record->seq = header->seq;
+	record->flags = flags;
+	record->timestamp_ms = (uint64_t) now.tv_sec * 1000 +
+			       now.tv_nsec / 1000000;
+	record->balancing_interval = tb->balancing_interval;
+	record->byte_weight = tb->byte_weight;
+	record->packet_weight = tb->packet_weight;
+	list_for_each_node_entry(tbpi, &tb->port_info_list, list) {
+		if (record->port_count == TB_LOG_PORT_MAX)
+			break;
+		log_port = &record->ports[record->port_count++];
+		log_port->ifindex = tbpi->tdport->ifindex;
+		if (!teamd_port_enabled(tb->ctx, tbpi->tdport, &enabled) &&
+		    enabled)
+			log_port->flags |= TB_LOG_PORT_ENABLED;
+		log_port->bytes = tb_stats_get_delta(&tbpi->stats);
+		log_port->packets = tb_stats_get_packets_delta(&tbpi->stats);
+	}
+	for (i = 0; i < HASH_COUNT; i++) {
+		tbhi = &tb->hash_info[i];
+		log_hash = &record->hashes[i];
+		log_hash->bytes = tb_stats_get_delta(&tbhi->stats);
+		log_hash->packets = tb_stats_get_packets_delta(&tbhi->stats);
+		log_hash->old_ifindex = tbhi->tdport ? tbhi->tdport->ifindex : 0;
+		log_hash->new_ifindex = log_hash->old_ifindex;
+		log_hash->idle_age = tbhi->idle_age;
+		if (tbhi->elephant)
+			log_hash->flags |= TB_LOG_HASH_ELEPHANT;
+	}
+	tb->log.record = record;
+}
+
+static void tb_log_hash_remapped(struct teamd_balancer *tb,
+				 struct tb_hash_info *tbhi,
+				 struct teamd_port *tdport)
+{
+	if (!tb->log.record)
+		return;
+	tb->log.record->hashes[tbhi->hash].new_ifindex = tdport->ifindex;
+}
+
+static void tb_log_port_evacuated(struct teamd_balancer *tb,
+				  struct teamd_port *tdport)
+{
+	struct tb_log_record *record = tb->log.record;
+	int i;
+
+	if (!record)
+		return;
+	for (i = 0; i < record->port_count; i++) {
+		if (record->ports[i].ifindex == tdport->ifindex)
+			record->ports[i].flags &= ~TB_LOG_PORT_ENABLED;
+	}
+}
+
+static void tb_log_record_end(struct teamd_balancer *tb)
+{
+	if (!tb->log.record)
+		return;
+	tb->log.header->seq++;
+	tb->log.record = NULL;
+}
+
+/* Drops the record being written, its slot is reused by the next one */
+static void tb_log_record_abort(struct teamd_balancer *tb)
+{
+	tb->log.record = NULL;
+}
+
+static int tb_rebalance(struct teamd_balancer *tb, struct team_handle *th)
+{
+	int err;
+	struct tb_hash_info *tbhi;
+	struct tb_port_info *tbpi;
+	uint64_t cost;
+	bool idle;
+
+	if (!tb->tx_balancing_enabled)
+		return 0;
+
+	tb_clear_rebalance_data(tb);
+	tb_log_record_begin(tb, 0);
+
+	if (tb->remap_policy == TB_REMAP_POLICY_IDLE_AWARE) {
+		unsigned int imbalance = tb_port_imbalance(tb);
+
+		if (imbalance > tb->busy_imbalance)
+			teamd_log_dbg("Imbalance %u%% exceeds %u%%, busy hashes may be remapped.",
+				      imbalance, tb->busy_imbalance);
+		else
+			tb_pin_busy_hashes(tb);
+	}
+	tb_pin_elephant_hashes(tb);
+
+	while ((tbhi = tb_get_biggest_unprocessed_hash(tb)) &&
+	       (tbpi = tb_get_least_loaded_port(tb))) {
+		/*
+		 * Do not remap zero delta hashes, except idle ones for
+		 * idle_aware policy. Those are the ones it moves, they are
+		 * accounted so they do not all end up on the same port.
+		 */
+		idle = tb->remap_policy == TB_REMAP_POLICY_IDLE_AWARE &&
+		       tb_hash_is_idle(tb, tbhi);
+		cost = tb_stats_get_cost(tb, &tbhi->stats);
+		if (tbhi->tdport && !cost && !idle) {
+			tbhi->rebalance.processed = true;
+			continue;
+		}
+		err = tb_hash_to_port_remap(th, tbhi, tbpi);
+		if (err) {
+			tbpi->rebalance.unusable = true;
+			continue;
+		}
+		tb_log_hash_remapped(tb, tbhi, tbpi->tdport);
+		tbpi->rebalance.load += cost + idle;
+		tbhi->rebalance.processed = true;
+	}
+	tb_log_record_end(tb);
+
+	list_for_each_node_entry(tbpi, &tb->port_info_list, list) {
+		if (tbpi->rebalance.unusable)
+			continue;
+		teamd_log_dbg("Port %s rebalanced, load: %" PRIu64,
+			      tbpi->tdport->ifname, tbpi->rebalance.load);
+	}
+	return 0;
+}
+
+/*
+ * Moves all hashes mapped to the given port to the remaining enabled ports
+ * right away, not waiting for the next stats refresh. Hashes are placed
+ * according to their load in the last interval, the regular rebalance
+ * refines the result later on.
+ */
+static int tb_port_evacuate(struct teamd_balancer *tb,
+			    struct teamd_port *tdport)
+{
+	struct team_handle *th = tb->ctx->th;
+	struct team_option *options[HASH_COUNT];
+	uint32_t ifindexes[HASH_COUNT];
+	struct teamd_port *tdports[HASH_COUNT];
+	int count = 0;
+	struct tb_hash_info *tbhi;
+	struct tb_port_info *tbpi;
+	struct tb_port_info *hash_tbpi;
+	bool enabled;
+	int err;
+	int i;
+
+	if (!tb->tx_balancing_enabled)
+		return 0;
+
+	tb_clear_rebalance_data(tb);
+
+	list_for_each_node_entry(tbpi, &tb->port_info_list, list) {
+		if (tbpi->tdport == tdport) {
+			tbpi->rebalance.unusable = true;
+			continue;
+		}
+		err = teamd_port_enabled(tb->ctx, tbpi->tdport, &enabled);
+		if (err || !enabled)
+			tbpi->rebalance.unusable = true;
+	}
+	for (i = 0; i < HASH_COUNT; i++) {
+		tbhi = &tb->hash_info[i];
+		if (tbhi->tdport == tdport)
+			continue;
+		tbhi->rebalance.processed = true;
+		if (!tbhi->tdport)
+			continue;
+		hash_tbpi = get_tb_port_info(tb, tbhi->tdport);
+		if (hash_tbpi)
+			hash_tbpi->rebalance.load +=
+				tb_stats_get_cost(tb, &tbhi->stats);
+	}
+
+	while ((tbhi = tb_get_biggest_unprocessed_hash(tb)) &&
+	       (tbpi = tb_get_least_loaded_port(tb))) {
+		options[count] = team_get_option(th, "na",
+						 "lb_tx_hash_to_port_mapping",
+						 tbhi->hash);
+		if (!options[count])
+			return -ENOENT;
+		tdports[count] = tbpi->tdport;
+		ifindexes[count++] = tbpi->tdport->ifindex;
+		/* Account idle hashes too so they do not all end up on the
+		 * same port.
+		 */
+		tbpi->rebalance.load += tb_stats_get_cost(tb, &tbhi->stats) + 1;
+		tbhi->rebalance.processed = true;
+	}
+	if (!count)
+		return 0;
+
+	tb_log_record_begin(tb, TB_LOG_RECORD_EVACUATION);
+	tb_log_port_evacuated(tb, tdport);
+	err = team_set_option_values_u32(th, options, ifindexes, count);
+	if (err) {
+		teamd_log_err("%s: Failed to evacuate hashes.", tdport->ifname);
+		tb_log_record_abort(tb);
+		return err;
+	}
+	for (i = 0; i < count; i++) {
+		tbhi = &tb->hash_info[team_get_option_array_index(options[i])];
+		tbhi->remap_count++;
+		tb_log_hash_remapped(tb, tbhi, tdports[i]);
+	}
+	tb_log_record_end(tb);
+	teamd_log_dbg("%s: Evacuated %d hashes.", tdport->ifname, count);
+	return 0;
+}
+
+static const uint64_t tb_cms_seeds[TB_CMS_DEPTH] = {
+	0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL,
+	0x165667b19e3779f9ULL, 0xd6e8feb86659fd93ULL,
+};
+
+static uint64_t tb_cms_add(struct tb_sampler *sampler, uint64_t key,
+			   uint64_t bytes)
+{
+	uint64_t estimate = UINT64_MAX;
+	uint64_t *counter;
+	int i;
+
+	for (i = 0; i < TB_CMS_DEPTH; i++) {
+		counter = &sampler->cms[i][(key * tb_cms_seeds[i]) >>
+					   (64 - TB_CMS_WIDTH_BITS)];
+		*counter += bytes;
+		if (*counter < estimate)
+			estimate = *counter;
+	}
+	return estimate;
+}
+
+struct tb_flow_tuple {
+	uint8_t dst[16];
+	uint8_t src[16];
+	uint16_t ethertype;
+	uint16_t vlan;
+	uint16_t sport;
+	uint16_t dport;
+	uint8_t l4proto;
+};
+
+static uint16_t tb_get_be16(const uint8_t *p)
+{
+	return p[0] << 8 | p[1];
+}
+
+static void tb_flow_tuple_get(struct tb_flow_tuple *tuple, const uint8_t *pkt,
+			      unsigned int len, const struct teamd_bpf_aux *aux)
+{
+	unsigned int off = ETH_HLEN;
+	unsigned int l4off;
+
+	memset(tuple, 0, sizeof(*tuple));
+	memcpy(tuple->dst, pkt, ETH_ALEN);
+	memcpy(tuple->src, pkt + ETH_ALEN, ETH_ALEN);
+	tuple->ethertype = tb_get_be16(pkt + 12);
+	if (aux->vlan_tag_present) {
+		tuple->vlan = aux->vlan_tag & 0xfff;
+	} else if (tuple->ethertype == ETH_P_8021Q && len >= off + 4) {
+		tuple->vlan = tb_get_be16(pkt + off) & 0xfff;
+		tuple->ethertype = tb_get_be16(pkt + off + 2);
+		off += 4;
+	}
+
+	if (tuple->ethertype == ETH_P_IP && len >= off + 20) {
+		memset(tuple->dst, 0, ETH_ALEN);
+		memset(tuple->src, 0, ETH_ALEN);
+		memcpy(tuple->src, pkt + off + 12, 4);
+		memcpy(tuple->dst, pkt + off + 16, 4);
+		tuple->l4proto = pkt[off + 9];
+		/* Only first fragment carries ports */
+		if (tb_get_be16(pkt + off + 6) & 0x1fff)
+			return;
+		l4off = off + (pkt[off] & 0xf) * 4;
+	} else if (tuple->ethertype == ETH_P_IPV6 && len >= off + 40) {
+		memcpy(tuple->src, pkt + off + 8, 16);
+		memcpy(tuple->dst, pkt + off + 24, 16);
+		tuple->l4proto = pkt[off + 6];
+		l4off = off + 40;
+	} else {
+		return;
+	}
+
+	switch (tuple->l4proto) {
+	case IPPROTO_TCP:
+	case IPPROTO_UDP:
+	case IPPROTO_SCTP:
+		if (len < l4off + 4)
+			return;
+		tuple->sport = tb_get_be16(pkt + l4off);
+		tuple->dport = tb_get_be16(pkt + l4off + 2);
+	}
+}
+
+/* FNV-1a */
+static uint64_t tb_flow_key(const struct tb_flow_tuple *tuple)
+{
+	const uint8_t *p = (const uint8_t *) tuple;
+	uint64_t key = 0xcbf29ce484222325ULL;
+	int i;
+
+	for (i = 0; i < sizeof(*tuple); i++) {
+		key ^= p[i];
+		key *= 0x100000001b3ULL;
+	}
+	return key;
+}
+
+static void tb_flow_desc_fill(struct tb_flow *flow,
+			      const struct tb_flow_tuple *tuple)
+{
+	char src[INET6_ADDRSTRLEN];
+	char dst[INET6_ADDRSTRLEN];
+	int family;
+
+	switch (tuple->ethertype) {
+	case ETH_P_IP:
+		family = AF_INET;
+		break;
+	case ETH_P_IPV6:
+		family = AF_INET6;
+		break;
+	default:
+		snprintf(flow->desc, sizeof(flow->desc),
+			 "%02x:%02x:%02x:%02x:%02x:%02x > "
+			 "%02x:%02x:%02x:%02x:%02x:%02x type 0x%04x",
+			 tuple->src[0], tuple->src[1], tuple->src[2],
+			 tuple->src[3], tuple->src[4], tuple->src[5],
+			 tuple->dst[0], tuple->dst[1], tuple->dst[2],
+			 tuple->dst[3], tuple->dst[4], tuple->dst[5],
+			 tuple->ethertype);
+		return;
+	}
+	inet_ntop(family, tuple->src, src, sizeof(src));
+	inet_ntop(family, tuple->dst, dst, sizeof(dst));
+	snprintf(flow->desc, sizeof(flow->desc), "%s:%u > %s:%u proto %u",
+		 src, tuple->sport, dst, tuple->dport, tuple->l4proto);
+}
+
+static void tb_top_flows_update(struct tb_sampler *sampler, uint64_t key,
+				uint8_t hash, uint64_t bytes,
+				const struct tb_flow_tuple *tuple)
+{
+	struct tb_flow *min_flow = NULL;
+	struct tb_flow *flow;
+	int i;
+
+	for (i = 0; i < sampler->top_count; i++) {
+		flow = &sampler->top[i];
+		if (flow->bytes && flow->key == key) {
+			flow->bytes = bytes;
+			flow->hash = hash;
+			return;
+		}
+		if (!min_flow || flow->bytes < min_flow->bytes)
+			min_flow = flow;
+	}
+	if (!min_flow || min_flow->bytes >= bytes)
+		return;
+	min_flow->key = key;
+	min_flow->hash = hash;
+	min_flow->bytes = bytes;
+	tb_flow_desc_fill(min_flow, tuple);
+}
+
+/* Kernel provides byte counts only, packet counts are estimated from samples */
+static void tb_sampler_count_packet(struct teamd_balancer *tb, uint8_t hash)
+{
+	struct tb_hash_info *tbhi = &tb->hash_info[hash];
+	struct tb_port_info *tbpi;
+
+	tbhi->stats.curr_packets += tb->sampler.rate;
+	if (!tbhi->tdport)
+		return;
+	tbpi = get_tb_port_info(tb, tbhi->tdport);
+	if (tbpi)
+		tbpi->stats.curr_packets += tb->sampler.rate;
+}
+
+static int tb_sampler_process(struct teamd_balancer *tb, const uint8_t *pkt,
+			      unsigned int len, unsigned int pkt_len,
+			      const struct teamd_bpf_aux *aux)
+{
+	struct tb_sampler *sampler = &tb->sampler;
+	struct tb_flow_tuple tuple;
+	uint32_t hash32;
+	uint64_t bytes;
+	uint64_t key;
+	uint8_t hash;
+	int err;
+
+	if (len < ETH_HLEN || !sampler->hash_fprog.len)
+		return 0;
+
+	/* Compute the hash the same way kernel does for this packet */
+	err = teamd_bpf_run(&sampler->hash_fprog, pkt, len, aux, &hash32);
+	if (err)
+		return err;
+	hash = hash32 ^ hash32 >> 8 ^ hash32 >> 16 ^ hash32 >> 24;
+
+	tb_flow_tuple_get(&tuple, pkt, len, aux);
+	key = tb_flow_key(&tuple);
+	tb->hash_info[hash].flow_bitmap |= 1ULL << (key & 63);
+	tb_sampler_count_packet(tb, hash);
+
+	bytes = tb_cms_add(sampler, key, (uint64_t) pkt_len * sampler->rate);
+	tb_top_flows_update(sampler, key, hash, bytes, &tuple);
+	return 0;
+}
+
+/*
+ * Called once per stats refresh. The number of flows per hash is a lower
+ * bound estimate saturating at 64.
+ */
+static void tb_sampler_interval(struct teamd_balancer *tb)
+{
+	struct tb_sampler *sampler = &tb->sampler;
+	struct tb_hash_info *tbhi;
+	struct tb_flow *flow;
+	int i, j;
+
+	if (sampler->sock == -1)
+		return;
+
+	for (i = 0; i < HASH_COUNT; i++) {
+		tbhi = &tb->hash_info[i];
+		tbhi->flows = __builtin_popcountll(tbhi->flow_bitmap);
+		tbhi->flow_bitmap = 0;
+		tbhi->elephant = false;
+	}
+	for (i = 0; i < sampler->top_count; i++) {
+		flow = &sampler->top[i];
+		if (!flow->bytes)
+			continue;
+		tbhi = &tb->hash_info[flow->hash];
+		if (tbhi->flows == 1)
+			tbhi->elephant = true;
+		flow->bytes >>= 1;
+		if (!flow->bytes)
+			memset(flow, 0, sizeof(*flow));
+	}
+	for (i = 0; i < TB_CMS_DEPTH; i++)
+		for (j = 0; j < TB_CMS_WIDTH; j++)
+			sampler->cms[i][j] >>= 1;
+}
+
+#define TB_SAMPLER_BUDGET 64
+
+static int tb_callback_sampler(struct teamd_context *ctx, int events,
+			       void *priv)
+{
+	struct teamd_balancer *tb = priv;
+	uint8_t buf[TB_SAMPLER_SNAPLEN_MAX];
+	union {
+		struct cmsghdr cmsg;
+		char buf[CMSG_SPACE(sizeof(struct tpacket_auxdata))];
+	} cmsg_buf;
+	struct iovec iov = {
+		.iov_base = buf,
+		.iov_len = tb->sampler.snaplen,
+	};
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+	};
+	struct teamd_bpf_aux aux;
+	struct tpacket_auxdata *auxdata;
+	struct cmsghdr *cmsg;
+	unsigned int pkt_len;
+	ssize_t ret;
+	int budget;
+	int err;
+
+	for (budget = TB_SAMPLER_BUDGET; budget; budget--) {
+		msg.msg_control = &cmsg_buf;
+		msg.msg_controllen = sizeof(cmsg_buf);
+		ret = recvmsg(tb->sampler.sock, &msg, MSG_DONTWAIT);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK ||
+			    errno == ENETDOWN)
+				return 0;
+			teamd_log_err("Failed to receive sampled packet.");
+			return -errno;
+		}
+
+		memset(&aux, 0, sizeof(aux));
+		pkt_len = ret;
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+		     cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (cmsg->cmsg_level != SOL_PACKET ||
+			    cmsg->cmsg_type != PACKET_AUXDATA)
+				continue;
+			auxdata = (struct tpacket_auxdata *) CMSG_DATA(cmsg);
+			pkt_len = auxdata->tp_len;
+			if (auxdata->tp_status & TP_STATUS_VLAN_VALID) {
+				aux.vlan_tag_present = true;
+				aux.vlan_tag = auxdata->tp_vlan_tci;
+			}
+		}
+
+		err = tb_sampler_process(tb, buf, ret, pkt_len, &aux);
+		if (err)
+			teamd_log_dbg("Failed to process sampled packet (%d).",
+				      err);
+	}
+	return 0;
+}
+
+#define TB_SAMPLER_CB_NAME "tb_sampler"
+
+/*
+ * Looking the hash function up in option list is too slow to be done for
+ * every sampled packet, so it is copied. Called again when it changes.
+ */
+static int tb_sampler_hash_func_update(struct teamd_balancer *tb)
+{
+	struct tb_sampler *sampler = &tb->sampler;
+	struct sock_filter *filter = NULL;
+	struct sock_fprog fprog;
+	int err;
+
+	err = team_get_bpf_hash_func(tb->ctx->th, &fprog);
+	if (err)
+		fprog.len = 0;
+	if (fprog.len) {
+		filter = malloc(fprog.len * sizeof(*filter));
+		if (!filter)
+			return -ENOMEM;
+		memcpy(filter, fprog.filter, fprog.len * sizeof(*filter));
 	}
-	return best_tbhi;
+	free(sampler->hash_fprog.filter);
+	sampler->hash_fprog.filter = filter;
+	sampler->hash_fprog.len = fprog.len;
+	if (fprog.len && teamd_bpf_load_len(&fprog) > sampler->snaplen)
+		teamd_log_warn("Hash function loads beyond %u bytes, hashes of some sampled packets may be computed wrong.",
+			       sampler->snaplen);
+	return err;
 }
 
-static void tb_clear_rebalance_data(struct teamd_balancer *tb)
+static int tb_sampler_init(struct teamd_balancer *tb)
 {
-	struct tb_port_info *tbpi;
-	int i;
+	struct tb_sampler *sampler = &tb->sampler;
+	struct teamd_context *ctx = tb->ctx;
+	struct sock_fprog fprog;
+	int val = 1;
+	int err;
 
-	list_for_each_node_entry(tbpi, &tb->port_info_list, list) {
-		tbpi->rebalance.bytes = 0;
-		tbpi->rebalance.unusable = false;
+	sampler->sock = -1;
+	if (!tb->tx_balancing_enabled || !sampler->rate)
+		return 0;
+
+	/*
+	 * Sampled packet has to carry all the bytes hash function loads,
+	 * otherwise hash computed here may differ from the one of kernel.
+	 */
+	sampler->snaplen = TB_SAMPLER_SNAPLEN_MAX;
+	if (!team_get_bpf_hash_func(ctx->th, &fprog))
+		sampler->snaplen = teamd_bpf_load_len(&fprog);
+	if (sampler->snaplen < TB_SAMPLER_SNAPLEN_MIN)
+		sampler->snaplen = TB_SAMPLER_SNAPLEN_MIN;
+	if (sampler->snaplen > TB_SAMPLER_SNAPLEN_MAX)
+		sampler->snaplen = TB_SAMPLER_SNAPLEN_MAX;
+	teamd_log_dbg("Sampler snaplen %u.", sampler->snaplen);
+	err = tb_sampler_hash_func_update(tb);
+	if (err && err != -ENOENT)
+		return err;
+
+	err = teamd_bpf_sampler_compile(&fprog, sampler->rate,
+					sampler->snaplen);
+	if (err) {
+		teamd_log_err("Failed to compile sampler filter.");
+		goto free_hash_func;
 	}
-	for (i = 0; i < HASH_COUNT; i++) {
-		tb->hash_info[i].rebalance.processed = false;
+	err = teamd_packet_sock_open_type(SOCK_RAW, &sampler->sock,
+					  ctx->ifindex, htons(ETH_P_ALL),
+					  &fprog, &fprog);
+	teamd_bpf_desc_compile_release(&fprog);
+	if (err) {
+		sampler->sock = -1;
+		goto free_hash_func;
 	}
+	if (setsockopt(sampler->sock, SOL_PACKET, PACKET_AUXDATA,
+		       &val, sizeof(val)) == -1) {
+		teamd_log_err("Failed to enable packet auxdata.");
+		err = -errno;
+		goto close_sock;
+	}
+
+	err = teamd_loop_callback_fd_add(ctx, TB_SAMPLER_CB_NAME, tb,
+					 tb_callback_sampler, sampler->sock,
+					 TEAMD_LOOP_FD_EVENT_READ);
+	if (err) {
+		teamd_log_err("Failed add sampler callback.");
+		goto close_sock;
+	}
+	teamd_loop_callback_enable(ctx, TB_SAMPLER_CB_NAME, tb);
+	teamd_log_info("Sampling every %u. packet, tracking %u top flows.",
+		       sampler->rate, sampler->top_count);
+	return 0;
+
+close_sock:
+	close(sampler->sock);
+	sampler->sock = -1;
+free_hash_func:
+	free(sampler->hash_fprog.filter);
+	sampler->hash_fprog.filter = NULL;
+	return err;
 }
 
-static int tb_hash_to_port_remap(struct team_handle *th,
-				 struct tb_hash_info *tbhi,
-				 struct tb_port_info *tbpi)
+static void tb_sampler_fini(struct teamd_balancer *tb)
 {
-	struct team_option *option;
-	struct teamd_port *new_tdport = tbpi->tdport;
-	uint8_t hash = tbhi->hash;
-	int err;
+	if (tb->sampler.sock == -1)
+		return;
+	teamd_loop_callback_del(tb->ctx, TB_SAMPLER_CB_NAME, tb);
+	close(tb->sampler.sock);
+	tb->sampler.sock = -1;
+	free(tb->sampler.hash_fprog.filter);
+	tb->sampler.hash_fprog.filter = NULL;
+}
 
-	if (tbhi->tdport == new_tdport)
-		return 0;
+static int tb_set_lb_stats_refresh_interval(struct team_handle *th,
+					    struct teamd_balancer *tb)
+{
+	struct team_option *option;
 
-	option = team_get_option(th, "na", "lb_tx_hash_to_port_mapping", hash);
+	option = team_get_option(th, "n!", "lb_stats_refresh_interval");
 	if (!option)
 		return -ENOENT;
-	err = team_set_option_value_u32(th, option, new_tdport->ifindex);
-	if (err)
-		return err;
-	teamd_log_dbg("Remapped hash \"%u\" (delta %" PRIu64 ") to port %s.",
-		      hash, tb_stats_get_delta(&tbhi->stats),
-		      new_tdport->ifname);
-	return 0;
+	return team_set_option_value_u32(th, option, tb->balancing_interval);
 }
 
-static int tb_rebalance(struct teamd_balancer *tb, struct team_handle *th)
+static unsigned int tb_rate_shift(uint64_t rate, uint64_t last_rate)
 {
-	int err;
-	struct tb_hash_info *tbhi;
-	struct tb_port_info *tbpi;
+	uint64_t max_rate = rate > last_rate ? rate : last_rate;
+	uint64_t diff = rate > last_rate ? rate - last_rate : last_rate - rate;
 
-	if (!tb->tx_balancing_enabled)
+	if (!max_rate)
 		return 0;
+	return diff * 100 / max_rate;
+}
 
-	tb_clear_rebalance_data(tb);
+/*
+ * Halves the stats refresh interval while ports are imbalanced or the
+ * total load shifts, grows it by half while the traffic is stable.
+ */
+static int tb_balancing_interval_adapt(struct teamd_balancer *tb,
+				       struct team_handle *th)
+{
+	uint32_t interval = tb->balancing_interval;
+	uint64_t total = 0;
+	unsigned int imbalance;
+	unsigned int shift;
+	uint64_t rate;
+	int i;
 
-	while ((tbhi = tb_get_biggest_unprocessed_hash(tb)) &&
-	       (tbpi = tb_get_least_loaded_port(tb))) {
-		/* Do not remap zero delta hashes */
-		if (tbhi->tdport && !tb_stats_get_delta(&tbhi->stats)) {
-			tbhi->rebalance.processed = true;
-			continue;
-		}
-		err = tb_hash_to_port_remap(th, tbhi, tbpi);
-		if (err) {
-			tbpi->rebalance.unusable = true;
-			continue;
-		}
-		tbpi->rebalance.bytes += tb_stats_get_delta(&tbhi->stats);
-		tbhi->rebalance.processed = true;
-	}
+	if (!tb->adaptive.enabled)
+		return 0;
 
-	list_for_each_node_entry(tbpi, &tb->port_info_list, list) {
-		if (tbpi->rebalance.unusable)
-			continue;
-		teamd_log_dbg("Port %s rebalanced, delta: %" PRIu64,
-			      tbpi->tdport->ifname, tbpi->rebalance.bytes);
-	}
-	return 0;
+	for (i = 0; i < HASH_COUNT; i++)
+		total += tb_stats_get_delta(&tb->hash_info[i].stats);
+	rate = total / (interval ? interval : 1);
+	shift = tb_rate_shift(rate, tb->adaptive.last_rate);
+	tb->adaptive.last_rate = rate;
+	imbalance = tb_port_imbalance(tb);
+
+	if (imbalance > tb->adaptive.stable_threshold ||
+	    shift > tb->adaptive.stable_threshold)
+		interval /= 2;
+	else
+		interval += interval / 2 ? interval / 2 : 1;
+	if (interval < tb->adaptive.min_interval)
+		interval = tb->adaptive.min_interval;
+	if (interval > tb->adaptive.max_interval)
+		interval = tb->adaptive.max_interval;
+	if (interval == tb->balancing_interval)
+		return 0;
+
+	teamd_log_dbg("Balancing interval %u -> %u (imbalance %u%%, load shift %u%%).",
+		      tb->balancing_interval, interval, imbalance, shift);
+	tb->balancing_interval = interval;
+	return tb_set_lb_stats_refresh_interval(th, tb);
 }
 
 struct lb_stats {
@@ -245,6 +1249,7 @@ static int tb_option_change_handler_func(struct team_handle *th, void *priv,
 	struct teamd_context *ctx = tb->ctx;
 	struct team_option *option;
 	bool rebalance_needed = false;
+	bool stats_changed = false;
 
 	team_for_each_option(option, ctx->th) {
 		char *name = team_get_option_name(option);
@@ -272,9 +1277,13 @@ static int tb_option_change_handler_func(struct team_handle *th, void *priv,
 		}
 		if (!changed)
 			continue;
+		if (!strcmp(name, "bpf_hash_func") && tb->sampler.sock != -1 &&
+		    tb_sampler_hash_func_update(tb))
+			teamd_log_warn("Failed to update sampler hash function.");
 		if (!strcmp(name, "lb_hash_stats") ||
-		    !strcmp(name, "lb_port_stats") ||
-		    !strcmp(name, "enabled"))
+		    !strcmp(name, "lb_port_stats"))
+			stats_changed = true;
+		if (stats_changed || !strcmp(name, "enabled"))
 			rebalance_needed = true;
 	}
 
@@ -326,6 +1335,16 @@ static int tb_option_change_handler_func(struct team_handle *th, void *priv,
 		}
 	}
 
+	if (stats_changed) {
+		int err;
+
+		tb_idle_age_update(tb);
+		tb_sampler_interval(tb);
+		err = tb_balancing_interval_adapt(tb, th);
+		if (err)
+			teamd_log_warn("Failed to adapt balancing interval.");
+	}
+
 	return tb_rebalance(tb, th);
 }
 
@@ -353,6 +1372,177 @@ static uint32_t tb_get_balancing_interval(struct teamd_context *ctx)
 	return balancing_interval;
 }
 
+static enum tb_remap_policy tb_get_remap_policy(struct teamd_context *ctx)
+{
+	const char *policy_name;
+	int err;
+	int i;
+
+	err = teamd_config_string_get(ctx, &policy_name, "$.runner.tx_balancer.remap_policy");
+	if (err)
+		return TB_REMAP_POLICY_GREEDY;
+	for (i = 0; i < ARRAY_SIZE(tb_remap_policy_names); i++) {
+		if (!strcmp(policy_name, tb_remap_policy_names[i]))
+			return i;
+	}
+	teamd_log_warn("Unknown remap policy \"%s\", using \"%s\".",
+		       policy_name,
+		       tb_remap_policy_names[TB_REMAP_POLICY_GREEDY]);
+	return TB_REMAP_POLICY_GREEDY;
+}
+
+static int tb_get_uint(struct teamd_context *ctx, unsigned int *p_val,
+		       const char *name, unsigned int dflt)
+{
+	int err;
+	int val;
+
+	err = teamd_config_int_get(ctx, &val, "$.runner.tx_balancer.%s", name);
+	if (err) {
+		*p_val = dflt;
+		return 0;
+	}
+	if (val < 0) {
+		teamd_log_err("\"%s\" must not be negative number.", name);
+		return -EINVAL;
+	}
+	*p_val = val;
+	return 0;
+}
+
+static int tb_get_log_size(struct teamd_context *ctx, uint32_t *p_size)
+{
+	int err;
+	int val;
+
+	err = teamd_config_int_get(ctx, &val,
+				   "$.runner.tx_balancer.decision_log_size");
+	if (err)
+		val = TB_DFLT_LOG_RECORD_COUNT;
+	if (val <= 0 || val > TB_MAX_LOG_RECORD_COUNT) {
+		teamd_log_err("Decision log size %d out of range 1 - %d.",
+			      val, TB_MAX_LOG_RECORD_COUNT);
+		return -EINVAL;
+	}
+	*p_size = val;
+	return 0;
+}
+
+static int tb_get_weight(struct teamd_context *ctx, uint64_t *p_weight,
+			 const char *name, int dflt)
+{
+	int err;
+	int val;
+
+	err = teamd_config_int_get(ctx, &val, "$.runner.tx_balancer.%s", name);
+	if (err)
+		val = dflt;
+	if (val < 0) {
+		teamd_log_err("\"%s\" must not be negative number.", name);
+		return -EINVAL;
+	}
+	*p_weight = val;
+	return 0;
+}
+
+static int tb_get_metric(struct teamd_context *ctx, struct teamd_balancer *tb)
+{
+	const char *metric_name;
+	int err;
+	int i;
+
+	tb->metric = TB_METRIC_BYTES;
+	err = teamd_config_string_get(ctx, &metric_name, "$.runner.tx_balancer.metric");
+	if (!err) {
+		for (i = 0; i < ARRAY_SIZE(tb_metric_names); i++) {
+			if (!strcmp(metric_name, tb_metric_names[i]))
+				break;
+		}
+		if (i == ARRAY_SIZE(tb_metric_names)) {
+			teamd_log_err("Unknown balancing metric \"%s\".",
+				      metric_name);
+			return -EINVAL;
+		}
+		tb->metric = i;
+	}
+
+	switch (tb->metric) {
+	case TB_METRIC_BYTES:
+		tb->byte_weight = 1;
+		tb->packet_weight = 0;
+		break;
+	case TB_METRIC_PACKETS:
+		tb->byte_weight = 0;
+		tb->packet_weight = 1;
+		break;
+	case TB_METRIC_COMBINED:
+		err = tb_get_weight(ctx, &tb->byte_weight, "byte_weight",
+				    TB_DFLT_BYTE_WEIGHT);
+		if (err)
+			return err;
+		err = tb_get_weight(ctx, &tb->packet_weight, "packet_weight",
+				    TB_DFLT_PACKET_WEIGHT);
+		if (err)
+			return err;
+		if (!tb->byte_weight && !tb->packet_weight) {
+			teamd_log_err("\"byte_weight\" and \"packet_weight\" must not be both zero.");
+			return -EINVAL;
+		}
+		break;
+	}
+	return 0;
+}
+
+static int tb_get_adaptive(struct teamd_context *ctx,
+			   struct teamd_balancer *tb)
+{
+	int err;
+
+	err = teamd_config_bool_get(ctx, &tb->adaptive.enabled,
+				    "$.runner.tx_balancer.adaptive_interval");
+	if (err)
+		tb->adaptive.enabled = TB_DFLT_ADAPTIVE_INTERVAL;
+	err = tb_get_uint(ctx, &tb->adaptive.min_interval,
+			  "min_balancing_interval",
+			  TB_DFLT_MIN_BALANCING_INTERVAL);
+	if (err)
+		return err;
+	err = tb_get_uint(ctx, &tb->adaptive.max_interval,
+			  "max_balancing_interval",
+			  TB_DFLT_MAX_BALANCING_INTERVAL);
+	if (err)
+		return err;
+	err = tb_get_uint(ctx, &tb->adaptive.stable_threshold,
+			  "stable_threshold", TB_DFLT_STABLE_THRESHOLD);
+	if (err)
+		return err;
+	if (!tb->adaptive.min_interval)
+		tb->adaptive.min_interval = 1;
+	if (tb->adaptive.max_interval < tb->adaptive.min_interval) {
+		teamd_log_err("\"max_balancing_interval\" must not be lower than \"min_balancing_interval\".");
+		return -EINVAL;
+	}
+	if (!tb->adaptive.enabled)
+		return 0;
+	/* Initial interval has to be in bounds as well */
+	if (tb->balancing_interval < tb->adaptive.min_interval)
+		tb->balancing_interval = tb->adaptive.min_interval;
+	if (tb->balancing_interval > tb->adaptive.max_interval)
+		tb->balancing_interval = tb->adaptive.max_interval;
+	return 0;
+}
+
+static void tb_get_latency_aware(struct teamd_context *ctx,
+				 struct teamd_balancer *tb)
+{
+	int err;
+
+	err = teamd_config_bool_get(ctx, &tb->latency_aware,
+				    "$.runner.tx_balancer.latency_aware");
+	if (err)
+		tb->latency_aware = TB_DFLT_LATENCY_AWARE;
+}
+
 static int tb_set_lb_tx_method(struct team_handle *th,
 			       struct teamd_balancer *tb)
 {
@@ -366,15 +1556,205 @@ static int tb_set_lb_tx_method(struct team_handle *th,
 					    "hash_to_port_mapping" : "hash");
 }
 
-static int tb_set_lb_stats_refresh_interval(struct team_handle *th,
-					    struct teamd_balancer *tb)
+static int tb_state_idle_age_get(struct teamd_context *ctx,
+				 struct team_state_gsc *gsc,
+				 void *priv)
 {
-	struct team_option *option;
+	struct tb_hash_info *tbhi = priv;
 
-	option = team_get_option(th, "n!", "lb_stats_refresh_interval");
-	if (!option)
-		return -ENOENT;
-	return team_set_option_value_u32(th, option, tb->balancing_interval);
+	gsc->data.int_val = tbhi->idle_age;
+	return 0;
+}
+
+static int tb_state_remap_count_get(struct teamd_context *ctx,
+				    struct team_state_gsc *gsc,
+				    void *priv)
+{
+	struct tb_hash_info *tbhi = priv;
+
+	gsc->data.int_val = tbhi->remap_count;
+	return 0;
+}
+
+static int tb_state_flows_get(struct teamd_context *ctx,
+			      struct team_state_gsc *gsc,
+			      void *priv)
+{
+	struct tb_hash_info *tbhi = priv;
+
+	gsc->data.int_val = tbhi->flows;
+	return 0;
+}
+
+/* Registered for idle_aware remap policy only */
+static const struct teamd_state_val tb_hash_state_vals[] = {
+	{
+		.subpath = "idle_age",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = tb_state_idle_age_get,
+	},
+	{
+		.subpath = "remap_count",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = tb_state_remap_count_get,
+	},
+};
+
+static const struct teamd_state_val tb_hash_state_vg = {
+	.vals = tb_hash_state_vals,
+	.vals_count = ARRAY_SIZE(tb_hash_state_vals),
+};
+
+/* Registered only if sampler is enabled */
+static const struct teamd_state_val tb_hash_sampler_state_vals[] = {
+	{
+		.subpath = "flows",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = tb_state_flows_get,
+	},
+};
+
+static const struct teamd_state_val tb_hash_sampler_state_vg = {
+	.vals = tb_hash_sampler_state_vals,
+	.vals_count = ARRAY_SIZE(tb_hash_sampler_state_vals),
+};
+
+static int tb_state_flow_desc_get(struct teamd_context *ctx,
+				  struct team_state_gsc *gsc,
+				  void *priv)
+{
+	struct tb_flow *flow = priv;
+
+	gsc->data.str_val.ptr = flow->desc;
+	return 0;
+}
+
+static int tb_state_flow_hash_get(struct teamd_context *ctx,
+				  struct team_state_gsc *gsc,
+				  void *priv)
+{
+	struct tb_flow *flow = priv;
+
+	gsc->data.int_val = flow->hash;
+	return 0;
+}
+
+static int tb_state_flow_kbytes_get(struct teamd_context *ctx,
+				    struct team_state_gsc *gsc,
+				    void *priv)
+{
+	struct tb_flow *flow = priv;
+	uint64_t kbytes = flow->bytes / 1024;
+
+	gsc->data.int_val = kbytes > INT_MAX ? INT_MAX : kbytes;
+	return 0;
+}
+
+static const struct teamd_state_val tb_flow_state_vals[] = {
+	{
+		.subpath = "flow",
+		.type = TEAMD_STATE_ITEM_TYPE_STRING,
+		.getter = tb_state_flow_desc_get,
+	},
+	{
+		.subpath = "hash",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = tb_state_flow_hash_get,
+	},
+	{
+		.subpath = "kbytes",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = tb_state_flow_kbytes_get,
+	},
+};
+
+static const struct teamd_state_val tb_flow_state_vg = {
+	.vals = tb_flow_state_vals,
+	.vals_count = ARRAY_SIZE(tb_flow_state_vals),
+};
+
+static int tb_state_balancing_interval_get(struct teamd_context *ctx,
+					   struct team_state_gsc *gsc,
+					   void *priv)
+{
+	struct teamd_balancer *tb = priv;
+
+	gsc->data.int_val = tb->balancing_interval;
+	return 0;
+}
+
+static const struct teamd_state_val tb_state_vals[] = {
+	{
+		.subpath = "balancing_interval",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = tb_state_balancing_interval_get,
+	},
+};
+
+static const struct teamd_state_val tb_state_vg = {
+	.vals = tb_state_vals,
+	.vals_count = ARRAY_SIZE(tb_state_vals),
+};
+
+static void tb_state_unregister(struct teamd_balancer *tb)
+{
+	int i;
+
+	teamd_state_val_unregister(tb->ctx, &tb_state_vg, tb);
+	for (i = 0; i < HASH_COUNT; i++) {
+		teamd_state_val_unregister(tb->ctx, &tb_hash_state_vg,
+					   &tb->hash_info[i]);
+		teamd_state_val_unregister(tb->ctx, &tb_hash_sampler_state_vg,
+					   &tb->hash_info[i]);
+	}
+	for (i = 0; i < TB_TOP_FLOWS_MAX; i++)
+		teamd_state_val_unregister(tb->ctx, &tb_flow_state_vg,
+					   &tb->sampler.top[i]);
+}
+
+static int tb_state_register(struct teamd_balancer *tb)
+{
+	int err;
+	int i;
+
+	err = teamd_state_val_register_ex(tb->ctx, &tb_state_vg, tb, NULL,
+					  "runner.tx_balancer");
+	if (err)
+		return err;
+	for (i = 0; i < HASH_COUNT; i++) {
+		if (tb->remap_policy != TB_REMAP_POLICY_IDLE_AWARE)
+			break;
+		err = teamd_state_val_register_ex(tb->ctx, &tb_hash_state_vg,
+						  &tb->hash_info[i], NULL,
+						  "runner.tx_balancer.hashes.hash_%u",
+						  i);
+		if (err)
+			goto unregister;
+	}
+	if (tb->sampler.sock == -1)
+		return 0;
+	for (i = 0; i < HASH_COUNT; i++) {
+		err = teamd_state_val_register_ex(tb->ctx,
+						  &tb_hash_sampler_state_vg,
+						  &tb->hash_info[i], NULL,
+						  "runner.tx_balancer.hashes.hash_%u",
+						  i);
+		if (err)
+			goto unregister;
+	}
+	for (i = 0; i < tb->sampler.top_count; i++) {
+		err = teamd_state_val_register_ex(tb->ctx, &tb_flow_state_vg,
+						  &tb->sampler.top[i], NULL,
+						  "runner.tx_balancer.top_flows.flow_%u",
+						  i);
+		if (err)
+			goto unregister;
+	}
+	return 0;
+
+unregister:
+	tb_state_unregister(tb);
+	return err;
 }
 
 static const struct team_change_handler tb_option_change_handler = {
@@ -385,6 +1765,8 @@ static const struct team_change_handler tb_option_change_handler = {
 int teamd_balancer_init(struct teamd_context *ctx, struct teamd_balancer **ptb)
 {
 	struct teamd_balancer *tb;
+	const char *log_path;
+	unsigned int idle_bytes;
 	int err;
 	int i;
 
@@ -398,6 +1780,39 @@ int teamd_balancer_init(struct teamd_context *ctx, struct teamd_balancer **ptb)
 
 	tb->tx_balancing_enabled = tb_get_enable_tx_balancing(ctx);
 	tb->balancing_interval = tb_get_balancing_interval(ctx);
+	tb->remap_policy = tb_get_remap_policy(ctx);
+	err = tb_get_uint(ctx, &tb->idle_intervals, "idle_intervals",
+			  TB_DFLT_IDLE_INTERVALS);
+	if (err)
+		goto err_get_uint;
+	err = tb_get_uint(ctx, &idle_bytes, "idle_bytes", TB_DFLT_IDLE_BYTES);
+	if (err)
+		goto err_get_uint;
+	tb->idle_bytes = idle_bytes;
+	err = tb_get_uint(ctx, &tb->busy_imbalance, "busy_imbalance",
+			  TB_DFLT_BUSY_IMBALANCE);
+	if (err)
+		goto err_get_uint;
+	err = tb_get_adaptive(ctx, tb);
+	if (err)
+		goto err_get_adaptive;
+	tb_get_latency_aware(ctx, tb);
+	err = tb_get_uint(ctx, &tb->sampler.rate, "sample_rate",
+			  TB_DFLT_SAMPLE_RATE);
+	if (err)
+		goto err_get_uint;
+	err = tb_get_uint(ctx, &tb->sampler.top_count, "top_flows",
+			  TB_DFLT_TOP_FLOWS);
+	if (err)
+		goto err_get_uint;
+	if (tb->sampler.top_count > TB_TOP_FLOWS_MAX)
+		tb->sampler.top_count = TB_TOP_FLOWS_MAX;
+	err = tb_get_metric(ctx, tb);
+	if (err)
+		goto err_get_metric;
+	if (tb->packet_weight && !tb->sampler.rate)
+		teamd_log_warn("Balancing metric \"%s\" uses packet counts which are available only if sampler is enabled.",
+			       tb_metric_names[tb->metric]);
 
 	err = tb_set_lb_tx_method(ctx->th, tb);
 	if (err) {
@@ -413,10 +1828,39 @@ int teamd_balancer_init(struct teamd_context *ctx, struct teamd_balancer **ptb)
 			teamd_log_err("Failed to set lb_stats_refresh_interval.");
 			goto err_set_lb_stats_refresh_interval;
 		}
-		teamd_log_info("Balancing interval %u.", tb->balancing_interval);
+		teamd_log_info("Balancing interval %u%s.", tb->balancing_interval,
+			       tb->adaptive.enabled ? " (adaptive)" : "");
+		teamd_log_info("Remap policy %s.",
+			       tb_remap_policy_names[tb->remap_policy]);
+		teamd_log_info("Balancing metric %s.",
+			       tb_metric_names[tb->metric]);
 	}
 
 	tb->ctx = ctx;
+	if (tb->tx_balancing_enabled &&
+	    !teamd_config_string_get(ctx, &log_path,
+				     "$.runner.tx_balancer.decision_log")) {
+		uint32_t log_size;
+
+		err = tb_get_log_size(ctx, &log_size);
+		if (err)
+			goto err_log_open;
+		err = tb_log_open(tb, log_path, log_size);
+		if (err)
+			goto err_log_open;
+	}
+	err = tb_sampler_init(tb);
+	if (err) {
+		teamd_log_err("Failed to init flow sampler.");
+		goto err_sampler_init;
+	}
+	if (tb->tx_balancing_enabled) {
+		err = tb_state_register(tb);
+		if (err) {
+			teamd_log_err("Failed to register tb state.");
+			goto err_state_register;
+		}
+	}
 	err = team_change_handler_register(ctx->th,
 					   &tb_option_change_handler, tb);
 	if (err) {
@@ -426,9 +1870,19 @@ int teamd_balancer_init(struct teamd_context *ctx, struct teamd_balancer **ptb)
 	*ptb = tb;
 	return 0;
 
+err_change_handler_register:
+	if (tb->tx_balancing_enabled)
+		tb_state_unregister(tb);
+err_state_register:
+	tb_sampler_fini(tb);
+err_sampler_init:
+	tb_log_close(tb);
+err_log_open:
 err_set_lb_tx_method:
+err_get_metric:
+err_get_adaptive:
+err_get_uint:
 err_set_lb_stats_refresh_interval:
-err_change_handler_register:
 	free(tb);
 	return err;
 }
@@ -437,6 +1891,10 @@ void teamd_balancer_fini(struct teamd_balancer *tb)
 {
 	team_change_handler_unregister(tb->ctx->th,
 				       &tb_option_change_handler, tb);
+	if (tb->tx_balancing_enabled)
+		tb_state_unregister(tb);
+	tb_sampler_fini(tb);
+	tb_log_close(tb);
 	free(tb);
 }
 
@@ -456,6 +1914,12 @@ int teamd_balancer_port_added(struct teamd_balancer *tb,
 	return 0;
 }
 
+int teamd_balancer_port_disabled(struct teamd_balancer *tb,
+				 struct teamd_port *tdport)
+{
+	return tb_port_evacuate(tb, tdport);
+}
+
 void teamd_balancer_port_removed(struct teamd_balancer *tb,
 				 struct teamd_port *tdport)
 {
@@ -464,6 +1928,7 @@ void teamd_balancer_port_removed(struct teamd_balancer *tb,
 	tbpi = get_tb_port_info(tb, tdport);
 	if (!tbpi)
 		return;
+	tb_port_evacuate(tb, tdport);
 	list_del(&tbpi->list);
 	free(tbpi);
 }
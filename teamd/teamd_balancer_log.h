@@ -0,0 +1,102 @@
+/*
+ *   teamd_balancer_log.h - Balancer decision log format
+ *   Copyright (C) 2012-2015 Jiri Pirko <jiri@resnulli.us>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TEAMD_BALANCER_LOG_H_
+#define _TEAMD_BALANCER_LOG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The log is a file consisting of header followed by record_count records
+ * of record_size bytes each, used as a ring. Record with sequence number
+ * seq is stored in slot seq % record_count. Header seq is updated only
+ * after the record is completely written. Values are in host byte order.
+ */
+
+#define TB_LOG_MAGIC		0x474c4254 /* "TBLG" */
+#define TB_LOG_VERSION		1
+#define TB_LOG_HASH_COUNT	256
+#define TB_LOG_PORT_MAX		32
+
+struct tb_log_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t record_count;
+	uint64_t seq; /* sequence number of the next record */
+	uint8_t reserved[40];
+};
+
+#define TB_LOG_PORT_ENABLED	0x1
+
+struct tb_log_port {
+	uint32_t ifindex;
+	uint32_t flags;
+	uint64_t bytes;
+	uint64_t packets;
+};
+
+#define TB_LOG_HASH_ELEPHANT	0x1
+
+struct tb_log_hash {
+	uint64_t bytes;
+	uint64_t packets;
+	uint32_t old_ifindex; /* zero if not mapped */
+	uint32_t new_ifindex;
+	uint32_t idle_age;
+	uint32_t flags;
+};
+
+/*
+ * Record written when a port got disabled or removed and hashes mapped to
+ * it were moved away outside of regular rebalance. Traffic stats are the
+ * ones of the previous interval.
+ */
+#define TB_LOG_RECORD_EVACUATION	0x1
+
+struct tb_log_record {
+	uint64_t seq;
+	uint64_t timestamp_ms;
+	uint32_t balancing_interval; /* in tenths of a second */
+	uint32_t port_count;
+	uint32_t flags;
+	uint32_t reserved;
+	uint64_t byte_weight;
+	uint64_t packet_weight;
+	struct tb_log_port ports[TB_LOG_PORT_MAX];
+	struct tb_log_hash hashes[TB_LOG_HASH_COUNT];
+};
+
+static inline size_t tb_log_size(uint32_t record_count)
+{
+	return sizeof(struct tb_log_header) +
+	       (size_t) record_count * sizeof(struct tb_log_record);
+}
+
+static inline struct tb_log_record *
+tb_log_record_slot(struct tb_log_header *header, uint64_t seq)
+{
+	char *records = (char *) (header + 1);
+
+	return (struct tb_log_record *)
+		(records + (seq % header->record_count) * header->record_size);
+}
+
+#endif /* _TEAMD_BALANCER_LOG_H_ */
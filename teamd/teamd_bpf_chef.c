@@ -19,8 +19,10 @@
 
 #include <stdlib.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <linux/filter.h>
+#include <linux/if_packet.h>
 
 #include "teamd_bpf_chef.h"
 
@@ -41,6 +43,11 @@
 #define PROTOID_UDP		0x11
 #define PROTOID_SCTP		0x84
 
+/* ancillary data not known by older headers */
+#ifndef SKF_AD_RANDOM
+#define SKF_AD_RANDOM		56
+#endif
+
 /* jump stack flags */
 #define FIX_JT	0x1
 #define FIX_JF	0x2
@@ -990,3 +997,317 @@ int teamd_bpf_desc_compile(struct sock_fprog *fprog)
 	err = stack_resolve_offsets(fprog);
 	return err;
 }
+
+/*
+ * Compiles filter for packet socket on team device which passes only
+ * every rate-th outgoing packet (on average), truncated to snaplen.
+ */
+int teamd_bpf_sampler_compile(struct sock_fprog *fprog, unsigned int rate,
+			      unsigned int snaplen)
+{
+	int err;
+
+	if (!rate)
+		return -EINVAL;
+	__compile_init(fprog);
+	add_inst(fprog, BPF_STMT(BPF_LD + BPF_W + BPF_ABS,
+				 SKF_AD_OFF + SKF_AD_PKTTYPE));
+	add_inst(fprog, BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K,
+				 PACKET_OUTGOING, 0, 4));
+	add_inst(fprog, BPF_STMT(BPF_LD + BPF_W + BPF_ABS,
+				 SKF_AD_OFF + SKF_AD_RANDOM));
+	add_inst(fprog, BPF_STMT(BPF_ALU + BPF_MOD + BPF_K, rate));
+	add_inst(fprog, BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, 0, 0, 1));
+	add_inst(fprog, BPF_STMT(BPF_RET + BPF_K, snaplen));
+	add_inst(fprog, BPF_STMT(BPF_RET + BPF_K, 0));
+	return 0;
+
+err_add_inst:
+	teamd_bpf_desc_compile_release(fprog);
+	return err;
+}
+
+static bool bpf_load(const uint8_t *pkt, unsigned int len, uint32_t k,
+		     unsigned int size, uint32_t *val)
+{
+	if (k >= len || len - k < size)
+		return false;
+	switch (size) {
+	case 4:
+		*val = (uint32_t) pkt[k] << 24 | (uint32_t) pkt[k + 1] << 16 |
+		       (uint32_t) pkt[k + 2] << 8 | pkt[k + 3];
+		break;
+	case 2:
+		*val = (uint32_t) pkt[k] << 8 | pkt[k + 1];
+		break;
+	default:
+		*val = pkt[k];
+	}
+	return true;
+}
+
+static unsigned int bpf_size(uint16_t code)
+{
+	switch (BPF_SIZE(code)) {
+	case BPF_W:
+		return 4;
+	case BPF_H:
+		return 2;
+	default:
+		return 1;
+	}
+}
+
+static int bpf_ancillary(uint32_t k, uint32_t *a, uint32_t x,
+			 const struct teamd_bpf_aux *aux)
+{
+	switch (k - SKF_AD_OFF) {
+	case SKF_AD_ALU_XOR_X:
+		*a ^= x;
+		return 0;
+	case SKF_AD_VLAN_TAG:
+		*a = aux->vlan_tag;
+		return 0;
+	case SKF_AD_VLAN_TAG_PRESENT:
+		*a = aux->vlan_tag_present;
+		return 0;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static int bpf_alu(uint16_t code, uint32_t *a, uint32_t src)
+{
+	switch (BPF_OP(code)) {
+	case BPF_ADD:
+		*a += src;
+		break;
+	case BPF_SUB:
+		*a -= src;
+		break;
+	case BPF_MUL:
+		*a *= src;
+		break;
+	case BPF_DIV:
+		if (!src)
+			return -EINVAL;
+		*a /= src;
+		break;
+	case BPF_MOD:
+		if (!src)
+			return -EINVAL;
+		*a %= src;
+		break;
+	case BPF_AND:
+		*a &= src;
+		break;
+	case BPF_OR:
+		*a |= src;
+		break;
+	case BPF_XOR:
+		*a ^= src;
+		break;
+	case BPF_LSH:
+		*a <<= src & 31;
+		break;
+	case BPF_RSH:
+		*a >>= src & 31;
+		break;
+	case BPF_NEG:
+		*a = -*a;
+		break;
+	default:
+		return -EOPNOTSUPP;
+	}
+	return 0;
+}
+
+static bool bpf_jump_cond(uint16_t code, uint32_t a, uint32_t src)
+{
+	switch (BPF_OP(code)) {
+	case BPF_JEQ:
+		return a == src;
+	case BPF_JGT:
+		return a > src;
+	case BPF_JGE:
+		return a >= src;
+	case BPF_JSET:
+		return a & src;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Returns the number of leading packet bytes the program may load from, so
+ * the program gives the same result on packet truncated to that length as
+ * on the whole packet. Index register is bounded only if it is loaded by
+ * immediate or MSH loads, UINT_MAX is returned otherwise.
+ */
+unsigned int teamd_bpf_load_len(const struct sock_fprog *fprog)
+{
+	unsigned int x_max = 0;
+	unsigned int len = 0;
+	unsigned int end;
+	unsigned int pc;
+
+	for (pc = 0; pc < fprog->len; pc++) {
+		const struct sock_filter *inst = &fprog->filter[pc];
+		uint16_t code = inst->code;
+
+		if (BPF_CLASS(code) == BPF_LDX) {
+			switch (BPF_MODE(code)) {
+			case BPF_IMM:
+				if (inst->k > x_max)
+					x_max = inst->k;
+				break;
+			case BPF_MSH:
+				if (x_max < 0xf << 2)
+					x_max = 0xf << 2;
+				break;
+			default:
+				return UINT_MAX;
+			}
+		} else if (BPF_CLASS(code) == BPF_MISC &&
+			   BPF_MISCOP(code) == BPF_TAX) {
+			return UINT_MAX;
+		}
+	}
+
+	for (pc = 0; pc < fprog->len; pc++) {
+		const struct sock_filter *inst = &fprog->filter[pc];
+		uint16_t code = inst->code;
+		uint32_t k = inst->k;
+
+		if (BPF_CLASS(code) == BPF_LDX && BPF_MODE(code) == BPF_MSH)
+			end = k + 1;
+		else if (BPF_CLASS(code) != BPF_LD)
+			continue;
+		else if (BPF_MODE(code) == BPF_ABS && k < (uint32_t) SKF_AD_OFF)
+			end = k + bpf_size(code);
+		else if (BPF_MODE(code) == BPF_IND)
+			end = x_max + k + bpf_size(code);
+		else
+			continue;
+		if (end > len)
+			len = end;
+	}
+	return len;
+}
+
+/*
+ * Runs classic BPF program in userspace the same way kernel would run it
+ * on a packet, including out-of-bounds loads terminating the program with
+ * zero return value. Only ancillary loads used by hash functions cooked
+ * here are supported.
+ */
+int teamd_bpf_run(const struct sock_fprog *fprog, const void *pkt,
+		  unsigned int len, const struct teamd_bpf_aux *aux,
+		  uint32_t *p_ret)
+{
+	uint32_t mem[BPF_MEMWORDS] = {0};
+	uint32_t a = 0;
+	uint32_t x = 0;
+	unsigned int pc;
+	int err;
+
+	for (pc = 0; pc < fprog->len; pc++) {
+		const struct sock_filter *inst = &fprog->filter[pc];
+		uint16_t code = inst->code;
+		uint32_t k = inst->k;
+		uint32_t src;
+
+		switch (BPF_CLASS(code)) {
+		case BPF_LD:
+			switch (BPF_MODE(code)) {
+			case BPF_ABS:
+				if (k >= (uint32_t) SKF_AD_OFF) {
+					err = bpf_ancillary(k, &a, x, aux);
+					if (err)
+						return err;
+					break;
+				}
+				if (!bpf_load(pkt, len, k, bpf_size(code), &a))
+					goto out_of_bounds;
+				break;
+			case BPF_IND:
+				if (!bpf_load(pkt, len, x + k, bpf_size(code),
+					      &a))
+					goto out_of_bounds;
+				break;
+			case BPF_LEN:
+				a = len;
+				break;
+			case BPF_IMM:
+				a = k;
+				break;
+			case BPF_MEM:
+				if (k >= BPF_MEMWORDS)
+					return -EINVAL;
+				a = mem[k];
+				break;
+			default:
+				return -EOPNOTSUPP;
+			}
+			break;
+		case BPF_LDX:
+			switch (BPF_MODE(code)) {
+			case BPF_MSH:
+				if (!bpf_load(pkt, len, k, 1, &x))
+					goto out_of_bounds;
+				x = (x & 0xf) << 2;
+				break;
+			case BPF_LEN:
+				x = len;
+				break;
+			case BPF_IMM:
+				x = k;
+				break;
+			case BPF_MEM:
+				if (k >= BPF_MEMWORDS)
+					return -EINVAL;
+				x = mem[k];
+				break;
+			default:
+				return -EOPNOTSUPP;
+			}
+			break;
+		case BPF_ST:
+		case BPF_STX:
+			if (k >= BPF_MEMWORDS)
+				return -EINVAL;
+			mem[k] = BPF_CLASS(code) == BPF_ST ? a : x;
+			break;
+		case BPF_ALU:
+			src = BPF_SRC(code) == BPF_X ? x : k;
+			err = bpf_alu(code, &a, src);
+			if (err)
+				return err;
+			break;
+		case BPF_JMP:
+			if (BPF_OP(code) == BPF_JA) {
+				pc += k;
+				break;
+			}
+			src = BPF_SRC(code) == BPF_X ? x : k;
+			pc += bpf_jump_cond(code, a, src) ? inst->jt : inst->jf;
+			break;
+		case BPF_RET:
+			*p_ret = BPF_RVAL(code) == BPF_A ? a : k;
+			return 0;
+		case BPF_MISC:
+			if (BPF_MISCOP(code) == BPF_TAX)
+				x = a;
+			else
+				a = x;
+			break;
+		default:
+			return -EOPNOTSUPP;
+		}
+	}
+	return -EINVAL;
+
+out_of_bounds:
+	*p_ret = 0;
+	return 0;
+}
@@ -21,6 +21,7 @@
 #define _TEAMD_BPF_CHEF_H_
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <sys/types.h>
 
 enum hashing_protos {
@@ -53,4 +54,18 @@ int teamd_bpf_desc_compile_finish(struct sock_fprog *fprog);
 int teamd_bpf_desc_add_frag(struct sock_fprog *fprog,
 			    const struct teamd_bpf_desc_frag *frag);
 
+int teamd_bpf_sampler_compile(struct sock_fprog *fprog, unsigned int rate,
+			      unsigned int snaplen);
+
+/* Packet metadata accessible by ancillary loads */
+struct teamd_bpf_aux {
+	bool vlan_tag_present;
+	uint16_t vlan_tag;
+};
+
+unsigned int teamd_bpf_load_len(const struct sock_fprog *fprog);
+int teamd_bpf_run(const struct sock_fprog *fprog, const void *pkt,
+		  unsigned int len, const struct teamd_bpf_aux *aux,
+		  uint32_t *p_ret);
+
 #endif /* _TEAMD_BPF_CHEF_H_ */
@@ -196,6 +196,41 @@ resend:
 	return 0;
 }
 
+/* Sends all messages in msgvec, possibly using multiple syscalls. Messages
+ * which can not be sent because of the link being down are skipped.
+ * Number of syscalls made is added to calls_p if it is not NULL.
+ */
+int teamd_sendmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen,
+		   int flags, unsigned int *calls_p)
+{
+	unsigned int sent = 0;
+	int ret;
+
+	while (sent < vlen) {
+		if (calls_p)
+			(*calls_p)++;
+		ret = sendmmsg(sockfd, msgvec + sent, vlen - sent, flags);
+		if (ret == -1) {
+			switch(errno) {
+			case EINTR:
+				continue;
+			case ENETDOWN:
+			case ENETUNREACH:
+			case EADDRNOTAVAIL:
+			case ENXIO:
+				/* skip the message which failed */
+				sent++;
+				continue;
+			default:
+				teamd_log_err("sendmmsg failed.");
+				return -errno;
+			}
+		}
+		sent += ret;
+	}
+	return 0;
+}
+
 int teamd_recvfrom(int sockfd, void *buf, size_t len, int flags,
 		   struct sockaddr *src_addr, socklen_t addrlen)
 {
@@ -217,3 +252,26 @@ rerecv:
 	}
 	return ret;
 }
+
+/* Returns number of received messages, zero if there is nothing to receive. */
+int teamd_recvmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen,
+		   int flags)
+{
+	int ret;
+
+rerecv:
+	ret = recvmmsg(sockfd, msgvec, vlen, flags, NULL);
+	if (ret == -1) {
+		switch(errno) {
+		case EINTR:
+			goto rerecv;
+		case EAGAIN:
+		case ENETDOWN:
+			return 0;
+		default:
+			teamd_log_err("recvmmsg failed.");
+			return -errno;
+		}
+	}
+	return ret;
+}
@@ -38,6 +38,7 @@ extern const struct teamd_link_watch teamd_link_watch_ethtool;
 extern const struct teamd_link_watch teamd_link_watch_arp_ping;
 extern const struct teamd_link_watch teamd_link_watch_nsnap;
 extern const struct teamd_link_watch teamd_link_watch_tipc;
+extern const struct teamd_link_watch teamd_link_watch_bfd_echo;
 
 int __set_sockaddr(struct sockaddr *sa, socklen_t sa_len, sa_family_t family,
 		   const char *hostname)
@@ -79,16 +80,28 @@ char *__str_sockaddr(struct sockaddr *sa, socklen_t sa_len, sa_family_t family,
 	return buf;
 }
 
-int teamd_link_watch_check_link_up(struct teamd_context *ctx,
-				   struct teamd_port *tdport,
-				   struct lw_common_port_priv *common_ppriv,
-				   bool new_link_up)
+static void link_watch_port_link_update(struct teamd_port *tdport)
+{
+	tdport->link_up = !tdport->link_watch_count ||
+			  tdport->link_watch_up_count;
+}
+
+static int link_watch_link_up_report(struct teamd_context *ctx,
+				     struct teamd_port *tdport,
+				     struct lw_common_port_priv *common_ppriv,
+				     bool new_link_up)
 {
 	const char *lw_name = common_ppriv->link_watch->name;
 
-	if (!teamd_link_watch_link_up_differs(common_ppriv, new_link_up))
+	if (new_link_up == common_ppriv->link_up)
 		return 0;
 	common_ppriv->link_up = new_link_up;
+	if (new_link_up)
+		tdport->link_watch_up_count++;
+	else
+		tdport->link_watch_up_count--;
+	link_watch_port_link_update(tdport);
+	clock_gettime(CLOCK_MONOTONIC, &tdport->link_changed_ts);
 	teamd_log_info("%s: %s-link went %s.", tdport->ifname, lw_name,
 		       new_link_up ? "up" : "down");
 	if (!new_link_up && common_ppriv->link_down_count < INT_MAX)
@@ -96,6 +109,101 @@ int teamd_link_watch_check_link_up(struct teamd_context *ctx,
 	return teamd_event_port_link_changed(ctx, tdport);
 }
 
+/*
+ * Flap damping. Every link down adds penalty which decays exponentially
+ * with configured half-life. Once it reaches suppress threshold, the link
+ * is reported down until the penalty decays below reuse threshold.
+ */
+
+#define LW_DAMPING_CB_NAME "lw_damping"
+#define LW_DAMPING_CHECK_INTERVAL 1 /* s */
+
+static unsigned int link_watch_damping_penalty(struct lw_common_port_priv *common_ppriv,
+					       const struct timespec *now)
+{
+	unsigned int half_life = common_ppriv->damping.half_life;
+	uint64_t penalty = common_ppriv->damping.cur_penalty;
+	uint64_t dt;
+	uint64_t halves;
+
+	dt = (now->tv_sec - common_ppriv->damping.cur_ts.tv_sec) * 1000 +
+	     (now->tv_nsec - common_ppriv->damping.cur_ts.tv_nsec) / 1000000;
+	halves = dt / half_life;
+	if (halves >= 32)
+		return 0;
+	penalty >>= halves;
+	/* Linear approximation of decay within one half-life */
+	penalty -= penalty * (dt % half_life) / (2 * half_life);
+	return penalty;
+}
+
+static void link_watch_damping_flap(struct lw_common_port_priv *common_ppriv,
+				    const struct timespec *now)
+{
+	uint64_t penalty = link_watch_damping_penalty(common_ppriv, now);
+
+	penalty += common_ppriv->damping.penalty;
+	if (penalty > common_ppriv->damping.max_penalty)
+		penalty = common_ppriv->damping.max_penalty;
+	common_ppriv->damping.cur_penalty = penalty;
+	common_ppriv->damping.cur_ts = *now;
+}
+
+static int link_watch_damping_callback(struct teamd_context *ctx, int events,
+				       void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct teamd_port *tdport = common_ppriv->tdport;
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (link_watch_damping_penalty(common_ppriv, &now) >=
+	    common_ppriv->damping.reuse)
+		return 0;
+	common_ppriv->damping.suppressed = false;
+	teamd_loop_callback_disable(ctx, LW_DAMPING_CB_NAME, common_ppriv);
+	teamd_log_info("%s: %s-link not suppressed anymore.", tdport->ifname,
+		       common_ppriv->link_watch->name);
+	return link_watch_link_up_report(ctx, tdport, common_ppriv,
+					 common_ppriv->raw_link_up);
+}
+
+int teamd_link_watch_check_link_up(struct teamd_context *ctx,
+				   struct teamd_port *tdport,
+				   struct lw_common_port_priv *common_ppriv,
+				   bool new_link_up)
+{
+	struct timespec now;
+
+	if (!teamd_link_watch_link_up_differs(common_ppriv, new_link_up))
+		return 0;
+	common_ppriv->raw_link_up = new_link_up;
+	if (!common_ppriv->damping.enabled)
+		goto report;
+
+	if (!new_link_up) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		link_watch_damping_flap(common_ppriv, &now);
+	}
+	if (!common_ppriv->damping.suppressed &&
+	    common_ppriv->damping.cur_penalty >= common_ppriv->damping.suppress) {
+		common_ppriv->damping.suppressed = true;
+		teamd_loop_callback_enable(ctx, LW_DAMPING_CB_NAME,
+					   common_ppriv);
+		teamd_log_info("%s: %s-link flapping, suppressed.",
+			       tdport->ifname, common_ppriv->link_watch->name);
+	}
+	if (common_ppriv->damping.suppressed) {
+		/* Link is held down, only transition to down is reported */
+		if (new_link_up || !common_ppriv->link_up)
+			common_ppriv->damping.suppressed_transitions++;
+		new_link_up = false;
+	}
+report:
+	return link_watch_link_up_report(ctx, tdport, common_ppriv,
+					 new_link_up);
+}
+
 /*
  * General link watch code
  */
@@ -104,6 +212,7 @@ static const struct teamd_link_watch *teamd_link_watch_list[] = {
 	&teamd_link_watch_arp_ping,
 	&teamd_link_watch_nsnap,
 	&teamd_link_watch_tipc,
+	&teamd_link_watch_bfd_echo,
 };
 
 #define TEAMD_LINK_WATCH_LIST_SIZE ARRAY_SIZE(teamd_link_watch_list)
@@ -124,22 +233,52 @@ static const struct teamd_link_watch *teamd_find_link_watch(const char *link_wat
 	return NULL;
 }
 
-bool teamd_link_watch_port_up(struct teamd_context *ctx,
-			      struct teamd_port *tdport)
+/*
+ * Returns smoothed probe round trip time in microseconds measured by link
+ * watches of the port which see the link up, the lowest one is taken.
+ * Zero means there is no measurement available.
+ */
+unsigned int teamd_link_watch_port_rtt(struct teamd_context *ctx,
+				       struct teamd_port *tdport)
 {
 	struct lw_common_port_priv *common_ppriv;
-	bool link;
+	unsigned int rtt = 0;
 
 	if (!tdport)
-		return true;
-	link = true;
+		return 0;
 	teamd_for_each_port_priv_by_creator(common_ppriv, tdport,
 					    LW_PORT_PRIV_CREATOR_PRIV) {
-		link = common_ppriv->link_up;
-		if (link)
-			return link;
+		if (!common_ppriv->link_up || !common_ppriv->rtt_us)
+			continue;
+		if (!rtt || common_ppriv->rtt_us < rtt)
+			rtt = common_ppriv->rtt_us;
 	}
-	return link;
+	return rtt;
+}
+
+/*
+ * Returns the first port priv of the given link watch, looking through all
+ * ports, for which match returns true. NULL if there is none.
+ */
+struct lw_common_port_priv *
+teamd_link_watch_port_priv_find(struct teamd_context *ctx,
+				const struct teamd_link_watch *link_watch,
+				bool (*match)(struct lw_common_port_priv *common_ppriv,
+					      void *priv),
+				void *priv)
+{
+	struct lw_common_port_priv *common_ppriv;
+	struct teamd_port *tdport;
+
+	teamd_for_each_tdport(tdport, ctx) {
+		teamd_for_each_port_priv_by_creator(common_ppriv, tdport,
+						    LW_PORT_PRIV_CREATOR_PRIV) {
+			if (common_ppriv->link_watch == link_watch &&
+			    match(common_ppriv, priv))
+				return common_ppriv;
+		}
+	}
+	return NULL;
 }
 
 static int teamd_link_watch_refresh_user_linkup(struct teamd_context *ctx,
@@ -194,6 +333,52 @@ static int link_watch_state_down_count_get(struct teamd_context *ctx,
 	return 0;
 }
 
+static int link_watch_state_damping_suppressed_get(struct teamd_context *ctx,
+						   struct team_state_gsc *gsc,
+						   void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+
+	gsc->data.bool_val = common_ppriv->damping.suppressed;
+	return 0;
+}
+
+static int link_watch_state_damping_penalty_get(struct teamd_context *ctx,
+						struct team_state_gsc *gsc,
+						void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct timespec now;
+
+	if (!common_ppriv->damping.enabled) {
+		gsc->data.int_val = 0;
+		return 0;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	gsc->data.int_val = link_watch_damping_penalty(common_ppriv, &now);
+	return 0;
+}
+
+static int link_watch_state_damping_suppressed_transitions_get(struct teamd_context *ctx,
+							       struct team_state_gsc *gsc,
+							       void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+
+	gsc->data.int_val = common_ppriv->damping.suppressed_transitions;
+	return 0;
+}
+
+static int link_watch_state_damping_raw_up_get(struct teamd_context *ctx,
+					       struct team_state_gsc *gsc,
+					       void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+
+	gsc->data.bool_val = common_ppriv->raw_link_up;
+	return 0;
+}
+
 static const struct teamd_state_val link_watch_state_vals[] = {
 	{
 		.subpath = "name",
@@ -210,6 +395,26 @@ static const struct teamd_state_val link_watch_state_vals[] = {
 		.type = TEAMD_STATE_ITEM_TYPE_INT,
 		.getter = link_watch_state_down_count_get,
 	},
+	{
+		.subpath = "damping.suppressed",
+		.type = TEAMD_STATE_ITEM_TYPE_BOOL,
+		.getter = link_watch_state_damping_suppressed_get,
+	},
+	{
+		.subpath = "damping.penalty",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = link_watch_state_damping_penalty_get,
+	},
+	{
+		.subpath = "damping.suppressed_transitions",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = link_watch_state_damping_suppressed_transitions_get,
+	},
+	{
+		.subpath = "damping.raw_up",
+		.type = TEAMD_STATE_ITEM_TYPE_BOOL,
+		.getter = link_watch_state_damping_raw_up_get,
+	},
 };
 
 static const struct teamd_state_val link_watch_state_vg = {
@@ -268,6 +473,115 @@ static unsigned int link_watch_select_free_id(struct teamd_port *tdport)
 	return id;
 }
 
+#define LW_DAMPING_DFLT_PENALTY 1000
+#define LW_DAMPING_DFLT_SUPPRESS 2000
+#define LW_DAMPING_DFLT_REUSE 1000
+#define LW_DAMPING_DFLT_HALF_LIFE 5000
+#define LW_DAMPING_DFLT_MAX_SUPPRESS 20000
+
+static int link_watch_damping_int_get(struct teamd_context *ctx,
+				      struct lw_common_port_priv *common_ppriv,
+				      unsigned int *p_val, const char *name,
+				      int dflt)
+{
+	int tmp;
+	int err;
+
+	err = teamd_config_int_get(ctx, &tmp, "@.damping.%s",
+				   common_ppriv->cpcookie, name);
+	if (err) {
+		tmp = dflt;
+	} else if (tmp <= 0) {
+		teamd_log_err("%s: \"damping.%s\" must be positive number.",
+			      common_ppriv->tdport->ifname, name);
+		return -EINVAL;
+	}
+	*p_val = tmp;
+	return 0;
+}
+
+static int link_watch_damping_init(struct teamd_context *ctx,
+				   struct lw_common_port_priv *common_ppriv)
+{
+	struct timespec interval = { LW_DAMPING_CHECK_INTERVAL, 0 };
+	unsigned int max_suppress;
+	unsigned int shift;
+	uint64_t max_penalty;
+	int err;
+
+	if (!teamd_config_path_exists(ctx, "@.damping", common_ppriv->cpcookie))
+		return 0;
+	err = link_watch_damping_int_get(ctx, common_ppriv,
+					 &common_ppriv->damping.penalty,
+					 "penalty", LW_DAMPING_DFLT_PENALTY);
+	if (err)
+		return err;
+	err = link_watch_damping_int_get(ctx, common_ppriv,
+					 &common_ppriv->damping.suppress,
+					 "suppress", LW_DAMPING_DFLT_SUPPRESS);
+	if (err)
+		return err;
+	err = link_watch_damping_int_get(ctx, common_ppriv,
+					 &common_ppriv->damping.reuse,
+					 "reuse", LW_DAMPING_DFLT_REUSE);
+	if (err)
+		return err;
+	err = link_watch_damping_int_get(ctx, common_ppriv,
+					 &common_ppriv->damping.half_life,
+					 "half_life", LW_DAMPING_DFLT_HALF_LIFE);
+	if (err)
+		return err;
+	err = link_watch_damping_int_get(ctx, common_ppriv, &max_suppress,
+					 "max_suppress",
+					 LW_DAMPING_DFLT_MAX_SUPPRESS);
+	if (err)
+		return err;
+	if (common_ppriv->damping.reuse >= common_ppriv->damping.suppress) {
+		teamd_log_err("%s: \"damping.reuse\" must be lower than \"damping.suppress\".",
+			      common_ppriv->tdport->ifname);
+		return -EINVAL;
+	}
+	/*
+	 * Penalty is capped so it decays to reuse threshold within
+	 * max_suppress time.
+	 */
+	shift = max_suppress / common_ppriv->damping.half_life;
+	if (shift > 16)
+		shift = 16;
+	max_penalty = (uint64_t) common_ppriv->damping.reuse << shift;
+	if (max_penalty < common_ppriv->damping.suppress)
+		max_penalty = common_ppriv->damping.suppress;
+	if (max_penalty > INT_MAX)
+		max_penalty = INT_MAX;
+	common_ppriv->damping.max_penalty = max_penalty;
+
+	err = teamd_loop_callback_timer_add_set(ctx, LW_DAMPING_CB_NAME,
+						common_ppriv,
+						link_watch_damping_callback,
+						&interval, &interval);
+	if (err) {
+		teamd_log_err("%s: Failed to add damping timer.",
+			      common_ppriv->tdport->ifname);
+		return err;
+	}
+	common_ppriv->damping.enabled = true;
+	teamd_log_dbg("%s: Using flap damping (penalty %u, suppress %u, reuse %u, half_life %u).",
+		      common_ppriv->tdport->ifname,
+		      common_ppriv->damping.penalty,
+		      common_ppriv->damping.suppress,
+		      common_ppriv->damping.reuse,
+		      common_ppriv->damping.half_life);
+	return 0;
+}
+
+static void link_watch_damping_fini(struct teamd_context *ctx,
+				    struct lw_common_port_priv *common_ppriv)
+{
+	if (!common_ppriv->damping.enabled)
+		return;
+	teamd_loop_callback_del(ctx, LW_DAMPING_CB_NAME, common_ppriv);
+}
+
 static int link_watch_load_config_one(struct teamd_context *ctx,
 				      struct teamd_port *tdport,
 				      struct teamd_config_path_cookie *cpcookie)
@@ -310,11 +624,23 @@ static int link_watch_load_config_one(struct teamd_context *ctx,
 	common_ppriv->tdport = tdport;
 	common_ppriv->cpcookie = cpcookie;
 	common_ppriv->link_up = linkup;
+	common_ppriv->raw_link_up = linkup;
 
-	err = link_watch_state_register(ctx, common_ppriv);
+	err = link_watch_damping_init(ctx, common_ppriv);
 	if (err)
 		return err;
+	err = link_watch_state_register(ctx, common_ppriv);
+	if (err)
+		goto damping_fini;
+	tdport->link_watch_count++;
+	if (linkup)
+		tdport->link_watch_up_count++;
+	link_watch_port_link_update(tdport);
 	return 0;
+
+damping_fini:
+	link_watch_damping_fini(ctx, common_ppriv);
+	return err;
 }
 
 static int link_watch_load_config(struct teamd_context *ctx,
@@ -393,8 +719,10 @@ static void link_watch_event_watch_port_removed(struct teamd_context *ctx,
 	struct lw_common_port_priv *common_ppriv;
 
 	teamd_for_each_port_priv_by_creator(common_ppriv, tdport,
-					    LW_PORT_PRIV_CREATOR_PRIV)
+					    LW_PORT_PRIV_CREATOR_PRIV) {
 		link_watch_state_unregister(ctx, common_ppriv);
+		link_watch_damping_fini(ctx, common_ppriv);
+	}
 }
 
 static int link_watch_event_watch_port_link_changed(struct teamd_context *ctx,
@@ -485,6 +813,8 @@ int teamd_link_watch_init(struct teamd_context *ctx)
 {
 	int err;
 
+	list_init(&ctx->lw_psr_group_list);
+	list_init(&ctx->lw_psr_phys_list);
 	err = teamd_event_watch_register(ctx, &link_watch_port_watch_ops, NULL);
 	if (err) {
 		teamd_log_err("Failed to register event watch.");
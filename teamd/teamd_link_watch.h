@@ -14,13 +14,42 @@ struct lw_common_port_priv {
 	const struct teamd_link_watch *link_watch;
 	struct teamd_context *ctx;
 	struct teamd_port *tdport;
-	bool link_up;
+	bool link_up; /* reported, might be held down by flap damping */
+	bool raw_link_up; /* as seen by the link watch */
 	int link_down_count;
 	bool forced_send;
+	unsigned int rtt_us; /* smoothed probe rtt, zero if unknown */
 	struct teamd_config_path_cookie *cpcookie;
+	struct {
+		bool enabled;
+		unsigned int penalty; /* added on every link down */
+		unsigned int suppress;
+		unsigned int reuse;
+		unsigned int max_penalty;
+		unsigned int half_life; /* ms */
+		unsigned int cur_penalty; /* at cur_ts, decays in time */
+		struct timespec cur_ts;
+		bool suppressed;
+		unsigned int suppressed_transitions;
+	} damping;
 };
 
 struct lw_psr_port_priv;
+struct lw_psr_group;
+
+/* Probe frame to be sent, len is zero if there is nothing to send.
+ * sock is the per-port socket to send the frame by if not batched.
+ * Frames of a port are all sent by the same socket.
+ */
+#define LW_PSR_FRAMES_MAX 16
+
+struct lw_psr_frame {
+	int sock;
+	const void *buf;
+	size_t len;
+	const struct sockaddr *addr;
+	socklen_t addrlen;
+};
 
 struct lw_psr_ops {
 	int (*sock_open)(struct lw_psr_port_priv *psr_ppriv);
@@ -28,19 +57,70 @@ struct lw_psr_ops {
 	int (*load_options)(struct teamd_context *ctx,
 			    struct teamd_port *tdport,
 			    struct lw_psr_port_priv *psr_ppriv);
-	int (*send)(struct lw_psr_port_priv *psr_ppriv);
-	int (*receive)(struct lw_psr_port_priv *psr_ppriv);
+	int (*send)(struct lw_psr_port_priv *psr_ppriv); /* if no frame_get */
+	int (*receive)(struct lw_psr_port_priv *psr_ppriv,
+		       const void *buf, size_t len,
+		       const struct sockaddr_ll *from);
+	/* frame_get is called with index from zero until it returns zero
+	 * len, at most LW_PSR_FRAMES_MAX times per interval.
+	 * tx_sock_open is needed for batched send only.
+	 */
+	int (*frame_get)(struct lw_psr_port_priv *psr_ppriv,
+			 unsigned int index, struct lw_psr_frame *frame);
+	int (*tx_sock_open)(int *sock_p);
+	/* Tells if the last interval counts as replied, optional. If not
+	 * set, any reply passed to lw_psr_reply_received() counts.
+	 */
+	bool (*reply_check)(struct lw_psr_port_priv *psr_ppriv);
+	/* Tells if both ports probe the same way, so probes of one of them
+	 * serve the other as well. Needed for phys_port_share only.
+	 */
+	bool (*probe_match)(struct lw_psr_port_priv *psr_ppriv1,
+			    struct lw_psr_port_priv *psr_ppriv2);
 };
 
+#define LW_PSR_RTT_HIST_SIZE 16
+
 struct lw_psr_port_priv {
 	struct lw_common_port_priv common; /* must be first */
 	const struct lw_psr_ops *ops;
 	struct timespec interval;
 	struct timespec init_wait;
 	unsigned int missed_max;
+	bool batch;
 	int sock;
 	unsigned int missed;
 	bool reply_received;
+	bool frame_valid; /* cleared when port hwaddr changes */
+	struct lw_psr_group *group;
+	struct list_item group_list;
+	bool phys_share;
+	bool phys_share_checked; /* lack of followers was reported */
+	struct lw_psr_port_priv *leader; /* probes instead of this port */
+	struct list_item phys_list; /* in leader's follower_list if follower */
+	struct list_item follower_list;
+	struct {
+		unsigned int tx_probes;
+		unsigned int tx_syscalls;
+		unsigned int rx_frames;
+		unsigned int rx_syscalls;
+	} stats;
+	struct {
+		bool enabled;
+		struct timespec fast_interval;
+		unsigned int recover_count;
+		bool fast; /* probing by fast_interval instead of interval */
+		unsigned int replied; /* intervals in a row while fast */
+		bool down; /* missed_max exceeded, probing slow again */
+	} adaptive;
+	struct {
+		struct timespec tx_ts; /* time the last probe was sent */
+		bool pending;
+		unsigned int last;
+		unsigned int min;
+		unsigned int max;
+		unsigned int hist[LW_PSR_RTT_HIST_SIZE];
+	} rtt;
 };
 
 int __set_sockaddr(struct sockaddr *sa, socklen_t sa_len, sa_family_t family,
@@ -51,13 +131,19 @@ char *__str_sockaddr(struct sockaddr *sa, socklen_t sa_len, sa_family_t family,
 static inline bool teamd_link_watch_link_up_differs(struct lw_common_port_priv *common_ppriv,
 					     bool new_link_up)
 {
-	return new_link_up != common_ppriv->link_up;
+	return new_link_up != common_ppriv->raw_link_up;
 }
 
 int teamd_link_watch_check_link_up(struct teamd_context *ctx,
 				   struct teamd_port *tdport,
 				   struct lw_common_port_priv *common_ppriv,
 				   bool new_link_up);
+struct lw_common_port_priv *
+teamd_link_watch_port_priv_find(struct teamd_context *ctx,
+				const struct teamd_link_watch *link_watch,
+				bool (*match)(struct lw_common_port_priv *common_ppriv,
+					      void *priv),
+				void *priv);
 
 struct lw_psr_port_priv *
 lw_psr_ppriv_get(struct lw_common_port_priv *common_ppriv);
@@ -65,6 +151,9 @@ int lw_psr_port_added(struct teamd_context *ctx, struct teamd_port *tdport,
 		      void *priv, void *creator_priv);
 void lw_psr_port_removed(struct teamd_context *ctx, struct teamd_port *tdport,
 			 void *priv, void *creator_priv);
+void lw_psr_reply_received(struct lw_psr_port_priv *psr_ppriv);
+int lw_psr_interval_set(struct lw_psr_port_priv *psr_ppriv,
+			const struct timespec *interval);
 int lw_psr_state_interval_get(struct teamd_context *ctx,
 			      struct team_state_gsc *gsc,
 			      void *priv);
@@ -77,5 +166,47 @@ int lw_psr_state_missed_max_get(struct teamd_context *ctx,
 int lw_psr_state_missed_get(struct teamd_context *ctx,
 			    struct team_state_gsc *gsc,
 			    void *priv);
+int lw_psr_state_batch_get(struct teamd_context *ctx,
+			   struct team_state_gsc *gsc,
+			   void *priv);
+int lw_psr_state_current_interval_get(struct teamd_context *ctx,
+				      struct team_state_gsc *gsc,
+				      void *priv);
+int lw_psr_state_interval_mode_get(struct teamd_context *ctx,
+				   struct team_state_gsc *gsc,
+				   void *priv);
+int lw_psr_state_phys_port_share_get(struct teamd_context *ctx,
+				     struct team_state_gsc *gsc,
+				     void *priv);
+int lw_psr_state_phys_port_leader_get(struct teamd_context *ctx,
+				      struct team_state_gsc *gsc,
+				      void *priv);
+int lw_psr_state_tx_probes_get(struct teamd_context *ctx,
+			       struct team_state_gsc *gsc,
+			       void *priv);
+int lw_psr_state_tx_syscalls_get(struct teamd_context *ctx,
+				 struct team_state_gsc *gsc,
+				 void *priv);
+int lw_psr_state_rx_frames_get(struct teamd_context *ctx,
+			       struct team_state_gsc *gsc,
+			       void *priv);
+int lw_psr_state_rx_syscalls_get(struct teamd_context *ctx,
+				 struct team_state_gsc *gsc,
+				 void *priv);
+int lw_psr_state_rtt_last_get(struct teamd_context *ctx,
+			      struct team_state_gsc *gsc,
+			      void *priv);
+int lw_psr_state_rtt_ewma_get(struct teamd_context *ctx,
+			      struct team_state_gsc *gsc,
+			      void *priv);
+int lw_psr_state_rtt_min_get(struct teamd_context *ctx,
+			     struct team_state_gsc *gsc,
+			     void *priv);
+int lw_psr_state_rtt_max_get(struct teamd_context *ctx,
+			     struct team_state_gsc *gsc,
+			     void *priv);
+int lw_psr_state_rtt_histogram_get(struct teamd_context *ctx,
+				   struct team_state_gsc *gsc,
+				   void *priv);
 
 #endif
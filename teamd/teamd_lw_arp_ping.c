@@ -19,6 +19,8 @@
  */
 
 #include <arpa/inet.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
 #include <net/if_arp.h>
 #include <linux/if_ether.h>
 #include <netdb.h>
@@ -31,18 +33,67 @@
  * ARP ping link watch
  */
 
+struct arp_packet {
+	struct arphdr			ah;
+	unsigned char			sender_mac[ETH_ALEN];
+	struct in_addr			sender_ip;
+	unsigned char			target_mac[ETH_ALEN];
+	struct in_addr			target_ip;
+} __attribute__((packed));
+
+struct __vlan_hdr {
+	__be16 h_vlan_TCI;
+	__be16 h_vlan_encapsulated_proto;
+};
+
+struct arp_vlan_packet {
+	struct __vlan_hdr		vlanh;
+	struct arp_packet		ap;
+} __attribute__((packed));
+
+#define LW_AP_TARGETS_MAX LW_PSR_FRAMES_MAX
+
+struct lw_ap_target {
+	struct in_addr addr;
+	bool replied; /* since the last periodic check */
+	/* prebuilt request frame, valid while start.psr.frame_valid is set */
+	union {
+		struct arp_packet ap;
+		struct arp_vlan_packet avp;
+	} frame;
+};
+
 struct lw_ap_port_priv {
 	union {
 		struct lw_common_port_priv common;
 		struct lw_psr_port_priv psr;
 	} start; /* must be first */
 	struct in_addr src;
-	struct in_addr dst;
+	struct lw_ap_target targets[LW_AP_TARGETS_MAX];
+	unsigned int target_count;
+	unsigned int quorum; /* targets needed to reply in an interval */
+	unsigned int targets_replied; /* in the last closed interval */
+	bool unmatched_reply; /* not validated reply of none of targets */
 	bool validate_active;
 	bool validate_inactive;
 	bool send_always;
 	bool vlanid_in_use;
 	unsigned short vlanid;
+	bool shared;
+	struct list_item shared_list;
+	/* common for frames of all targets */
+	struct sockaddr_ll ll_my;
+	struct sockaddr_ll ll_bcast;
+	size_t frame_len;
+};
+
+#define LW_AP_SHARED_HASH_SIZE 64
+
+struct lw_ap_shared {
+	struct teamd_context *ctx;
+	int sock;
+	unsigned int entry_count; /* filter entries, one per member target */
+	struct list_item hash[LW_AP_SHARED_HASH_SIZE]; /* keyed by ifindex */
 };
 
 static struct lw_ap_port_priv *
@@ -133,29 +184,92 @@ static char *str_in_addr(struct in_addr *addr)
 			      buf, sizeof(buf));
 }
 
-static int lw_ap_sock_open(struct lw_psr_port_priv *psr_ppriv)
+static int lw_ap_target_add(struct lw_ap_port_priv *ap_ppriv,
+			    const char *host)
 {
-	struct lw_ap_port_priv *ap_ppriv = lw_ap_ppriv_get(psr_ppriv);
-	struct sock_fprog fprog;
-	struct sock_filter arp_vlan_rpl_flt[ARRAY_SIZE(arp_vlan_rpl_flt)];
+	struct lw_ap_target *target;
+	int err;
 
-	if (ap_ppriv->vlanid_in_use) {
-		memcpy(&arp_vlan_rpl_flt, arp_vlan_rpl_fprog.filter,
-		       sizeof(arp_vlan_rpl_flt));
-		fprog = arp_vlan_rpl_fprog;
-		fprog.filter = arp_vlan_rpl_flt;
-		SET_FILTER_VLANID(&fprog, ap_ppriv->vlanid);
-	} else {
-		fprog = arp_novlan_rpl_fprog;
+	if (ap_ppriv->target_count == LW_AP_TARGETS_MAX) {
+		teamd_log_err("Too many \"target_host\" items, maximum is %u.",
+			      LW_AP_TARGETS_MAX);
+		return -E2BIG;
 	}
-	return teamd_packet_sock_open(&psr_ppriv->sock,
-				      psr_ppriv->common.tdport->ifindex,
-				      htons(ETH_P_ALL), &fprog, &arp_rpl_fprog);
+	target = &ap_ppriv->targets[ap_ppriv->target_count];
+	err = set_in_addr(&target->addr, host);
+	if (err)
+		return err;
+	teamd_log_dbg("target address \"%s\".", str_in_addr(&target->addr));
+	ap_ppriv->target_count++;
+	return 0;
 }
 
-static void lw_ap_sock_close(struct lw_psr_port_priv *psr_ppriv)
+/* "target_host" is either single host or array of hosts */
+static int lw_ap_load_targets(struct teamd_context *ctx,
+			      struct lw_ap_port_priv *ap_ppriv,
+			      struct teamd_config_path_cookie *cpcookie)
+{
+	const char *host;
+	int err;
+	int i;
+
+	if (!teamd_config_path_is_arr(ctx, "@.target_host", cpcookie)) {
+		err = teamd_config_string_get(ctx, &host, "@.target_host",
+					      cpcookie);
+		if (err) {
+			teamd_log_err("Failed to get \"target_host\" link-watch option.");
+			return -EINVAL;
+		}
+		return lw_ap_target_add(ap_ppriv, host);
+	}
+	teamd_config_for_each_arr_index(i, ctx, "@.target_host", cpcookie) {
+		err = teamd_config_string_get(ctx, &host, "@.target_host[%d]",
+					      cpcookie, i);
+		if (err) {
+			teamd_log_err("Failed to get \"target_host\" item %d.", i);
+			return -EINVAL;
+		}
+		err = lw_ap_target_add(ap_ppriv, host);
+		if (err)
+			return err;
+	}
+	if (!ap_ppriv->target_count) {
+		teamd_log_err("Empty \"target_host\" link-watch option.");
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/* "quorum" is "any", "all" or number of targets */
+static int lw_ap_load_quorum(struct teamd_context *ctx,
+			     struct lw_ap_port_priv *ap_ppriv,
+			     struct teamd_config_path_cookie *cpcookie)
 {
-	close(psr_ppriv->sock);
+	const char *quorum;
+	int tmp;
+	int err;
+
+	err = teamd_config_int_get(ctx, &tmp, "@.quorum", cpcookie);
+	if (!err) {
+		if (tmp < 1 || tmp > ap_ppriv->target_count) {
+			teamd_log_err("\"quorum\" must be between 1 and number of targets.");
+			return -EINVAL;
+		}
+		ap_ppriv->quorum = tmp;
+	} else {
+		err = teamd_config_string_get(ctx, &quorum, "@.quorum",
+					      cpcookie);
+		if (err || !strcmp(quorum, "any")) {
+			ap_ppriv->quorum = 1;
+		} else if (!strcmp(quorum, "all")) {
+			ap_ppriv->quorum = ap_ppriv->target_count;
+		} else {
+			teamd_log_err("Unknown \"quorum\" value \"%s\".", quorum);
+			return -EINVAL;
+		}
+	}
+	teamd_log_dbg("quorum \"%u\".", ap_ppriv->quorum);
+	return 0;
 }
 
 static int lw_ap_load_options(struct teamd_context *ctx,
@@ -181,15 +295,12 @@ static int lw_ap_load_options(struct teamd_context *ctx,
 	teamd_log_dbg("source address \"%s\".",
 		      str_in_addr(&ap_ppriv->src));
 
-	err = teamd_config_string_get(ctx, &host, "@.target_host", cpcookie);
-	if (err) {
-		teamd_log_err("Failed to get \"target_host\" link-watch option.");
-		return -EINVAL;
-	}
-	err = set_in_addr(&ap_ppriv->dst, host);
+	err = lw_ap_load_targets(ctx, ap_ppriv, cpcookie);
+	if (err)
+		return err;
+	err = lw_ap_load_quorum(ctx, ap_ppriv, cpcookie);
 	if (err)
 		return err;
-	teamd_log_dbg("target address \"%s\".", str_in_addr(&ap_ppriv->dst));
 
 	err = teamd_config_bool_get(ctx, &ap_ppriv->validate_active,
 				    "@.validate_active", cpcookie);
@@ -220,6 +331,36 @@ static int lw_ap_load_options(struct teamd_context *ctx,
 		teamd_log_dbg("vlan id \"%u\".", ap_ppriv->vlanid);
 	}
 
+	err = teamd_config_bool_get(ctx, &ap_ppriv->shared,
+				    "@.shared_socket", cpcookie);
+	if (err)
+		ap_ppriv->shared = false;
+	teamd_log_dbg("shared_socket \"%d\".", ap_ppriv->shared);
+
+	return 0;
+}
+
+/* Shared socket is not bound to the port, so get hw type by ioctl. */
+static int __get_port_hwaddr_ioctl(struct lw_psr_port_priv *psr_ppriv,
+				   struct sockaddr_ll *addr)
+{
+	struct teamd_port *tdport = psr_ppriv->common.tdport;
+	struct ifreq ifr;
+	int ret;
+
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, tdport->ifname, sizeof(ifr.ifr_name) - 1);
+	ret = ioctl(psr_ppriv->common.ctx->lw_ap_shared->sock, SIOCGIFHWADDR,
+		    &ifr);
+	if (ret == -1) {
+		teamd_log_err("%s: Failed to get hw address.", tdport->ifname);
+		return -errno;
+	}
+	memset(addr, 0, sizeof(*addr));
+	addr->sll_family = AF_PACKET;
+	addr->sll_ifindex = tdport->ifindex;
+	addr->sll_hatype = ifr.ifr_hwaddr.sa_family;
+	addr->sll_halen = team_get_ifinfo_hwaddr_len(tdport->team_ifinfo);
 	return 0;
 }
 
@@ -231,7 +372,11 @@ static int __get_port_curr_hwaddr(struct lw_psr_port_priv *psr_ppriv,
 	char *port_hwaddr = team_get_ifinfo_hwaddr(ifinfo);
 	int err;
 
-	err = teamd_getsockname_hwaddr(psr_ppriv->sock, addr, expected_len);
+	if (lw_ap_ppriv_get(psr_ppriv)->shared)
+		err = __get_port_hwaddr_ioctl(psr_ppriv, addr);
+	else
+		err = teamd_getsockname_hwaddr(psr_ppriv->sock, addr,
+					       expected_len);
 	if (err)
 		return err;
 	if ((addr->sll_halen != port_hwaddr_len) ||
@@ -243,120 +388,567 @@ static int __get_port_curr_hwaddr(struct lw_psr_port_priv *psr_ppriv,
 	return 0;
 }
 
-struct arp_packet {
-	struct arphdr			ah;
-	unsigned char			sender_mac[ETH_ALEN];
-	struct in_addr			sender_ip;
-	unsigned char			target_mac[ETH_ALEN];
-	struct in_addr			target_ip;
-} __attribute__((packed));
+static int lw_ap_frame_build(struct lw_psr_port_priv *psr_ppriv)
+{
+	struct lw_ap_port_priv *ap_ppriv = lw_ap_ppriv_get(psr_ppriv);
+	struct sockaddr_ll *ll_my = &ap_ppriv->ll_my;
+	struct sockaddr_ll *ll_bcast = &ap_ppriv->ll_bcast;
+	struct lw_ap_target *target;
+	struct arp_packet *ap;
+	unsigned int i;
+	int err;
 
-struct __vlan_hdr {
-	__be16 h_vlan_TCI;
-	__be16 h_vlan_encapsulated_proto;
-};
+	err = __get_port_curr_hwaddr(psr_ppriv, ll_my, 0);
+	if (err)
+		return err;
+	*ll_bcast = *ll_my;
+	memset(ll_bcast->sll_addr, 0xFF, ll_bcast->sll_halen);
+	if (ap_ppriv->vlanid_in_use) {
+		ll_bcast->sll_protocol = htons(ETH_P_8021Q);
+		ap_ppriv->frame_len = sizeof(struct arp_vlan_packet);
+	} else {
+		ll_bcast->sll_protocol = htons(ETH_P_ARP);
+		ap_ppriv->frame_len = sizeof(struct arp_packet);
+	}
 
-struct arp_vlan_packet {
-	struct __vlan_hdr		vlanh;
-	struct arp_packet		ap;
-} __attribute__((packed));
+	for (i = 0; i < ap_ppriv->target_count; i++) {
+		target = &ap_ppriv->targets[i];
+		memset(&target->frame, 0, sizeof(target->frame));
+		if (ap_ppriv->vlanid_in_use) {
+			struct arp_vlan_packet *avp = &target->frame.avp;
 
-static int lw_ap_send(struct lw_psr_port_priv *psr_ppriv)
+			avp->vlanh.h_vlan_encapsulated_proto = htons(ETH_P_ARP);
+			avp->vlanh.h_vlan_TCI = htons(ap_ppriv->vlanid);
+			ap = &avp->ap;
+		} else {
+			ap = &target->frame.ap;
+		}
+
+		ap->ah.ar_hrd = htons(ll_my->sll_hatype);
+		ap->ah.ar_pro = htons(ETH_P_IP);
+		ap->ah.ar_hln = ll_my->sll_halen;
+		ap->ah.ar_pln = 4;
+		ap->ah.ar_op = htons(ARPOP_REQUEST);
+
+		memcpy(ap->sender_mac, ll_my->sll_addr, sizeof(ap->sender_mac));
+		ap->sender_ip = ap_ppriv->src;
+		memcpy(ap->target_mac, ll_bcast->sll_addr,
+		       sizeof(ap->target_mac));
+		ap->target_ip = target->addr;
+	}
+
+	psr_ppriv->frame_valid = true;
+	return 0;
+}
+
+/* One frame per target, all of them go out in one batch */
+static int lw_ap_frame_get(struct lw_psr_port_priv *psr_ppriv,
+			   unsigned int index, struct lw_psr_frame *frame)
 {
 	struct lw_ap_port_priv *ap_ppriv = lw_ap_ppriv_get(psr_ppriv);
 	int err;
-	struct sockaddr_ll ll_my;
-	struct sockaddr_ll ll_bcast;
-	struct arp_packet ap;
 
+	frame->len = 0;
+	if (index >= ap_ppriv->target_count)
+		return 0;
 	if (!(psr_ppriv->common.forced_send || ap_ppriv->send_always))
 		return 0;
 
-	err = __get_port_curr_hwaddr(psr_ppriv, &ll_my, 0);
-	if (err)
-		return err;
-	ll_bcast = ll_my;
-	memset(ll_bcast.sll_addr, 0xFF, ll_bcast.sll_halen);
+	if (!psr_ppriv->frame_valid) {
+		err = lw_ap_frame_build(psr_ppriv);
+		if (err)
+			return err;
+	}
+	if (ap_ppriv->shared)
+		frame->sock = psr_ppriv->common.ctx->lw_ap_shared->sock;
+	else
+		frame->sock = psr_ppriv->sock;
+	frame->buf = &ap_ppriv->targets[index].frame;
+	frame->len = ap_ppriv->frame_len;
+	frame->addr = (struct sockaddr *) &ap_ppriv->ll_bcast;
+	frame->addrlen = sizeof(ap_ppriv->ll_bcast);
+	return 0;
+}
 
-	memset(&ap, 0, sizeof(ap));
-	ap.ah.ar_hrd = htons(ll_my.sll_hatype);
-	ap.ah.ar_pro = htons(ETH_P_IP);
-	ap.ah.ar_hln = ll_my.sll_halen;
-	ap.ah.ar_pln = 4;
-	ap.ah.ar_op = htons(ARPOP_REQUEST);
+/* Socket is not bound to any protocol so it does not receive */
+static int lw_ap_tx_sock_open(int *sock_p)
+{
+	return teamd_packet_sock_open(sock_p, 0, 0, NULL, NULL);
+}
 
-	memcpy(ap.sender_mac, ll_my.sll_addr, sizeof(ap.sender_mac));
-	ap.sender_ip = ap_ppriv->src;
-	memcpy(ap.target_mac, ll_bcast.sll_addr, sizeof(ap.target_mac));
-	ap.target_ip = ap_ppriv->dst;
+static bool lw_ap_addr_match(struct lw_ap_port_priv *ap_ppriv,
+			     struct lw_ap_target *target,
+			     const struct arp_packet *ap)
+{
+	return (ap_ppriv->src.s_addr == ap->target_ip.s_addr &&
+		target->addr.s_addr == ap->sender_ip.s_addr) ||
+	       (target->addr.s_addr == ap->target_ip.s_addr &&
+		ap_ppriv->src.s_addr == ap->sender_ip.s_addr);
+}
 
-	if (ap_ppriv->vlanid_in_use) {
-		struct arp_vlan_packet avp;
-		avp.ap = ap;
-		avp.vlanh.h_vlan_encapsulated_proto = htons(ETH_P_ARP);
-		avp.vlanh.h_vlan_TCI = htons(ap_ppriv->vlanid);
-		ll_bcast.sll_protocol = htons(ETH_P_8021Q);
-		return teamd_sendto(psr_ppriv->sock, &avp, sizeof(avp),
-				    0, (struct sockaddr *) &ll_bcast,
-				    sizeof(ll_bcast));
-	} else {
-		ll_bcast.sll_protocol = htons(ETH_P_ARP);
-		return teamd_sendto(psr_ppriv->sock, &ap, sizeof(ap),
-				    0, (struct sockaddr *) &ll_bcast,
-				    sizeof(ll_bcast));
-	}
+static struct lw_ap_target *lw_ap_target_find(struct lw_ap_port_priv *ap_ppriv,
+					      const struct arp_packet *ap)
+{
+	unsigned int i;
+
+	for (i = 0; i < ap_ppriv->target_count; i++)
+		if (lw_ap_addr_match(ap_ppriv, &ap_ppriv->targets[i], ap))
+			return &ap_ppriv->targets[i];
+	return NULL;
 }
 
-static int lw_ap_receive(struct lw_psr_port_priv *psr_ppriv)
+static int lw_ap_receive(struct lw_psr_port_priv *psr_ppriv,
+			 const void *buf, size_t len,
+			 const struct sockaddr_ll *from)
 {
 	struct lw_common_port_priv *common_ppriv = &psr_ppriv->common;
 	struct lw_ap_port_priv *ap_ppriv = lw_ap_ppriv_get(psr_ppriv);
+	const struct arp_packet *ap = buf;
+	struct lw_ap_target *target;
+	bool validate;
 	int err;
-	struct sockaddr_ll ll_my;
-	struct sockaddr_ll ll_from;
-	struct arp_packet ap;
 	bool port_enabled;
 
-	err = teamd_recvfrom(psr_ppriv->sock, &ap, sizeof(ap), 0,
-			     (struct sockaddr *) &ll_from, sizeof(ll_from));
-	if (err <= 0)
-		return err;
+	/* Our own requests are seen as outgoing */
+	if (from->sll_pkttype == PACKET_OUTGOING || len < sizeof(*ap))
+		return 0;
 
 	err = teamd_port_enabled(common_ppriv->ctx, common_ppriv->tdport,
 				 &port_enabled);
 	if (err)
 		return err;
 
-	if ((port_enabled && ap_ppriv->validate_active) ||
-	    (!port_enabled && ap_ppriv->validate_inactive)) {
-		err = __get_port_curr_hwaddr(psr_ppriv, &ll_my, 0);
+	validate = (port_enabled && ap_ppriv->validate_active) ||
+		   (!port_enabled && ap_ppriv->validate_inactive);
+	if (validate) {
+		if (!psr_ppriv->frame_valid) {
+			err = lw_ap_frame_build(psr_ppriv);
+			if (err)
+				return err;
+		}
+
+		if (ap->ah.ar_hrd != htons(ap_ppriv->ll_my.sll_hatype) ||
+		    ap->ah.ar_pro != htons(ETH_P_IP) ||
+		    ap->ah.ar_hln != ap_ppriv->ll_my.sll_halen ||
+		    ap->ah.ar_pln != 4) {
+			return 0;
+		}
+	}
+
+	target = lw_ap_target_find(ap_ppriv, ap);
+	if (target)
+		target->replied = true;
+	else if (validate)
+		return 0;
+	else
+		ap_ppriv->unmatched_reply = true;
+	lw_psr_reply_received(psr_ppriv);
+	return 0;
+}
+
+/*
+ * Interval counts as replied once quorum of targets replied. Packets are
+ * assigned to targets by their addresses. With quorum of one and without
+ * validation any other ARP packet counts as well, as before multiple
+ * targets. It can not stand for a particular target, so it never counts
+ * towards a bigger quorum.
+ */
+static bool lw_ap_reply_check(struct lw_psr_port_priv *psr_ppriv)
+{
+	struct lw_ap_port_priv *ap_ppriv = lw_ap_ppriv_get(psr_ppriv);
+	unsigned int replied = 0;
+	bool ret;
+	unsigned int i;
+
+	for (i = 0; i < ap_ppriv->target_count; i++) {
+		if (ap_ppriv->targets[i].replied)
+			replied++;
+		ap_ppriv->targets[i].replied = false;
+	}
+	ap_ppriv->targets_replied = replied;
+	ret = replied >= ap_ppriv->quorum ||
+	      (ap_ppriv->quorum == 1 && ap_ppriv->unmatched_reply);
+	ap_ppriv->unmatched_reply = false;
+	return ret;
+}
+
+static bool lw_ap_probe_match(struct lw_psr_port_priv *psr_ppriv1,
+			      struct lw_psr_port_priv *psr_ppriv2)
+{
+	struct lw_ap_port_priv *ap_ppriv1 = lw_ap_ppriv_get(psr_ppriv1);
+	struct lw_ap_port_priv *ap_ppriv2 = lw_ap_ppriv_get(psr_ppriv2);
+	unsigned int i;
+
+	if (ap_ppriv1->src.s_addr != ap_ppriv2->src.s_addr ||
+	    ap_ppriv1->target_count != ap_ppriv2->target_count ||
+	    ap_ppriv1->quorum != ap_ppriv2->quorum ||
+	    ap_ppriv1->validate_active != ap_ppriv2->validate_active ||
+	    ap_ppriv1->validate_inactive != ap_ppriv2->validate_inactive ||
+	    ap_ppriv1->send_always != ap_ppriv2->send_always ||
+	    ap_ppriv1->vlanid_in_use != ap_ppriv2->vlanid_in_use ||
+	    (ap_ppriv1->vlanid_in_use &&
+	     ap_ppriv1->vlanid != ap_ppriv2->vlanid))
+		return false;
+	for (i = 0; i < ap_ppriv1->target_count; i++)
+		if (ap_ppriv1->targets[i].addr.s_addr !=
+		    ap_ppriv2->targets[i].addr.s_addr)
+			return false;
+	return true;
+}
+
+/*
+ * Shared socket. Link watches with "shared_socket" set receive replies by
+ * a single packet socket not bound to any port. Its filter accepts only ARP
+ * packets matching port, source and target addresses and vlan of any member.
+ * Received packets are dispatched to members by ifindex and addresses.
+ *
+ * The socket has to see all frames (ETH_P_ALL). A protocol specific socket
+ * gets frames of team ports only after they are passed to the team device,
+ * and frames of disabled ports not at all. The filter checks for ARP first
+ * so other frames cost a few instructions. Outgoing frames are not passed
+ * to the socket at all (PACKET_IGNORE_OUTGOING) where kernel supports that,
+ * filter drops them otherwise. ARP packets are compared with member targets
+ * one by one, their number is limited to keep the per-packet cost bounded.
+ */
+
+#ifndef PACKET_IGNORE_OUTGOING
+#define PACKET_IGNORE_OUTGOING 23
+#endif
+
+#define LW_AP_SHARED_CB_NAME "lw_ap_shared"
+#define LW_AP_SHARED_ENTRIES_MAX 64
+#define LW_AP_SHARED_RX_BATCH_MAX 16
+
+#define OFFSET_ARP_SENDER_IP					\
+	in_struct_offset(struct arp_packet, sender_ip)
+#define OFFSET_ARP_TARGET_IP					\
+	in_struct_offset(struct arp_packet, target_ip)
+
+static struct sock_filter arp_shared_head_flt[] = {
+	BPF_STMT(BPF_LD + BPF_B + BPF_ABS, SKF_AD_OFF + SKF_AD_PROTOCOL),
+	BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, ETH_P_ARP, 1, 0),
+	BPF_STMT(BPF_JMP + BPF_JA, 0), /* k will be set to jump to drop */
+	BPF_STMT(BPF_LD + BPF_W + BPF_ABS, SKF_AD_OFF + SKF_AD_PKTTYPE),
+	BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, PACKET_OUTGOING, 0, 1),
+	BPF_STMT(BPF_JMP + BPF_JA, 0), /* k will be set to jump to drop */
+	BPF_STMT(BPF_LD + BPF_H + BPF_ABS, OFFSET_ARP_OP_CODE),
+	BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, ARPOP_REPLY, 2, 0),
+	BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, ARPOP_REQUEST, 1, 0),
+	BPF_STMT(BPF_JMP + BPF_JA, 0), /* k will be set to jump to drop */
+	BPF_STMT(BPF_LD + BPF_W + BPF_ABS, OFFSET_ARP_SENDER_IP),
+	BPF_STMT(BPF_ST, 0),
+	BPF_STMT(BPF_LD + BPF_W + BPF_ABS, OFFSET_ARP_TARGET_IP),
+	BPF_STMT(BPF_ST, 1),
+};
+
+/* Values 0xffffffff and 0xffff are replaced by member ones */
+static struct sock_filter arp_shared_member_flt[] = {
+	BPF_STMT(BPF_LD + BPF_MEM, 0),
+	BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, 0xffffffff, 0, 2), /* dst */
+	BPF_STMT(BPF_LD + BPF_MEM, 1),
+	BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, 0xffffffff, 4, 0), /* src */
+	BPF_STMT(BPF_LD + BPF_MEM, 0),
+	BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, 0xffffffff, 0, 9), /* src */
+	BPF_STMT(BPF_LD + BPF_MEM, 1),
+	BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, 0xffffffff, 0, 7), /* dst */
+	BPF_STMT(BPF_LD + BPF_W + BPF_ABS, SKF_AD_OFF + SKF_AD_IFINDEX),
+	BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, 0xffffffff, 0, 5), /* ifindex */
+	BPF_STMT(BPF_LD + BPF_B + BPF_ABS, SKF_AD_OFF + SKF_AD_VLAN_TAG_PRESENT),
+	BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, 0, 2, 0), /* jt 3 if vlan used */
+	BPF_STMT(BPF_LD + BPF_B + BPF_ABS, SKF_AD_OFF + SKF_AD_VLAN_TAG),
+	BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, 0xffff, 0, 1), /* vlanid */
+	BPF_STMT(BPF_RET + BPF_K, (u_int) -1),
+};
+
+static struct sock_filter arp_shared_drop_flt[] = {
+	BPF_STMT(BPF_RET + BPF_K, 0),
+};
+
+static const struct sock_fprog arp_shared_drop_fprog = {
+	.len = ARRAY_SIZE(arp_shared_drop_flt),
+	.filter = arp_shared_drop_flt,
+};
+
+static void lw_ap_shared_member_flt_fill(struct sock_filter *flt,
+					 struct lw_ap_port_priv *ap_ppriv,
+					 struct lw_ap_target *target)
+{
+	uint32_t src = ntohl(ap_ppriv->src.s_addr);
+	uint32_t dst = ntohl(target->addr.s_addr);
+
+	memcpy(flt, arp_shared_member_flt, sizeof(arp_shared_member_flt));
+	flt[1].k = dst;
+	flt[3].k = src;
+	flt[5].k = src;
+	flt[7].k = dst;
+	flt[9].k = ap_ppriv->start.common.tdport->ifindex;
+	if (ap_ppriv->vlanid_in_use) {
+		flt[11].jt = 3;
+		flt[13].k = ap_ppriv->vlanid;
+	} else {
+		flt[13].k = 0;
+	}
+}
+
+static int lw_ap_shared_filter_update(struct lw_ap_shared *shared)
+{
+	unsigned int head_len = ARRAY_SIZE(arp_shared_head_flt);
+	unsigned int member_len = ARRAY_SIZE(arp_shared_member_flt);
+	struct lw_ap_port_priv *ap_ppriv;
+	struct sock_filter *flt;
+	struct sock_fprog fprog;
+	unsigned int drop;
+	unsigned int pos;
+	unsigned int i;
+	unsigned int j;
+	int ret;
+	int err;
+
+	drop = head_len + shared->entry_count * member_len;
+	if (drop + 1 > BPF_MAXINSNS)
+		return -E2BIG;
+	flt = malloc((drop + 1) * sizeof(*flt));
+	if (!flt)
+		return -ENOMEM;
+	memcpy(flt, arp_shared_head_flt, sizeof(arp_shared_head_flt));
+	flt[2].k = drop - 3;
+	flt[5].k = drop - 6;
+	flt[9].k = drop - 10;
+	pos = head_len;
+	for (i = 0; i < LW_AP_SHARED_HASH_SIZE; i++) {
+		list_for_each_node_entry(ap_ppriv, &shared->hash[i],
+					 shared_list) {
+			for (j = 0; j < ap_ppriv->target_count; j++) {
+				lw_ap_shared_member_flt_fill(&flt[pos], ap_ppriv,
+							     &ap_ppriv->targets[j]);
+				pos += member_len;
+			}
+		}
+	}
+	flt[drop] = arp_shared_drop_flt[0];
+
+	fprog.len = drop + 1;
+	fprog.filter = flt;
+	ret = setsockopt(shared->sock, SOL_SOCKET, SO_ATTACH_FILTER,
+			 &fprog, sizeof(fprog));
+	err = ret == -1 ? -errno : 0;
+	free(flt);
+	if (err)
+		teamd_log_err("Failed to attach shared socket filter.");
+	return err;
+}
+
+static int lw_ap_shared_dispatch(struct lw_ap_shared *shared,
+				 const struct sockaddr_ll *from,
+				 const void *buf, size_t len)
+{
+	const struct arp_packet *ap = buf;
+	struct lw_ap_port_priv *ap_ppriv;
+	struct lw_psr_port_priv *psr_ppriv;
+	int ifindex = from->sll_ifindex;
+	unsigned int bucket = ifindex % LW_AP_SHARED_HASH_SIZE;
+	int err;
+
+	if (from->sll_pkttype == PACKET_OUTGOING || len < sizeof(*ap))
+		return 0;
+	list_for_each_node_entry(ap_ppriv, &shared->hash[bucket],
+				 shared_list) {
+		psr_ppriv = &ap_ppriv->start.psr;
+		if (psr_ppriv->common.tdport->ifindex != ifindex ||
+		    !lw_ap_target_find(ap_ppriv, ap))
+			continue;
+		psr_ppriv->stats.rx_frames++;
+		err = psr_ppriv->ops->receive(psr_ppriv, buf, len, from);
 		if (err)
 			return err;
+	}
+	return 0;
+}
 
-		if (ap.ah.ar_hrd != htons(ll_my.sll_hatype) ||
-		    ap.ah.ar_pro != htons(ETH_P_IP) ||
-		    ap.ah.ar_hln != ll_my.sll_halen ||
-		    ap.ah.ar_pln != 4) {
-			return 0;
+static int lw_ap_shared_callback_socket(struct teamd_context *ctx, int events,
+					void *priv)
+{
+	struct lw_ap_shared *shared = priv;
+	struct arp_packet buf[LW_AP_SHARED_RX_BATCH_MAX];
+	struct sockaddr_ll addr[LW_AP_SHARED_RX_BATCH_MAX];
+	struct iovec iov[LW_AP_SHARED_RX_BATCH_MAX];
+	struct mmsghdr msg[LW_AP_SHARED_RX_BATCH_MAX];
+	int count;
+	int err;
+	int i;
+
+	do {
+		memset(msg, 0, sizeof(msg));
+		for (i = 0; i < LW_AP_SHARED_RX_BATCH_MAX; i++) {
+			iov[i].iov_base = &buf[i];
+			iov[i].iov_len = sizeof(buf[i]);
+			msg[i].msg_hdr.msg_name = &addr[i];
+			msg[i].msg_hdr.msg_namelen = sizeof(addr[i]);
+			msg[i].msg_hdr.msg_iov = &iov[i];
+			msg[i].msg_hdr.msg_iovlen = 1;
+		}
+		count = teamd_recvmmsg(shared->sock, msg,
+				       LW_AP_SHARED_RX_BATCH_MAX, MSG_DONTWAIT);
+		if (count < 0)
+			return count;
+		for (i = 0; i < count; i++) {
+			err = lw_ap_shared_dispatch(shared, &addr[i],
+						    &buf[i], msg[i].msg_len);
+			if (err)
+				return err;
 		}
+	} while (count == LW_AP_SHARED_RX_BATCH_MAX);
+	return 0;
+}
 
-		if ((ap_ppriv->src.s_addr != ap.target_ip.s_addr ||
-		     ap_ppriv->dst.s_addr != ap.sender_ip.s_addr) &&
-		    (ap_ppriv->dst.s_addr != ap.target_ip.s_addr ||
-		     ap_ppriv->src.s_addr != ap.sender_ip.s_addr))
-			return 0;
+static int lw_ap_shared_create(struct teamd_context *ctx)
+{
+	struct lw_ap_shared *shared;
+	int one = 1;
+	int err;
+	int ret;
+	int i;
+
+	shared = myzalloc(sizeof(*shared));
+	if (!shared)
+		return -ENOMEM;
+	shared->ctx = ctx;
+	for (i = 0; i < LW_AP_SHARED_HASH_SIZE; i++)
+		list_init(&shared->hash[i]);
+
+	/* Drop everything until filter of members is attached */
+	err = teamd_packet_sock_open(&shared->sock, 0, htons(ETH_P_ALL),
+				     &arp_shared_drop_fprog, NULL);
+	if (err)
+		goto free_shared;
+
+	ret = setsockopt(shared->sock, SOL_PACKET, PACKET_IGNORE_OUTGOING,
+			 &one, sizeof(one));
+	if (ret == -1) {
+		if (errno != ENOPROTOOPT) {
+			teamd_log_err("Failed to ignore outgoing frames.");
+			err = -errno;
+			goto close_sock;
+		}
+		teamd_log_dbg("Outgoing frames are dropped by filter only.");
+	}
+
+	err = teamd_loop_callback_fd_add(ctx, LW_AP_SHARED_CB_NAME, shared,
+					 lw_ap_shared_callback_socket,
+					 shared->sock,
+					 TEAMD_LOOP_FD_EVENT_READ);
+	if (err) {
+		teamd_log_err("Failed add shared socket callback.");
+		goto close_sock;
+	}
+	teamd_loop_callback_enable(ctx, LW_AP_SHARED_CB_NAME, shared);
+	ctx->lw_ap_shared = shared;
+	return 0;
+
+close_sock:
+	close(shared->sock);
+free_shared:
+	free(shared);
+	return err;
+}
+
+static void lw_ap_shared_destroy(struct lw_ap_shared *shared)
+{
+	struct teamd_context *ctx = shared->ctx;
+
+	teamd_loop_callback_del(ctx, LW_AP_SHARED_CB_NAME, shared);
+	close(shared->sock);
+	free(shared);
+	ctx->lw_ap_shared = NULL;
+}
+
+static void lw_ap_shared_leave(struct lw_ap_port_priv *ap_ppriv)
+{
+	struct lw_ap_shared *shared = ap_ppriv->start.common.ctx->lw_ap_shared;
+
+	list_del(&ap_ppriv->shared_list);
+	shared->entry_count -= ap_ppriv->target_count;
+	if (!shared->entry_count) {
+		lw_ap_shared_destroy(shared);
+		return;
 	}
+	/* In case of failure the old filter stays, dispatch ignores others */
+	lw_ap_shared_filter_update(shared);
+}
 
-	psr_ppriv->reply_received = true;
+static int lw_ap_shared_join(struct lw_ap_port_priv *ap_ppriv)
+{
+	struct teamd_context *ctx = ap_ppriv->start.common.ctx;
+	uint32_t ifindex = ap_ppriv->start.common.tdport->ifindex;
+	struct lw_ap_shared *shared;
+	int err;
+
+	if (!ctx->lw_ap_shared) {
+		err = lw_ap_shared_create(ctx);
+		if (err)
+			return err;
+	}
+	shared = ctx->lw_ap_shared;
+	if (shared->entry_count + ap_ppriv->target_count >
+	    LW_AP_SHARED_ENTRIES_MAX) {
+		teamd_log_err("Too many link watch targets using shared socket.");
+		return -E2BIG;
+	}
+	list_add_tail(&shared->hash[ifindex % LW_AP_SHARED_HASH_SIZE],
+		      &ap_ppriv->shared_list);
+	shared->entry_count += ap_ppriv->target_count;
+	err = lw_ap_shared_filter_update(shared);
+	if (err) {
+		lw_ap_shared_leave(ap_ppriv);
+		return err;
+	}
 	return 0;
 }
 
+static int lw_ap_sock_open(struct lw_psr_port_priv *psr_ppriv)
+{
+	struct lw_ap_port_priv *ap_ppriv = lw_ap_ppriv_get(psr_ppriv);
+	struct sock_fprog fprog;
+	struct sock_filter arp_vlan_rpl_flt[ARRAY_SIZE(arp_vlan_rpl_flt)];
+
+	if (ap_ppriv->shared) {
+		psr_ppriv->sock = -1;
+		return lw_ap_shared_join(ap_ppriv);
+	}
+
+	if (ap_ppriv->vlanid_in_use) {
+		memcpy(&arp_vlan_rpl_flt, arp_vlan_rpl_fprog.filter,
+		       sizeof(arp_vlan_rpl_flt));
+		fprog = arp_vlan_rpl_fprog;
+		fprog.filter = arp_vlan_rpl_flt;
+		SET_FILTER_VLANID(&fprog, ap_ppriv->vlanid);
+	} else {
+		fprog = arp_novlan_rpl_fprog;
+	}
+	return teamd_packet_sock_open(&psr_ppriv->sock,
+				      psr_ppriv->common.tdport->ifindex,
+				      htons(ETH_P_ALL), &fprog, &arp_rpl_fprog);
+}
+
+static void lw_ap_sock_close(struct lw_psr_port_priv *psr_ppriv)
+{
+	struct lw_ap_port_priv *ap_ppriv = lw_ap_ppriv_get(psr_ppriv);
+
+	if (ap_ppriv->shared)
+		lw_ap_shared_leave(ap_ppriv);
+	else
+		close(psr_ppriv->sock);
+}
+
 static const struct lw_psr_ops lw_psr_ops_ap = {
 	.sock_open		= lw_ap_sock_open,
 	.sock_close		= lw_ap_sock_close,
 	.load_options		= lw_ap_load_options,
-	.send			= lw_ap_send,
 	.receive		= lw_ap_receive,
+	.frame_get		= lw_ap_frame_get,
+	.tx_sock_open		= lw_ap_tx_sock_open,
+	.reply_check		= lw_ap_reply_check,
+	.probe_match		= lw_ap_probe_match,
 };
 
 static int lw_ap_port_added(struct teamd_context *ctx,
@@ -389,8 +981,45 @@ static int lw_ap_state_target_host_get(struct teamd_context *ctx,
 	struct lw_common_port_priv *common_ppriv = priv;
 	struct lw_psr_port_priv *psr_ppriv = lw_psr_ppriv_get(common_ppriv);
 	struct lw_ap_port_priv *ap_ppriv = lw_ap_ppriv_get(psr_ppriv);
+	size_t size = ap_ppriv->target_count * (NI_MAXHOST + 1);
+	char *str;
+	size_t len = 0;
+	unsigned int i;
+
+	/* Multiple targets are separated by space */
+	str = malloc(size);
+	if (!str)
+		return -ENOMEM;
+	str[0] = '\0';
+	for (i = 0; i < ap_ppriv->target_count; i++)
+		len += snprintf(str + len, size - len, i ? " %s" : "%s",
+				str_in_addr(&ap_ppriv->targets[i].addr));
+	gsc->data.str_val.ptr = str;
+	gsc->data.str_val.free = true;
+	return 0;
+}
+
+static int lw_ap_state_quorum_get(struct teamd_context *ctx,
+				  struct team_state_gsc *gsc,
+				  void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct lw_psr_port_priv *psr_ppriv = lw_psr_ppriv_get(common_ppriv);
+	struct lw_ap_port_priv *ap_ppriv = lw_ap_ppriv_get(psr_ppriv);
+
+	gsc->data.int_val = ap_ppriv->quorum;
+	return 0;
+}
+
+static int lw_ap_state_targets_replied_get(struct teamd_context *ctx,
+					   struct team_state_gsc *gsc,
+					   void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct lw_psr_port_priv *psr_ppriv = lw_psr_ppriv_get(common_ppriv);
+	struct lw_ap_port_priv *ap_ppriv = lw_ap_ppriv_get(psr_ppriv);
 
-	gsc->data.str_val.ptr = str_in_addr(&ap_ppriv->dst);
+	gsc->data.int_val = ap_ppriv->targets_replied;
 	return 0;
 }
 
@@ -430,6 +1059,18 @@ static int lw_ap_state_send_always_get(struct teamd_context *ctx,
 	return 0;
 }
 
+static int lw_ap_state_shared_socket_get(struct teamd_context *ctx,
+					 struct team_state_gsc *gsc,
+					 void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct lw_psr_port_priv *psr_ppriv = lw_psr_ppriv_get(common_ppriv);
+	struct lw_ap_port_priv *ap_ppriv = lw_ap_ppriv_get(psr_ppriv);
+
+	gsc->data.bool_val = ap_ppriv->shared;
+	return 0;
+}
+
 static const struct teamd_state_val lw_ap_state_vals[] = {
 	{
 		.subpath = "source_host",
@@ -441,6 +1082,16 @@ static const struct teamd_state_val lw_ap_state_vals[] = {
 		.type = TEAMD_STATE_ITEM_TYPE_STRING,
 		.getter = lw_ap_state_target_host_get,
 	},
+	{
+		.subpath = "quorum",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_ap_state_quorum_get,
+	},
+	{
+		.subpath = "targets_replied",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_ap_state_targets_replied_get,
+	},
 	{
 		.subpath = "interval",
 		.type = TEAMD_STATE_ITEM_TYPE_INT,
@@ -476,6 +1127,81 @@ static const struct teamd_state_val lw_ap_state_vals[] = {
 		.type = TEAMD_STATE_ITEM_TYPE_INT,
 		.getter = lw_psr_state_missed_get,
 	},
+	{
+		.subpath = "batch",
+		.type = TEAMD_STATE_ITEM_TYPE_BOOL,
+		.getter = lw_psr_state_batch_get,
+	},
+	{
+		.subpath = "current_interval",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_current_interval_get,
+	},
+	{
+		.subpath = "interval_mode",
+		.type = TEAMD_STATE_ITEM_TYPE_STRING,
+		.getter = lw_psr_state_interval_mode_get,
+	},
+	{
+		.subpath = "phys_port_share",
+		.type = TEAMD_STATE_ITEM_TYPE_BOOL,
+		.getter = lw_psr_state_phys_port_share_get,
+	},
+	{
+		.subpath = "phys_port_leader",
+		.type = TEAMD_STATE_ITEM_TYPE_STRING,
+		.getter = lw_psr_state_phys_port_leader_get,
+	},
+	{
+		.subpath = "shared_socket",
+		.type = TEAMD_STATE_ITEM_TYPE_BOOL,
+		.getter = lw_ap_state_shared_socket_get,
+	},
+	{
+		.subpath = "tx_probes",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_tx_probes_get,
+	},
+	{
+		.subpath = "tx_syscalls",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_tx_syscalls_get,
+	},
+	{
+		.subpath = "rx_frames",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_rx_frames_get,
+	},
+	{
+		.subpath = "rx_syscalls",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_rx_syscalls_get,
+	},
+	{
+		.subpath = "rtt_last",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_rtt_last_get,
+	},
+	{
+		.subpath = "rtt_ewma",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_rtt_ewma_get,
+	},
+	{
+		.subpath = "rtt_min",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_rtt_min_get,
+	},
+	{
+		.subpath = "rtt_max",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_rtt_max_get,
+	},
+	{
+		.subpath = "rtt_histogram",
+		.type = TEAMD_STATE_ITEM_TYPE_STRING,
+		.getter = lw_psr_state_rtt_histogram_get,
+	},
 };
 
 const struct teamd_link_watch teamd_link_watch_arp_ping = {
@@ -0,0 +1,582 @@
+/*
+ *   teamd_lw_bfd_echo.c - Team port BFD-style echo link watcher
+ *   Copyright (C) 2012-2015 Jiri Pirko <jiri@resnulli.us>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/ether.h>
+#include <linux/if_ether.h>
+#include <private/misc.h>
+#include "teamd.h"
+#include "teamd_link_watch.h"
+#include "teamd_config.h"
+
+/*
+ * BFD-style echo link watch
+ *
+ * Echo requests are sent periodically to the peer using frames of local
+ * experimental ethertype. Peer link watch replies to them. Link is up as long
+ * as a reply is received at least once in detect_mult consecutive intervals.
+ * Both sides advertise their desired transmit and required receive intervals
+ * and the transmit interval used is the slower of local desired and remote
+ * required one, as in BFD.
+ */
+
+#define BFD_ECHO_ETH_P		0x88B5 /* IEEE local experimental 1 */
+#define BFD_ECHO_MAGIC		0x74424645
+#define BFD_ECHO_VERSION	1
+#define BFD_ECHO_TYPE_REQUEST	1
+#define BFD_ECHO_TYPE_REPLY	2
+
+#define BFD_ECHO_DEFAULT_DETECT_MULT 3
+
+struct bfd_echo_packet {
+	uint32_t magic;
+	uint8_t version;
+	uint8_t type;
+	uint8_t detect_mult;
+	uint8_t reserved;
+	uint32_t my_discr;
+	uint32_t your_discr;
+	uint32_t desired_min_tx; /* in microseconds */
+	uint32_t required_min_rx; /* in microseconds */
+	uint32_t seq;
+} __attribute__((packed));
+
+struct lw_bfd_port_priv {
+	union {
+		struct lw_common_port_priv common;
+		struct lw_psr_port_priv psr;
+	} start; /* must be first */
+	struct timespec desired_min_tx;
+	struct timespec required_min_rx;
+	unsigned int detect_mult;
+	unsigned char peer_hwaddr[ETH_ALEN];
+	bool respond;
+	uint32_t my_discr;
+	uint32_t seq;
+	struct {
+		uint32_t discr;
+		unsigned int desired_min_tx_us;
+		unsigned int required_min_rx_us;
+		unsigned int detect_mult;
+	} remote;
+	/* prebuilt request frame, valid while start.psr.frame_valid is set */
+	struct sockaddr_ll ll_peer;
+	struct bfd_echo_packet request;
+};
+
+static struct lw_bfd_port_priv *
+lw_bfd_ppriv_get(struct lw_psr_port_priv *psr_ppriv)
+{
+	return (struct lw_bfd_port_priv *) psr_ppriv;
+}
+
+static unsigned int timespec_to_us(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000 + ts->tv_nsec / 1000;
+}
+
+static void us_to_timespec(struct timespec *ts, unsigned int us)
+{
+	ts->tv_sec = us / 1000000;
+	ts->tv_nsec = (us % 1000000) * 1000;
+}
+
+static int lw_bfd_sock_open(struct lw_psr_port_priv *psr_ppriv)
+{
+	return teamd_packet_sock_open(&psr_ppriv->sock,
+				      psr_ppriv->common.tdport->ifindex,
+				      htons(BFD_ECHO_ETH_P), NULL, NULL);
+}
+
+static void lw_bfd_sock_close(struct lw_psr_port_priv *psr_ppriv)
+{
+	close(psr_ppriv->sock);
+}
+
+static int lw_bfd_load_options(struct teamd_context *ctx,
+			       struct teamd_port *tdport,
+			       struct lw_psr_port_priv *psr_ppriv)
+{
+	struct lw_bfd_port_priv *bfd_ppriv = lw_bfd_ppriv_get(psr_ppriv);
+	struct teamd_config_path_cookie *cpcookie = psr_ppriv->common.cpcookie;
+	struct ether_addr peer;
+	const char *str;
+	int tmp;
+	int err;
+
+	/* Interval is negotiated with the peer, it can not adapt on its own */
+	if (psr_ppriv->adaptive.enabled) {
+		teamd_log_err("\"adaptive\" is not supported by this link-watch.");
+		return -EINVAL;
+	}
+
+	bfd_ppriv->desired_min_tx = psr_ppriv->interval;
+
+	err = teamd_config_int_get(ctx, &tmp, "@.required_min_rx", cpcookie);
+	if (!err) {
+		if (tmp <= 0) {
+			teamd_log_err("\"required_min_rx\" must be positive number.");
+			return -EINVAL;
+		}
+		ms_to_timespec(&bfd_ppriv->required_min_rx, tmp);
+	} else {
+		bfd_ppriv->required_min_rx = bfd_ppriv->desired_min_tx;
+	}
+	teamd_log_dbg("required_min_rx \"%d\".",
+		      timespec_to_ms(&bfd_ppriv->required_min_rx));
+
+	err = teamd_config_int_get(ctx, &tmp, "@.detect_mult", cpcookie);
+	if (!err) {
+		if (tmp < 1 || tmp > 255) {
+			teamd_log_err("\"detect_mult\" value is out of its limits.");
+			return -EINVAL;
+		}
+	} else {
+		tmp = BFD_ECHO_DEFAULT_DETECT_MULT;
+	}
+	teamd_log_dbg("detect_mult \"%d\".", tmp);
+	bfd_ppriv->detect_mult = tmp;
+	/* Link goes down once detect_mult intervals in a row are missed */
+	psr_ppriv->missed_max = tmp - 1;
+
+	err = teamd_config_string_get(ctx, &str, "@.peer_hwaddr", cpcookie);
+	if (!err) {
+		if (!ether_aton_r(str, &peer)) {
+			teamd_log_err("Failed to parse \"peer_hwaddr\".");
+			return -EINVAL;
+		}
+		memcpy(bfd_ppriv->peer_hwaddr, peer.ether_addr_octet, ETH_ALEN);
+	} else {
+		memset(bfd_ppriv->peer_hwaddr, 0xFF, ETH_ALEN);
+	}
+
+	err = teamd_config_bool_get(ctx, &bfd_ppriv->respond, "@.respond",
+				    cpcookie);
+	if (err)
+		bfd_ppriv->respond = true;
+	teamd_log_dbg("respond \"%d\".", bfd_ppriv->respond);
+
+	/* Discriminator has to differ between teamd instances and ports */
+	bfd_ppriv->my_discr = ((uint32_t) getpid() << 16) ^
+			      ((uint32_t) tdport->ifindex << 4) ^
+			      psr_ppriv->common.id;
+	return 0;
+}
+
+static void lw_bfd_packet_fill(struct lw_bfd_port_priv *bfd_ppriv,
+			       struct bfd_echo_packet *packet, uint8_t type)
+{
+	memset(packet, 0, sizeof(*packet));
+	packet->magic = htonl(BFD_ECHO_MAGIC);
+	packet->version = BFD_ECHO_VERSION;
+	packet->type = type;
+	packet->detect_mult = bfd_ppriv->detect_mult;
+	packet->my_discr = htonl(bfd_ppriv->my_discr);
+	packet->your_discr = htonl(bfd_ppriv->remote.discr);
+	packet->desired_min_tx =
+		htonl(timespec_to_us(&bfd_ppriv->desired_min_tx));
+	packet->required_min_rx =
+		htonl(timespec_to_us(&bfd_ppriv->required_min_rx));
+}
+
+static void lw_bfd_frame_build(struct lw_psr_port_priv *psr_ppriv)
+{
+	struct lw_bfd_port_priv *bfd_ppriv = lw_bfd_ppriv_get(psr_ppriv);
+	struct sockaddr_ll *ll_peer = &bfd_ppriv->ll_peer;
+
+	memset(ll_peer, 0, sizeof(*ll_peer));
+	ll_peer->sll_family = AF_PACKET;
+	ll_peer->sll_protocol = htons(BFD_ECHO_ETH_P);
+	ll_peer->sll_ifindex = psr_ppriv->common.tdport->ifindex;
+	ll_peer->sll_halen = ETH_ALEN;
+	memcpy(ll_peer->sll_addr, bfd_ppriv->peer_hwaddr, ETH_ALEN);
+
+	lw_bfd_packet_fill(bfd_ppriv, &bfd_ppriv->request,
+			   BFD_ECHO_TYPE_REQUEST);
+	psr_ppriv->frame_valid = true;
+}
+
+static int lw_bfd_frame_get(struct lw_psr_port_priv *psr_ppriv,
+			    unsigned int index, struct lw_psr_frame *frame)
+{
+	struct lw_bfd_port_priv *bfd_ppriv = lw_bfd_ppriv_get(psr_ppriv);
+
+	frame->len = 0;
+	if (index)
+		return 0;
+	if (!psr_ppriv->frame_valid)
+		lw_bfd_frame_build(psr_ppriv);
+	bfd_ppriv->request.seq = htonl(++bfd_ppriv->seq);
+	frame->sock = psr_ppriv->sock;
+	frame->buf = &bfd_ppriv->request;
+	frame->len = sizeof(bfd_ppriv->request);
+	frame->addr = (struct sockaddr *) &bfd_ppriv->ll_peer;
+	frame->addrlen = sizeof(bfd_ppriv->ll_peer);
+	return 0;
+}
+
+/* Socket is not bound to any protocol so it does not receive */
+static int lw_bfd_tx_sock_open(int *sock_p)
+{
+	return teamd_packet_sock_open(sock_p, 0, 0, NULL, NULL);
+}
+
+static int lw_bfd_remote_update(struct lw_psr_port_priv *psr_ppriv,
+				const struct bfd_echo_packet *packet)
+{
+	struct lw_bfd_port_priv *bfd_ppriv = lw_bfd_ppriv_get(psr_ppriv);
+	unsigned int desired_min_tx_us = ntohl(packet->desired_min_tx);
+	unsigned int required_min_rx_us = ntohl(packet->required_min_rx);
+	uint32_t discr = ntohl(packet->my_discr);
+	struct timespec interval;
+	unsigned int tx_us;
+
+	if (bfd_ppriv->remote.discr == discr &&
+	    bfd_ppriv->remote.desired_min_tx_us == desired_min_tx_us &&
+	    bfd_ppriv->remote.required_min_rx_us == required_min_rx_us)
+		return 0;
+
+	bfd_ppriv->remote.discr = discr;
+	bfd_ppriv->remote.desired_min_tx_us = desired_min_tx_us;
+	bfd_ppriv->remote.required_min_rx_us = required_min_rx_us;
+	bfd_ppriv->remote.detect_mult = packet->detect_mult;
+	psr_ppriv->frame_valid = false;
+
+	/* Do not send faster than the peer is willing to receive */
+	tx_us = timespec_to_us(&bfd_ppriv->desired_min_tx);
+	if (required_min_rx_us > tx_us)
+		tx_us = required_min_rx_us;
+	us_to_timespec(&interval, tx_us);
+	if (memcmp(&interval, &psr_ppriv->interval, sizeof(interval)))
+		teamd_log_dbg("%s: Negotiated bfd_echo interval %u us.",
+			      psr_ppriv->common.tdport->ifname, tx_us);
+	return lw_psr_interval_set(psr_ppriv, &interval);
+}
+
+static int lw_bfd_respond(struct lw_psr_port_priv *psr_ppriv,
+			  const struct bfd_echo_packet *request,
+			  const struct sockaddr_ll *from)
+{
+	struct lw_bfd_port_priv *bfd_ppriv = lw_bfd_ppriv_get(psr_ppriv);
+	struct bfd_echo_packet reply;
+	struct sockaddr_ll ll_to;
+
+	lw_bfd_packet_fill(bfd_ppriv, &reply, BFD_ECHO_TYPE_REPLY);
+	reply.your_discr = request->my_discr;
+	reply.seq = request->seq;
+
+	memset(&ll_to, 0, sizeof(ll_to));
+	ll_to.sll_family = AF_PACKET;
+	ll_to.sll_protocol = htons(BFD_ECHO_ETH_P);
+	ll_to.sll_ifindex = psr_ppriv->common.tdport->ifindex;
+	ll_to.sll_halen = ETH_ALEN;
+	memcpy(ll_to.sll_addr, from->sll_addr, ETH_ALEN);
+	return teamd_sendto(psr_ppriv->sock, &reply, sizeof(reply), 0,
+			    (struct sockaddr *) &ll_to, sizeof(ll_to));
+}
+
+extern const struct teamd_link_watch teamd_link_watch_bfd_echo;
+
+static bool lw_bfd_discr_match(struct lw_common_port_priv *common_ppriv,
+			       void *priv)
+{
+	struct lw_bfd_port_priv *bfd_ppriv =
+		lw_bfd_ppriv_get(lw_psr_ppriv_get(common_ppriv));
+
+	return bfd_ppriv->my_discr == *(uint32_t *) priv;
+}
+
+/*
+ * Ports of the same team may share a segment. Packets sent by any of our
+ * ports must not be taken as peer ones, otherwise ports answer each other.
+ */
+static bool lw_bfd_packet_is_ours(struct lw_psr_port_priv *psr_ppriv,
+				  const struct bfd_echo_packet *packet,
+				  const struct sockaddr_ll *from)
+{
+	struct teamd_context *ctx = psr_ppriv->common.ctx;
+	uint32_t discr = ntohl(packet->my_discr);
+	struct teamd_port *tdport;
+
+	teamd_for_each_tdport(tdport, ctx) {
+		if (team_get_ifinfo_hwaddr_len(tdport->team_ifinfo) == ETH_ALEN &&
+		    !memcmp(team_get_ifinfo_hwaddr(tdport->team_ifinfo),
+			    from->sll_addr, ETH_ALEN))
+			return true;
+	}
+	return teamd_link_watch_port_priv_find(ctx, &teamd_link_watch_bfd_echo,
+					       lw_bfd_discr_match, &discr);
+}
+
+static int lw_bfd_receive(struct lw_psr_port_priv *psr_ppriv,
+			  const void *buf, size_t len,
+			  const struct sockaddr_ll *from)
+{
+	struct lw_bfd_port_priv *bfd_ppriv = lw_bfd_ppriv_get(psr_ppriv);
+	const struct bfd_echo_packet *packet = buf;
+	int err;
+
+	if (from->sll_pkttype == PACKET_OUTGOING ||
+	    len < sizeof(*packet) ||
+	    packet->magic != htonl(BFD_ECHO_MAGIC) ||
+	    packet->version != BFD_ECHO_VERSION ||
+	    from->sll_halen != ETH_ALEN)
+		return 0;
+	if (lw_bfd_packet_is_ours(psr_ppriv, packet, from))
+		return 0;
+
+	err = lw_bfd_remote_update(psr_ppriv, packet);
+	if (err)
+		return err;
+
+	switch (packet->type) {
+	case BFD_ECHO_TYPE_REQUEST:
+		if (!bfd_ppriv->respond)
+			return 0;
+		return lw_bfd_respond(psr_ppriv, packet, from);
+	case BFD_ECHO_TYPE_REPLY:
+		/* Late reply to an earlier request says nothing about this one */
+		if (ntohl(packet->your_discr) == bfd_ppriv->my_discr &&
+		    ntohl(packet->seq) == bfd_ppriv->seq)
+			lw_psr_reply_received(psr_ppriv);
+		return 0;
+	}
+	return 0;
+}
+
+static const struct lw_psr_ops lw_psr_ops_bfd = {
+	.sock_open		= lw_bfd_sock_open,
+	.sock_close		= lw_bfd_sock_close,
+	.load_options		= lw_bfd_load_options,
+	.receive		= lw_bfd_receive,
+	.frame_get		= lw_bfd_frame_get,
+	.tx_sock_open		= lw_bfd_tx_sock_open,
+};
+
+static int lw_bfd_port_added(struct teamd_context *ctx,
+			     struct teamd_port *tdport,
+			     void *priv, void *creator_priv)
+{
+	struct lw_psr_port_priv *psr_ppriv = priv;
+
+	psr_ppriv->ops = &lw_psr_ops_bfd;
+	return lw_psr_port_added(ctx, tdport, priv, creator_priv);
+}
+
+static int lw_bfd_state_desired_min_tx_get(struct teamd_context *ctx,
+					   struct team_state_gsc *gsc,
+					   void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct lw_psr_port_priv *psr_ppriv = lw_psr_ppriv_get(common_ppriv);
+	struct lw_bfd_port_priv *bfd_ppriv = lw_bfd_ppriv_get(psr_ppriv);
+
+	gsc->data.int_val = timespec_to_ms(&bfd_ppriv->desired_min_tx);
+	return 0;
+}
+
+static int lw_bfd_state_required_min_rx_get(struct teamd_context *ctx,
+					    struct team_state_gsc *gsc,
+					    void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct lw_psr_port_priv *psr_ppriv = lw_psr_ppriv_get(common_ppriv);
+	struct lw_bfd_port_priv *bfd_ppriv = lw_bfd_ppriv_get(psr_ppriv);
+
+	gsc->data.int_val = timespec_to_ms(&bfd_ppriv->required_min_rx);
+	return 0;
+}
+
+static int lw_bfd_state_detect_mult_get(struct teamd_context *ctx,
+					struct team_state_gsc *gsc,
+					void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct lw_psr_port_priv *psr_ppriv = lw_psr_ppriv_get(common_ppriv);
+	struct lw_bfd_port_priv *bfd_ppriv = lw_bfd_ppriv_get(psr_ppriv);
+
+	gsc->data.int_val = bfd_ppriv->detect_mult;
+	return 0;
+}
+
+static int lw_bfd_state_respond_get(struct teamd_context *ctx,
+				    struct team_state_gsc *gsc,
+				    void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct lw_psr_port_priv *psr_ppriv = lw_psr_ppriv_get(common_ppriv);
+	struct lw_bfd_port_priv *bfd_ppriv = lw_bfd_ppriv_get(psr_ppriv);
+
+	gsc->data.bool_val = bfd_ppriv->respond;
+	return 0;
+}
+
+static int lw_bfd_state_remote_desired_min_tx_get(struct teamd_context *ctx,
+						  struct team_state_gsc *gsc,
+						  void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct lw_psr_port_priv *psr_ppriv = lw_psr_ppriv_get(common_ppriv);
+	struct lw_bfd_port_priv *bfd_ppriv = lw_bfd_ppriv_get(psr_ppriv);
+
+	gsc->data.int_val = bfd_ppriv->remote.desired_min_tx_us / 1000;
+	return 0;
+}
+
+static int lw_bfd_state_remote_required_min_rx_get(struct teamd_context *ctx,
+						   struct team_state_gsc *gsc,
+						   void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct lw_psr_port_priv *psr_ppriv = lw_psr_ppriv_get(common_ppriv);
+	struct lw_bfd_port_priv *bfd_ppriv = lw_bfd_ppriv_get(psr_ppriv);
+
+	gsc->data.int_val = bfd_ppriv->remote.required_min_rx_us / 1000;
+	return 0;
+}
+
+static int lw_bfd_state_remote_detect_mult_get(struct teamd_context *ctx,
+					       struct team_state_gsc *gsc,
+					       void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct lw_psr_port_priv *psr_ppriv = lw_psr_ppriv_get(common_ppriv);
+	struct lw_bfd_port_priv *bfd_ppriv = lw_bfd_ppriv_get(psr_ppriv);
+
+	gsc->data.int_val = bfd_ppriv->remote.detect_mult;
+	return 0;
+}
+
+static const struct teamd_state_val lw_bfd_state_vals[] = {
+	{
+		.subpath = "interval",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_interval_get,
+	},
+	{
+		.subpath = "init_wait",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_init_wait_get,
+	},
+	{
+		.subpath = "desired_min_tx",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_bfd_state_desired_min_tx_get,
+	},
+	{
+		.subpath = "required_min_rx",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_bfd_state_required_min_rx_get,
+	},
+	{
+		.subpath = "detect_mult",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_bfd_state_detect_mult_get,
+	},
+	{
+		.subpath = "respond",
+		.type = TEAMD_STATE_ITEM_TYPE_BOOL,
+		.getter = lw_bfd_state_respond_get,
+	},
+	{
+		.subpath = "remote.desired_min_tx",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_bfd_state_remote_desired_min_tx_get,
+	},
+	{
+		.subpath = "remote.required_min_rx",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_bfd_state_remote_required_min_rx_get,
+	},
+	{
+		.subpath = "remote.detect_mult",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_bfd_state_remote_detect_mult_get,
+	},
+	{
+		.subpath = "missed",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_missed_get,
+	},
+	{
+		.subpath = "batch",
+		.type = TEAMD_STATE_ITEM_TYPE_BOOL,
+		.getter = lw_psr_state_batch_get,
+	},
+	{
+		.subpath = "tx_probes",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_tx_probes_get,
+	},
+	{
+		.subpath = "tx_syscalls",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_tx_syscalls_get,
+	},
+	{
+		.subpath = "rx_frames",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_rx_frames_get,
+	},
+	{
+		.subpath = "rx_syscalls",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_rx_syscalls_get,
+	},
+	{
+		.subpath = "rtt_last",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_rtt_last_get,
+	},
+	{
+		.subpath = "rtt_ewma",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_rtt_ewma_get,
+	},
+	{
+		.subpath = "rtt_min",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_rtt_min_get,
+	},
+	{
+		.subpath = "rtt_max",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_rtt_max_get,
+	},
+	{
+		.subpath = "rtt_histogram",
+		.type = TEAMD_STATE_ITEM_TYPE_STRING,
+		.getter = lw_psr_state_rtt_histogram_get,
+	},
+};
+
+const struct teamd_link_watch teamd_link_watch_bfd_echo = {
+	.name			= "bfd_echo",
+	.state_vg		= {
+		.vals		= lw_bfd_state_vals,
+		.vals_count	= ARRAY_SIZE(lw_bfd_state_vals),
+	},
+	.port_priv = {
+		.init		= lw_bfd_port_added,
+		.fini		= lw_psr_port_removed,
+		.priv_size	= sizeof(struct lw_bfd_port_priv),
+	},
+};
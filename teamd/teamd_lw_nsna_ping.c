@@ -50,6 +50,12 @@ static char *str_sockaddr_in6(struct sockaddr_in6 *sin6)
 			      buf, sizeof(buf));
 }
 
+struct ns_packet {
+	struct nd_neighbor_solicit	nsh;
+	struct nd_opt_hdr		opt;
+	unsigned char			hwaddr[ETH_ALEN];
+};
+
 struct lw_nsnap_port_priv {
 	union {
 		struct lw_common_port_priv common;
@@ -57,6 +63,9 @@ struct lw_nsnap_port_priv {
 	} start; /* must be first */
 	int tx_sock;
 	struct sockaddr_in6 dst;
+	/* prebuilt solicitation, valid while start.psr.frame_valid is set */
+	struct sockaddr_in6 sendto_addr;
+	struct ns_packet nsp;
 };
 
 static struct lw_nsnap_port_priv *
@@ -189,42 +198,57 @@ static void compute_multi_in6_addr(struct in6_addr *addr)
 	addr->s6_addr32[3] |= htonl(0xFF000000);
 }
 
-struct ns_packet {
-	struct nd_neighbor_solicit	nsh;
-	struct nd_opt_hdr		opt;
-	unsigned char			hwaddr[ETH_ALEN];
-};
-
-static int lw_nsnap_send(struct lw_psr_port_priv *psr_ppriv)
+static int lw_nsnap_frame_build(struct lw_psr_port_priv *psr_ppriv)
 {
 	struct lw_nsnap_port_priv *nsnap_ppriv = lw_nsnap_ppriv_get(psr_ppriv);
-	int err;
+	struct ns_packet *nsp = &nsnap_ppriv->nsp;
 	struct sockaddr_ll ll_my;
-	struct sockaddr_in6 sendto_addr;
-	struct ns_packet nsp;
+	int err;
 
 	err = teamd_getsockname_hwaddr(psr_ppriv->sock, &ll_my,
-				       sizeof(nsp.hwaddr));
+				       sizeof(nsp->hwaddr));
 	if (err)
 		return err;
 
-	memset(&nsp, 0, sizeof(nsp));
+	memset(nsp, 0, sizeof(*nsp));
 
 	/* setup ICMP6 header */
-	nsp.nsh.nd_ns_type = ND_NEIGHBOR_SOLICIT;
-	nsp.nsh.nd_ns_cksum = 0; /* kernel computes this */
-	nsp.nsh.nd_ns_target = nsnap_ppriv->dst.sin6_addr;
-	nsp.opt.nd_opt_type = ND_OPT_SOURCE_LINKADDR;
-	nsp.opt.nd_opt_len = 1; /* 8 bytes */
-	memcpy(nsp.hwaddr, ll_my.sll_addr, sizeof(nsp.hwaddr));
-
-	sendto_addr = nsnap_ppriv->dst;
-	compute_multi_in6_addr(&sendto_addr.sin6_addr);
-	sendto_addr.sin6_scope_id = psr_ppriv->common.tdport->ifindex;
-	err = teamd_sendto(nsnap_ppriv->tx_sock, &nsp, sizeof(nsp), 0,
-			   (struct sockaddr *) &sendto_addr,
-			   sizeof(sendto_addr));
-	return err;
+	nsp->nsh.nd_ns_type = ND_NEIGHBOR_SOLICIT;
+	nsp->nsh.nd_ns_cksum = 0; /* kernel computes this */
+	nsp->nsh.nd_ns_target = nsnap_ppriv->dst.sin6_addr;
+	nsp->opt.nd_opt_type = ND_OPT_SOURCE_LINKADDR;
+	nsp->opt.nd_opt_len = 1; /* 8 bytes */
+	memcpy(nsp->hwaddr, ll_my.sll_addr, sizeof(nsp->hwaddr));
+
+	nsnap_ppriv->sendto_addr = nsnap_ppriv->dst;
+	compute_multi_in6_addr(&nsnap_ppriv->sendto_addr.sin6_addr);
+	nsnap_ppriv->sendto_addr.sin6_scope_id =
+		psr_ppriv->common.tdport->ifindex;
+
+	psr_ppriv->frame_valid = true;
+	return 0;
+}
+
+static int lw_nsnap_frame_get(struct lw_psr_port_priv *psr_ppriv,
+			      unsigned int index, struct lw_psr_frame *frame)
+{
+	struct lw_nsnap_port_priv *nsnap_ppriv = lw_nsnap_ppriv_get(psr_ppriv);
+	int err;
+
+	frame->len = 0;
+	if (index)
+		return 0;
+	if (!psr_ppriv->frame_valid) {
+		err = lw_nsnap_frame_build(psr_ppriv);
+		if (err)
+			return err;
+	}
+	frame->sock = nsnap_ppriv->tx_sock;
+	frame->buf = &nsnap_ppriv->nsp;
+	frame->len = sizeof(nsnap_ppriv->nsp);
+	frame->addr = (struct sockaddr *) &nsnap_ppriv->sendto_addr;
+	frame->addrlen = sizeof(nsnap_ppriv->sendto_addr);
+	return 0;
 }
 
 struct na_packet {
@@ -234,43 +258,53 @@ struct na_packet {
 	unsigned char			hwaddr[ETH_ALEN];
 };
 
-static int lw_nsnap_receive(struct lw_psr_port_priv *psr_ppriv)
+static int lw_nsnap_receive(struct lw_psr_port_priv *psr_ppriv,
+			    const void *buf, size_t len,
+			    const struct sockaddr_ll *from)
 {
 	struct lw_nsnap_port_priv *nsnap_ppriv = lw_nsnap_ppriv_get(psr_ppriv);
-	struct na_packet nap;
-	struct sockaddr_ll ll_from;
-	int err;
+	const struct na_packet *nap = buf;
 
-	err = teamd_recvfrom(psr_ppriv->sock, &nap, sizeof(nap), 0,
-			     (struct sockaddr *) &ll_from, sizeof(ll_from));
-	if (err <= 0)
-		return err;
+	if (len < sizeof(*nap))
+		return 0;
 
 	/* check IPV6 header */
-	if (nap.ip6h.ip6_vfc != 0x60 /* IPV6 */ ||
-	    nap.ip6h.ip6_plen != htons(sizeof(nap) - sizeof(nap.ip6h)) ||
-	    nap.ip6h.ip6_nxt != IPPROTO_ICMPV6 ||
-	    nap.ip6h.ip6_hlim != 255 /* Do not route */ ||
-	    memcmp(&nap.ip6h.ip6_src, &nsnap_ppriv->dst.sin6_addr,
+	if (nap->ip6h.ip6_vfc != 0x60 /* IPV6 */ ||
+	    nap->ip6h.ip6_plen != htons(sizeof(*nap) - sizeof(nap->ip6h)) ||
+	    nap->ip6h.ip6_nxt != IPPROTO_ICMPV6 ||
+	    nap->ip6h.ip6_hlim != 255 /* Do not route */ ||
+	    memcmp(&nap->ip6h.ip6_src, &nsnap_ppriv->dst.sin6_addr,
 		   sizeof(struct in6_addr)))
 		return 0;
 
 	/* check ICMP6 header */
-	if (nap.nah.nd_na_type != ND_NEIGHBOR_ADVERT ||
-	    nap.opt.nd_opt_type != ND_OPT_TARGET_LINKADDR ||
-	    nap.opt.nd_opt_len != 1 /* 8 bytes */)
+	if (nap->nah.nd_na_type != ND_NEIGHBOR_ADVERT ||
+	    nap->opt.nd_opt_type != ND_OPT_TARGET_LINKADDR ||
+	    nap->opt.nd_opt_len != 1 /* 8 bytes */)
 		return 0;
 
-	psr_ppriv->reply_received = true;
+	lw_psr_reply_received(psr_ppriv);
 	return 0;
 }
 
+static bool lw_nsnap_probe_match(struct lw_psr_port_priv *psr_ppriv1,
+				 struct lw_psr_port_priv *psr_ppriv2)
+{
+	struct lw_nsnap_port_priv *nsnap_ppriv1 = lw_nsnap_ppriv_get(psr_ppriv1);
+	struct lw_nsnap_port_priv *nsnap_ppriv2 = lw_nsnap_ppriv_get(psr_ppriv2);
+
+	return !memcmp(&nsnap_ppriv1->dst.sin6_addr,
+		       &nsnap_ppriv2->dst.sin6_addr, sizeof(struct in6_addr));
+}
+
 static const struct lw_psr_ops lw_psr_ops_nsnap = {
 	.sock_open		= lw_nsnap_sock_open,
 	.sock_close		= lw_nsnap_sock_close,
 	.load_options		= lw_nsnap_load_options,
-	.send			= lw_nsnap_send,
 	.receive		= lw_nsnap_receive,
+	.frame_get		= lw_nsnap_frame_get,
+	.tx_sock_open		= icmp6_sock_open,
+	.probe_match		= lw_nsnap_probe_match,
 };
 
 static int lw_nsnap_port_added(struct teamd_context *ctx,
@@ -321,6 +355,76 @@ static const struct teamd_state_val lw_nsnap_state_vals[] = {
 		.type = TEAMD_STATE_ITEM_TYPE_INT,
 		.getter = lw_psr_state_missed_get,
 	},
+	{
+		.subpath = "batch",
+		.type = TEAMD_STATE_ITEM_TYPE_BOOL,
+		.getter = lw_psr_state_batch_get,
+	},
+	{
+		.subpath = "current_interval",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_current_interval_get,
+	},
+	{
+		.subpath = "interval_mode",
+		.type = TEAMD_STATE_ITEM_TYPE_STRING,
+		.getter = lw_psr_state_interval_mode_get,
+	},
+	{
+		.subpath = "phys_port_share",
+		.type = TEAMD_STATE_ITEM_TYPE_BOOL,
+		.getter = lw_psr_state_phys_port_share_get,
+	},
+	{
+		.subpath = "phys_port_leader",
+		.type = TEAMD_STATE_ITEM_TYPE_STRING,
+		.getter = lw_psr_state_phys_port_leader_get,
+	},
+	{
+		.subpath = "tx_probes",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_tx_probes_get,
+	},
+	{
+		.subpath = "tx_syscalls",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_tx_syscalls_get,
+	},
+	{
+		.subpath = "rx_frames",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_rx_frames_get,
+	},
+	{
+		.subpath = "rx_syscalls",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_rx_syscalls_get,
+	},
+	{
+		.subpath = "rtt_last",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_rtt_last_get,
+	},
+	{
+		.subpath = "rtt_ewma",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_rtt_ewma_get,
+	},
+	{
+		.subpath = "rtt_min",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_rtt_min_get,
+	},
+	{
+		.subpath = "rtt_max",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lw_psr_state_rtt_max_get,
+	},
+	{
+		.subpath = "rtt_histogram",
+		.type = TEAMD_STATE_ITEM_TYPE_STRING,
+		.getter = lw_psr_state_rtt_histogram_get,
+	},
 };
 
 const struct teamd_link_watch teamd_link_watch_nsnap = {
@@ -18,10 +18,18 @@
  *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
 #include <private/misc.h>
 #include "teamd.h"
 #include "teamd_link_watch.h"
 #include "teamd_config.h"
+#include "teamd_phys_port_check.h"
 
 /*
  * Generic periodic send/receive link watch "template"
@@ -29,20 +37,28 @@
 
 static const struct timespec lw_psr_default_init_wait = { 0, 1 };
 #define LW_PSR_DEFAULT_MISSED_MAX 3
+#define LW_PSR_DEFAULT_FAST_INTERVAL 100
+#define LW_PSR_DEFAULT_RECOVER_COUNT 3
 
-#define LW_PERIODIC_CB_NAME "lw_periodic"
-static int lw_psr_callback_periodic(struct teamd_context *ctx, int events, void *priv)
+static int lw_psr_periodic_check(struct lw_psr_port_priv *psr_ppriv)
 {
-	struct lw_common_port_priv *common_ppriv = priv;
-	struct lw_psr_port_priv *psr_ppriv = priv;
+	struct lw_common_port_priv *common_ppriv = &psr_ppriv->common;
 	struct teamd_port *tdport = common_ppriv->tdport;
-	bool link_up = common_ppriv->link_up;
+	struct lw_psr_port_priv *follower;
+	bool link_up = common_ppriv->raw_link_up;
+	bool replied;
 	int err;
 
-	if (psr_ppriv->reply_received) {
+	if (psr_ppriv->ops->reply_check)
+		replied = psr_ppriv->ops->reply_check(psr_ppriv);
+	else
+		replied = psr_ppriv->reply_received;
+	if (replied) {
 		link_up = true;
 		psr_ppriv->missed = 0;
 	} else {
+		/* Measured rtt says nothing about a path which does not reply */
+		common_ppriv->rtt_us = 0;
 		psr_ppriv->missed++;
 		if (psr_ppriv->missed > psr_ppriv->missed_max && link_up) {
 			teamd_log_dbg("%s: Missed %u replies (max %u).",
@@ -51,21 +67,448 @@ static int lw_psr_callback_periodic(struct teamd_context *ctx, int events, void
 			link_up = false;
 		}
 	}
-	err = teamd_link_watch_check_link_up(ctx, tdport,
+	err = teamd_link_watch_check_link_up(common_ppriv->ctx, tdport,
 					     common_ppriv, link_up);
 	if (err)
 		return err;
 	psr_ppriv->reply_received = false;
 
-	return psr_ppriv->ops->send(psr_ppriv);
+	/*
+	 * Followers are looked for among ports of this team only. Ports are
+	 * usually added right after each other, so the first check is late
+	 * enough to tell the sharing will not happen.
+	 */
+	if (psr_ppriv->phys_share && !psr_ppriv->phys_share_checked) {
+		psr_ppriv->phys_share_checked = true;
+		if (list_empty(&psr_ppriv->follower_list))
+			teamd_log_warn("%s: No other port of this team uses the same physical port with equal link watch options, \"phys_port_share\" has no effect.",
+				       tdport->ifname);
+	}
+
+	/* Result of the leader stands for its followers as well */
+	list_for_each_node_entry(follower, &psr_ppriv->follower_list,
+				 phys_list) {
+		follower->missed = psr_ppriv->missed;
+		follower->common.rtt_us = common_ppriv->rtt_us;
+		err = teamd_link_watch_check_link_up(follower->common.ctx,
+						     follower->common.tdport,
+						     &follower->common,
+						     link_up);
+		if (err)
+			return err;
+	}
+	return 0;
+}
+
+/*
+ * Probe round trip time. Probe is timestamped when it is handed to kernel
+ * and the first reply after that closes the measurement.
+ */
+
+static void lw_psr_probe_sent(struct lw_psr_port_priv *psr_ppriv,
+			      const struct timespec *ts)
+{
+	psr_ppriv->rtt.tx_ts = *ts;
+	psr_ppriv->rtt.pending = true;
+}
+
+static void lw_psr_rtt_update(struct lw_psr_port_priv *psr_ppriv,
+			      unsigned int rtt)
+{
+	struct lw_common_port_priv *common_ppriv = &psr_ppriv->common;
+	unsigned int i;
+
+	psr_ppriv->rtt.last = rtt;
+	if (!psr_ppriv->rtt.min || rtt < psr_ppriv->rtt.min)
+		psr_ppriv->rtt.min = rtt;
+	if (rtt > psr_ppriv->rtt.max)
+		psr_ppriv->rtt.max = rtt;
+	/* Bucket i counts rtts lower than 32us << i, last one the rest */
+	for (i = 0; i < LW_PSR_RTT_HIST_SIZE - 1; i++)
+		if (rtt < (32U << i))
+			break;
+	psr_ppriv->rtt.hist[i]++;
+	/* EWMA with weight of 1/8 for the new sample, same as TCP srtt */
+	if (!common_ppriv->rtt_us)
+		common_ppriv->rtt_us = rtt;
+	else
+		common_ppriv->rtt_us = ((uint64_t) common_ppriv->rtt_us * 7 +
+					rtt) / 8;
+	if (!common_ppriv->rtt_us)
+		common_ppriv->rtt_us = 1;
 }
 
+void lw_psr_reply_received(struct lw_psr_port_priv *psr_ppriv)
+{
+	struct timespec now;
+	int64_t rtt;
+
+	psr_ppriv->reply_received = true;
+	if (!psr_ppriv->rtt.pending)
+		return;
+	psr_ppriv->rtt.pending = false;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	rtt = (int64_t) (now.tv_sec - psr_ppriv->rtt.tx_ts.tv_sec) * 1000000 +
+	      (now.tv_nsec - psr_ppriv->rtt.tx_ts.tv_nsec) / 1000;
+	if (rtt < 1)
+		rtt = 1;
+	else if (rtt > UINT_MAX)
+		rtt = UINT_MAX;
+	lw_psr_rtt_update(psr_ppriv, rtt);
+}
+
+/* Frame is not copied, it stays unchanged until it is sent */
+static void lw_psr_msg_fill(struct mmsghdr *msg, struct iovec *iov,
+			    const struct lw_psr_frame *frame)
+{
+	iov->iov_base = (void *) frame->buf;
+	iov->iov_len = frame->len;
+	memset(msg, 0, sizeof(*msg));
+	msg->msg_hdr.msg_name = (void *) frame->addr;
+	msg->msg_hdr.msg_namelen = frame->addrlen;
+	msg->msg_hdr.msg_iov = iov;
+	msg->msg_hdr.msg_iovlen = 1;
+}
+
+static struct timespec *
+lw_psr_current_interval(struct lw_psr_port_priv *psr_ppriv)
+{
+	if (psr_ppriv->adaptive.fast)
+		return &psr_ppriv->adaptive.fast_interval;
+	return &psr_ppriv->interval;
+}
+
+#define LW_PERIODIC_CB_NAME "lw_periodic"
+
+/*
+ * Adaptive interval. Port is probed by the slow interval while replies come.
+ * Once a reply is missed, it is probed by the fast interval until replies
+ * come recover_count intervals in a row. Once more than missed_max replies
+ * are missed, link is down and there is nothing to detect fast anymore, so
+ * the slow interval is used until a reply comes. Then the fast one is used
+ * again until the link proves stable.
+ */
+static int lw_psr_adaptive_update(struct teamd_context *ctx,
+				  struct lw_psr_port_priv *psr_ppriv,
+				  bool replied)
+{
+	struct timespec *interval;
+	bool fast = psr_ppriv->adaptive.fast;
+
+	if (!replied) {
+		psr_ppriv->adaptive.down =
+			psr_ppriv->missed > psr_ppriv->missed_max;
+		fast = !psr_ppriv->adaptive.down;
+	} else if (psr_ppriv->adaptive.down) {
+		psr_ppriv->adaptive.down = false;
+		fast = true;
+	} else if (fast &&
+		   ++psr_ppriv->adaptive.replied >=
+		   psr_ppriv->adaptive.recover_count) {
+		fast = false;
+	}
+	if (fast == psr_ppriv->adaptive.fast)
+		return 0;
+
+	psr_ppriv->adaptive.fast = fast;
+	psr_ppriv->adaptive.replied = 0;
+	interval = lw_psr_current_interval(psr_ppriv);
+	teamd_log_dbg("%s: Probing by %s interval %d ms.",
+		      psr_ppriv->common.tdport->ifname, fast ? "fast" : "slow",
+		      timespec_to_ms(interval));
+	return teamd_loop_callback_timer_set(ctx, LW_PERIODIC_CB_NAME,
+					     psr_ppriv, interval, interval);
+}
+
+static int lw_psr_callback_periodic(struct teamd_context *ctx, int events, void *priv)
+{
+	struct lw_psr_port_priv *psr_ppriv = priv;
+	struct lw_psr_frame frame;
+	struct iovec iov[LW_PSR_FRAMES_MAX];
+	struct mmsghdr msg[LW_PSR_FRAMES_MAX];
+	struct timespec now;
+	unsigned int count;
+	int sock = -1;
+	int err;
+
+	err = lw_psr_periodic_check(psr_ppriv);
+	if (err)
+		return err;
+	if (psr_ppriv->adaptive.enabled) {
+		err = lw_psr_adaptive_update(ctx, psr_ppriv,
+					     !psr_ppriv->missed);
+		if (err)
+			return err;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (!psr_ppriv->ops->frame_get) {
+		lw_psr_probe_sent(psr_ppriv, &now);
+		return psr_ppriv->ops->send(psr_ppriv);
+	}
+
+	/* All frames of the port go out by a single syscall */
+	for (count = 0; count < LW_PSR_FRAMES_MAX; count++) {
+		err = psr_ppriv->ops->frame_get(psr_ppriv, count, &frame);
+		if (err)
+			return err;
+		if (!frame.len)
+			break;
+		sock = frame.sock;
+		lw_psr_msg_fill(&msg[count], &iov[count], &frame);
+	}
+	if (!count)
+		return 0;
+	lw_psr_probe_sent(psr_ppriv, &now);
+	psr_ppriv->stats.tx_probes += count;
+	return teamd_sendmmsg(sock, msg, count, 0,
+			      &psr_ppriv->stats.tx_syscalls);
+}
+
+#define LW_PSR_RX_BATCH_MAX 16
+#define LW_PSR_RX_FRAME_MAX 128
+
 #define LW_SOCKET_CB_NAME "lw_socket"
 static int lw_psr_callback_socket(struct teamd_context *ctx, int events, void *priv)
 {
 	struct lw_psr_port_priv *psr_ppriv = priv;
+	unsigned char buf[LW_PSR_RX_BATCH_MAX][LW_PSR_RX_FRAME_MAX];
+	struct sockaddr_ll addr[LW_PSR_RX_BATCH_MAX];
+	struct iovec iov[LW_PSR_RX_BATCH_MAX];
+	struct mmsghdr msg[LW_PSR_RX_BATCH_MAX];
+	int count;
+	int err;
+	int i;
+
+	/* Drain the socket, replies might have piled up. */
+	do {
+		memset(msg, 0, sizeof(msg));
+		for (i = 0; i < LW_PSR_RX_BATCH_MAX; i++) {
+			iov[i].iov_base = buf[i];
+			iov[i].iov_len = sizeof(buf[i]);
+			msg[i].msg_hdr.msg_name = &addr[i];
+			msg[i].msg_hdr.msg_namelen = sizeof(addr[i]);
+			msg[i].msg_hdr.msg_iov = &iov[i];
+			msg[i].msg_hdr.msg_iovlen = 1;
+		}
+		count = teamd_recvmmsg(psr_ppriv->sock, msg,
+				       LW_PSR_RX_BATCH_MAX, MSG_DONTWAIT);
+		if (count < 0)
+			return count;
+		psr_ppriv->stats.rx_syscalls++;
+		psr_ppriv->stats.rx_frames += count;
+		for (i = 0; i < count; i++) {
+			err = psr_ppriv->ops->receive(psr_ppriv, buf[i],
+						      msg[i].msg_len, &addr[i]);
+			if (err)
+				return err;
+		}
+	} while (count == LW_PSR_RX_BATCH_MAX);
+	return 0;
+}
+
+/*
+ * Batched send. Ports using the same link watch with the same interval are
+ * put into a group. Probes of all ports of a group are sent by a single
+ * sendmmsg() call on shared ticks of the group.
+ */
+
+#define LW_PSR_TX_BATCH_MAX 64
+
+struct lw_psr_group {
+	struct list_item list;
+	struct teamd_context *ctx;
+	const struct lw_psr_ops *ops;
+	struct timespec interval;
+	int tx_sock;
+	struct list_item port_list;
+};
+
+#define LW_GROUP_CB_NAME "lw_group"
+static int lw_psr_callback_group(struct teamd_context *ctx, int events,
+				 void *priv)
+{
+	struct lw_psr_group *group = priv;
+	struct lw_psr_port_priv *psr_ppriv;
+	struct lw_psr_port_priv *first = NULL;
+	struct lw_psr_frame frame;
+	struct iovec iov[LW_PSR_TX_BATCH_MAX];
+	struct mmsghdr msg[LW_PSR_TX_BATCH_MAX];
+	struct timespec now;
+	unsigned int count = 0;
+	unsigned int i;
+	int err;
+
+	/* Single timestamp is used for the whole group tick */
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	list_for_each_node_entry(psr_ppriv, &group->port_list, group_list) {
+		/* Failure of one port must not stop probing of the others */
+		err = lw_psr_periodic_check(psr_ppriv);
+		if (err) {
+			teamd_log_err("%s: Periodic check failed.",
+				      psr_ppriv->common.tdport->ifname);
+			continue;
+		}
+		for (i = 0; i < LW_PSR_FRAMES_MAX; i++) {
+			err = group->ops->frame_get(psr_ppriv, i, &frame);
+			if (err) {
+				teamd_log_err("%s: Failed to get probe frame.",
+					      psr_ppriv->common.tdport->ifname);
+				break;
+			}
+			if (!frame.len)
+				break;
+			lw_psr_msg_fill(&msg[count], &iov[count], &frame);
+			lw_psr_probe_sent(psr_ppriv, &now);
+			psr_ppriv->stats.tx_probes++;
+			/* Syscalls are accounted to the first port of the batch */
+			if (!first)
+				first = psr_ppriv;
+			if (++count == LW_PSR_TX_BATCH_MAX) {
+				err = teamd_sendmmsg(group->tx_sock, msg, count,
+						     0, &first->stats.tx_syscalls);
+				if (err)
+					return err;
+				count = 0;
+				first = NULL;
+			}
+		}
+	}
+	if (!count)
+		return 0;
+	return teamd_sendmmsg(group->tx_sock, msg, count, 0,
+			      &first->stats.tx_syscalls);
+}
+
+static struct lw_psr_group *lw_psr_group_find(struct teamd_context *ctx,
+					      struct lw_psr_port_priv *psr_ppriv)
+{
+	struct lw_psr_group *group;
+
+	list_for_each_node_entry(group, &ctx->lw_psr_group_list, list) {
+		if (group->ops == psr_ppriv->ops &&
+		    !memcmp(&group->interval, &psr_ppriv->interval,
+			    sizeof(group->interval)))
+			return group;
+	}
+	return NULL;
+}
+
+static int lw_psr_group_create(struct teamd_context *ctx,
+			       struct lw_psr_port_priv *psr_ppriv,
+			       struct lw_psr_group **p_group)
+{
+	struct lw_psr_group *group;
+	int err;
+
+	group = myzalloc(sizeof(*group));
+	if (!group)
+		return -ENOMEM;
+	group->ctx = ctx;
+	group->ops = psr_ppriv->ops;
+	group->interval = psr_ppriv->interval;
+	list_init(&group->port_list);
+
+	err = group->ops->tx_sock_open(&group->tx_sock);
+	if (err) {
+		teamd_log_err("Failed to create group socket.");
+		goto free_group;
+	}
+
+	err = teamd_loop_callback_timer_add_set(ctx, LW_GROUP_CB_NAME, group,
+						lw_psr_callback_group,
+						&group->interval,
+						&psr_ppriv->init_wait);
+	if (err) {
+		teamd_log_err("Failed add group callback timer");
+		goto close_sock;
+	}
+	teamd_loop_callback_enable(ctx, LW_GROUP_CB_NAME, group);
+	list_add_tail(&ctx->lw_psr_group_list, &group->list);
+	*p_group = group;
+	return 0;
+
+close_sock:
+	close(group->tx_sock);
+free_group:
+	free(group);
+	return err;
+}
 
-	return psr_ppriv->ops->receive(psr_ppriv);
+static void lw_psr_group_destroy(struct lw_psr_group *group)
+{
+	list_del(&group->list);
+	teamd_loop_callback_del(group->ctx, LW_GROUP_CB_NAME, group);
+	close(group->tx_sock);
+	free(group);
+}
+
+static int lw_psr_group_join(struct teamd_context *ctx,
+			     struct lw_psr_port_priv *psr_ppriv)
+{
+	struct lw_psr_group *group;
+	int err;
+
+	group = lw_psr_group_find(ctx, psr_ppriv);
+	if (!group) {
+		err = lw_psr_group_create(ctx, psr_ppriv, &group);
+		if (err)
+			return err;
+	}
+	list_add_tail(&group->port_list, &psr_ppriv->group_list);
+	psr_ppriv->group = group;
+	return 0;
+}
+
+static void lw_psr_group_leave(struct lw_psr_port_priv *psr_ppriv)
+{
+	struct lw_psr_group *group = psr_ppriv->group;
+
+	list_del(&psr_ppriv->group_list);
+	psr_ppriv->group = NULL;
+	if (list_empty(&group->port_list))
+		lw_psr_group_destroy(group);
+}
+
+static int lw_psr_load_adaptive(struct teamd_context *ctx,
+				struct lw_psr_port_priv *psr_ppriv)
+{
+	struct teamd_config_path_cookie *cpcookie = psr_ppriv->common.cpcookie;
+	int err;
+	int tmp;
+
+	psr_ppriv->adaptive.enabled = teamd_config_path_exists(ctx, "@.adaptive",
+								cpcookie);
+	if (!psr_ppriv->adaptive.enabled)
+		return 0;
+	if (psr_ppriv->batch) {
+		teamd_log_err("\"adaptive\" can not be used together with \"batch\".");
+		return -EINVAL;
+	}
+
+	err = teamd_config_int_get(ctx, &tmp, "@.adaptive.fast_interval",
+				   cpcookie);
+	if (err)
+		tmp = LW_PSR_DEFAULT_FAST_INTERVAL;
+	if (tmp <= 0 || tmp >= timespec_to_ms(&psr_ppriv->interval)) {
+		teamd_log_err("\"adaptive.fast_interval\" must be positive number lower than \"interval\".");
+		return -EINVAL;
+	}
+	teamd_log_dbg("adaptive.fast_interval \"%d\".", tmp);
+	ms_to_timespec(&psr_ppriv->adaptive.fast_interval, tmp);
+
+	err = teamd_config_int_get(ctx, &tmp, "@.adaptive.recover_count",
+				   cpcookie);
+	if (err)
+		tmp = LW_PSR_DEFAULT_RECOVER_COUNT;
+	if (tmp <= 0) {
+		teamd_log_err("\"adaptive.recover_count\" must be positive number.");
+		return -EINVAL;
+	}
+	teamd_log_dbg("adaptive.recover_count \"%d\".", tmp);
+	psr_ppriv->adaptive.recover_count = tmp;
+	psr_ppriv->adaptive.fast = false;
+	psr_ppriv->adaptive.replied = 0;
+	return 0;
 }
 
 static int lw_psr_load_options(struct teamd_context *ctx,
@@ -104,9 +547,49 @@ static int lw_psr_load_options(struct teamd_context *ctx,
 	teamd_log_dbg("missed_max \"%d\".", tmp);
 	psr_ppriv->missed_max = tmp;
 
+	err = teamd_config_bool_get(ctx, &psr_ppriv->batch, "@.batch",
+				    cpcookie);
+	if (err)
+		psr_ppriv->batch = false;
+	if (psr_ppriv->batch &&
+	    (!psr_ppriv->ops->frame_get || !psr_ppriv->ops->tx_sock_open)) {
+		teamd_log_err("\"batch\" is not supported by this link-watch.");
+		return -EINVAL;
+	}
+	teamd_log_dbg("batch \"%d\".", psr_ppriv->batch);
+
+	err = lw_psr_load_adaptive(ctx, psr_ppriv);
+	if (err)
+		return err;
+
+	err = teamd_config_bool_get(ctx, &psr_ppriv->phys_share,
+				    "@.phys_port_share", cpcookie);
+	if (err)
+		psr_ppriv->phys_share = false;
+	if (psr_ppriv->phys_share && !psr_ppriv->ops->probe_match) {
+		teamd_log_err("\"phys_port_share\" is not supported by this link-watch.");
+		return -EINVAL;
+	}
+	teamd_log_dbg("phys_port_share \"%d\".", psr_ppriv->phys_share);
+
+	return 0;
+}
+
+static int lw_psr_event_watch_port_hwaddr_changed(struct teamd_context *ctx,
+						  struct teamd_port *tdport,
+						  void *priv)
+{
+	struct lw_psr_port_priv *psr_ppriv = priv;
+
+	if (psr_ppriv->common.tdport == tdport)
+		psr_ppriv->frame_valid = false;
 	return 0;
 }
 
+static const struct teamd_event_watch_ops lw_psr_port_watch_ops = {
+	.port_hwaddr_changed = lw_psr_event_watch_port_hwaddr_changed,
+};
+
 struct lw_psr_port_priv *
 lw_psr_ppriv_get(struct lw_common_port_priv *common_ppriv)
 {
@@ -114,6 +597,144 @@ lw_psr_ppriv_get(struct lw_common_port_priv *common_ppriv)
 }
 
 
+static int lw_psr_periodic_add(struct teamd_context *ctx,
+			       struct lw_psr_port_priv *psr_ppriv)
+{
+	int err;
+
+	if (psr_ppriv->batch)
+		return lw_psr_group_join(ctx, psr_ppriv);
+	err = teamd_loop_callback_timer_add_set(ctx, LW_PERIODIC_CB_NAME,
+						psr_ppriv,
+						lw_psr_callback_periodic,
+						&psr_ppriv->interval,
+						&psr_ppriv->init_wait);
+	if (err)
+		return err;
+	teamd_loop_callback_enable(ctx, LW_PERIODIC_CB_NAME, psr_ppriv);
+	return 0;
+}
+
+static void lw_psr_periodic_del(struct teamd_context *ctx,
+				struct lw_psr_port_priv *psr_ppriv)
+{
+	if (psr_ppriv->batch)
+		lw_psr_group_leave(psr_ppriv);
+	else
+		teamd_loop_callback_del(ctx, LW_PERIODIC_CB_NAME, psr_ppriv);
+}
+
+/*
+ * Shared probing. Ports using the same physical port and probing the same
+ * way are served by a single one of them, the leader. Only the leader
+ * sends probes and its result is fanned out to the rest, the followers.
+ * Leaders with phys_port_share set are listed in ctx->lw_psr_phys_list.
+ */
+
+static struct lw_psr_port_priv *
+lw_psr_phys_leader_find(struct teamd_context *ctx,
+			struct lw_psr_port_priv *psr_ppriv)
+{
+	struct lw_psr_port_priv *leader;
+
+	list_for_each_node_entry(leader, &ctx->lw_psr_phys_list, phys_list) {
+		if (leader->ops == psr_ppriv->ops &&
+		    !memcmp(&leader->interval, &psr_ppriv->interval,
+			    sizeof(leader->interval)) &&
+		    leader->missed_max == psr_ppriv->missed_max &&
+		    leader->adaptive.enabled == psr_ppriv->adaptive.enabled &&
+		    !memcmp(&leader->adaptive.fast_interval,
+			    &psr_ppriv->adaptive.fast_interval,
+			    sizeof(leader->adaptive.fast_interval)) &&
+		    leader->adaptive.recover_count ==
+		    psr_ppriv->adaptive.recover_count &&
+		    leader->ops->probe_match(leader, psr_ppriv) &&
+		    teamd_phys_port_same(leader->common.tdport,
+					 psr_ppriv->common.tdport))
+			return leader;
+	}
+	return NULL;
+}
+
+static int lw_psr_phys_attach(struct teamd_context *ctx,
+			      struct lw_psr_port_priv *psr_ppriv)
+{
+	struct lw_psr_port_priv *leader = NULL;
+	int err;
+
+	if (psr_ppriv->phys_share)
+		leader = lw_psr_phys_leader_find(ctx, psr_ppriv);
+	if (leader) {
+		teamd_log_dbg("%s: Probing is done by port %s.",
+			      psr_ppriv->common.tdport->ifname,
+			      leader->common.tdport->ifname);
+		psr_ppriv->leader = leader;
+		list_add_tail(&leader->follower_list, &psr_ppriv->phys_list);
+		return 0;
+	}
+
+	err = lw_psr_periodic_add(ctx, psr_ppriv);
+	if (err)
+		return err;
+	if (psr_ppriv->phys_share)
+		list_add_tail(&ctx->lw_psr_phys_list, &psr_ppriv->phys_list);
+	return 0;
+}
+
+static void lw_psr_phys_detach(struct teamd_context *ctx,
+			       struct lw_psr_port_priv *psr_ppriv)
+{
+	struct lw_psr_port_priv *follower;
+	struct lw_psr_port_priv *tmp;
+	int err;
+
+	if (psr_ppriv->leader) {
+		list_del(&psr_ppriv->phys_list);
+		psr_ppriv->leader = NULL;
+		return;
+	}
+
+	lw_psr_periodic_del(ctx, psr_ppriv);
+	if (!psr_ppriv->phys_share)
+		return;
+	list_del(&psr_ppriv->phys_list);
+
+	/* The first follower takes over, the rest follows it */
+	list_for_each_node_entry_safe(follower, tmp, &psr_ppriv->follower_list,
+				      phys_list) {
+		list_del(&follower->phys_list);
+		follower->leader = NULL;
+		err = lw_psr_phys_attach(ctx, follower);
+		if (err)
+			teamd_log_err("%s: Failed to take over probing.",
+				      follower->common.tdport->ifname);
+	}
+}
+
+/* Changes interval of running link watch, next probe is sent in interval */
+int lw_psr_interval_set(struct lw_psr_port_priv *psr_ppriv,
+			const struct timespec *interval)
+{
+	struct teamd_context *ctx = psr_ppriv->common.ctx;
+
+	if (!memcmp(&psr_ppriv->interval, interval, sizeof(*interval)))
+		return 0;
+	if (psr_ppriv->leader) {
+		/* Follower does not probe on its own */
+		psr_ppriv->interval = *interval;
+		return 0;
+	}
+	if (psr_ppriv->batch) {
+		lw_psr_group_leave(psr_ppriv);
+		psr_ppriv->interval = *interval;
+		return lw_psr_group_join(ctx, psr_ppriv);
+	}
+	psr_ppriv->interval = *interval;
+	return teamd_loop_callback_timer_set(ctx, LW_PERIODIC_CB_NAME,
+					     psr_ppriv, &psr_ppriv->interval,
+					     &psr_ppriv->interval);
+}
+
 int lw_psr_port_added(struct teamd_context *ctx, struct teamd_port *tdport,
 		      void *priv, void *creator_priv)
 {
@@ -138,20 +759,29 @@ int lw_psr_port_added(struct teamd_context *ctx, struct teamd_port *tdport,
 		return err;
 	}
 
-	err = teamd_loop_callback_fd_add(ctx, LW_SOCKET_CB_NAME, psr_ppriv,
-					 lw_psr_callback_socket,
-					 psr_ppriv->sock,
-					 TEAMD_LOOP_FD_EVENT_READ);
+	psr_ppriv->frame_valid = false;
+	err = teamd_event_watch_register(ctx, &lw_psr_port_watch_ops,
+					 psr_ppriv);
 	if (err) {
-		teamd_log_err("Failed add socket callback.");
+		teamd_log_err("Failed to register event watch.");
 		goto close_sock;
 	}
 
-	err = teamd_loop_callback_timer_add_set(ctx, LW_PERIODIC_CB_NAME,
-						psr_ppriv,
-						lw_psr_callback_periodic,
-						&psr_ppriv->interval,
-						&psr_ppriv->init_wait);
+	/* Link watch might receive replies by a socket shared among ports */
+	if (psr_ppriv->sock != -1) {
+		err = teamd_loop_callback_fd_add(ctx, LW_SOCKET_CB_NAME,
+						 psr_ppriv,
+						 lw_psr_callback_socket,
+						 psr_ppriv->sock,
+						 TEAMD_LOOP_FD_EVENT_READ);
+		if (err) {
+			teamd_log_err("Failed add socket callback.");
+			goto event_watch_unregister;
+		}
+	}
+
+	list_init(&psr_ppriv->follower_list);
+	err = lw_psr_phys_attach(ctx, psr_ppriv);
 	if (err) {
 		teamd_log_err("Failed add callback timer");
 		goto socket_callback_del;
@@ -161,17 +791,20 @@ int lw_psr_port_added(struct teamd_context *ctx, struct teamd_port *tdport,
 	if (err) {
 		teamd_log_err("%s: Failed to enable user linkup.",
 			      tdport->ifname);
-		goto periodic_callback_del;
+		goto periodic_del;
 	}
 
-	teamd_loop_callback_enable(ctx, LW_SOCKET_CB_NAME, psr_ppriv);
-	teamd_loop_callback_enable(ctx, LW_PERIODIC_CB_NAME, psr_ppriv);
+	if (psr_ppriv->sock != -1)
+		teamd_loop_callback_enable(ctx, LW_SOCKET_CB_NAME, psr_ppriv);
 	return 0;
 
-periodic_callback_del:
-	teamd_loop_callback_del(ctx, LW_PERIODIC_CB_NAME, psr_ppriv);
+periodic_del:
+	lw_psr_phys_detach(ctx, psr_ppriv);
 socket_callback_del:
-	teamd_loop_callback_del(ctx, LW_SOCKET_CB_NAME, psr_ppriv);
+	if (psr_ppriv->sock != -1)
+		teamd_loop_callback_del(ctx, LW_SOCKET_CB_NAME, psr_ppriv);
+event_watch_unregister:
+	teamd_event_watch_unregister(ctx, &lw_psr_port_watch_ops, psr_ppriv);
 close_sock:
 	psr_ppriv->ops->sock_close(psr_ppriv);
 	return err;
@@ -182,8 +815,10 @@ void lw_psr_port_removed(struct teamd_context *ctx, struct teamd_port *tdport,
 {
 	struct lw_psr_port_priv *psr_ppriv = priv;
 
-	teamd_loop_callback_del(ctx, LW_PERIODIC_CB_NAME, psr_ppriv);
-	teamd_loop_callback_del(ctx, LW_SOCKET_CB_NAME, psr_ppriv);
+	lw_psr_phys_detach(ctx, psr_ppriv);
+	if (psr_ppriv->sock != -1)
+		teamd_loop_callback_del(ctx, LW_SOCKET_CB_NAME, psr_ppriv);
+	teamd_event_watch_unregister(ctx, &lw_psr_port_watch_ops, psr_ppriv);
 	psr_ppriv->ops->sock_close(psr_ppriv);
 }
 
@@ -230,3 +865,177 @@ int lw_psr_state_missed_get(struct teamd_context *ctx,
 	gsc->data.int_val = psr_ppriv->missed;
 	return 0;
 }
+
+int lw_psr_state_batch_get(struct teamd_context *ctx,
+			   struct team_state_gsc *gsc,
+			   void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct lw_psr_port_priv *psr_ppriv = lw_psr_ppriv_get(common_ppriv);
+
+	gsc->data.bool_val = psr_ppriv->batch;
+	return 0;
+}
+
+int lw_psr_state_current_interval_get(struct teamd_context *ctx,
+				      struct team_state_gsc *gsc,
+				      void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct lw_psr_port_priv *psr_ppriv = lw_psr_ppriv_get(common_ppriv);
+
+	/* Follower is probed by its leader */
+	if (psr_ppriv->leader)
+		psr_ppriv = psr_ppriv->leader;
+	gsc->data.int_val = timespec_to_ms(lw_psr_current_interval(psr_ppriv));
+	return 0;
+}
+
+int lw_psr_state_interval_mode_get(struct teamd_context *ctx,
+				   struct team_state_gsc *gsc,
+				   void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct lw_psr_port_priv *psr_ppriv = lw_psr_ppriv_get(common_ppriv);
+
+	if (psr_ppriv->leader)
+		psr_ppriv = psr_ppriv->leader;
+	if (!psr_ppriv->adaptive.enabled)
+		gsc->data.str_val.ptr = "fixed";
+	else
+		gsc->data.str_val.ptr = psr_ppriv->adaptive.fast ? "fast" : "slow";
+	return 0;
+}
+
+int lw_psr_state_phys_port_share_get(struct teamd_context *ctx,
+				     struct team_state_gsc *gsc,
+				     void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct lw_psr_port_priv *psr_ppriv = lw_psr_ppriv_get(common_ppriv);
+
+	gsc->data.bool_val = psr_ppriv->phys_share;
+	return 0;
+}
+
+int lw_psr_state_phys_port_leader_get(struct teamd_context *ctx,
+				      struct team_state_gsc *gsc,
+				      void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct lw_psr_port_priv *psr_ppriv = lw_psr_ppriv_get(common_ppriv);
+	struct lw_psr_port_priv *leader = psr_ppriv->leader;
+
+	gsc->data.str_val.ptr = leader ? leader->common.tdport->ifname : "";
+	return 0;
+}
+
+int lw_psr_state_tx_probes_get(struct teamd_context *ctx,
+			       struct team_state_gsc *gsc,
+			       void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct lw_psr_port_priv *psr_ppriv = lw_psr_ppriv_get(common_ppriv);
+
+	gsc->data.int_val = psr_ppriv->stats.tx_probes;
+	return 0;
+}
+
+int lw_psr_state_tx_syscalls_get(struct teamd_context *ctx,
+				 struct team_state_gsc *gsc,
+				 void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct lw_psr_port_priv *psr_ppriv = lw_psr_ppriv_get(common_ppriv);
+
+	gsc->data.int_val = psr_ppriv->stats.tx_syscalls;
+	return 0;
+}
+
+int lw_psr_state_rx_frames_get(struct teamd_context *ctx,
+			       struct team_state_gsc *gsc,
+			       void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct lw_psr_port_priv *psr_ppriv = lw_psr_ppriv_get(common_ppriv);
+
+	gsc->data.int_val = psr_ppriv->stats.rx_frames;
+	return 0;
+}
+
+int lw_psr_state_rx_syscalls_get(struct teamd_context *ctx,
+				 struct team_state_gsc *gsc,
+				 void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct lw_psr_port_priv *psr_ppriv = lw_psr_ppriv_get(common_ppriv);
+
+	gsc->data.int_val = psr_ppriv->stats.rx_syscalls;
+	return 0;
+}
+
+int lw_psr_state_rtt_last_get(struct teamd_context *ctx,
+			      struct team_state_gsc *gsc,
+			      void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct lw_psr_port_priv *psr_ppriv = lw_psr_ppriv_get(common_ppriv);
+
+	gsc->data.int_val = psr_ppriv->rtt.last;
+	return 0;
+}
+
+int lw_psr_state_rtt_ewma_get(struct teamd_context *ctx,
+			      struct team_state_gsc *gsc,
+			      void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+
+	gsc->data.int_val = common_ppriv->rtt_us;
+	return 0;
+}
+
+int lw_psr_state_rtt_min_get(struct teamd_context *ctx,
+			     struct team_state_gsc *gsc,
+			     void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct lw_psr_port_priv *psr_ppriv = lw_psr_ppriv_get(common_ppriv);
+
+	gsc->data.int_val = psr_ppriv->rtt.min;
+	return 0;
+}
+
+int lw_psr_state_rtt_max_get(struct teamd_context *ctx,
+			     struct team_state_gsc *gsc,
+			     void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct lw_psr_port_priv *psr_ppriv = lw_psr_ppriv_get(common_ppriv);
+
+	gsc->data.int_val = psr_ppriv->rtt.max;
+	return 0;
+}
+
+#define LW_PSR_RTT_HIST_STR_LEN (LW_PSR_RTT_HIST_SIZE * 11)
+
+int lw_psr_state_rtt_histogram_get(struct teamd_context *ctx,
+				   struct team_state_gsc *gsc,
+				   void *priv)
+{
+	struct lw_common_port_priv *common_ppriv = priv;
+	struct lw_psr_port_priv *psr_ppriv = lw_psr_ppriv_get(common_ppriv);
+	char *str;
+	int len = 0;
+	int i;
+
+	str = malloc(LW_PSR_RTT_HIST_STR_LEN);
+	if (!str)
+		return -ENOMEM;
+	for (i = 0; i < LW_PSR_RTT_HIST_SIZE; i++)
+		len += snprintf(str + len, LW_PSR_RTT_HIST_STR_LEN - len,
+				i ? " %u" : "%u", psr_ppriv->rtt.hist[i]);
+	gsc->data.str_val.ptr = str;
+	gsc->data.str_val.free = true;
+	return 0;
+}
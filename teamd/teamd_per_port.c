@@ -32,15 +32,56 @@ struct port_priv_item {
 	struct list_item list;
 	const struct teamd_port_priv *pp;
 	void *creator_priv;
+	struct port_priv_item *creator_next; /* next item of the same creator */
 	long priv[0];
 };
 
+/*
+ * Each creator has a slot pointing to its newest priv item, items of the
+ * same creator are chained from there. That way lookup by creator does not
+ * need to walk privs of other creators.
+ */
+struct port_priv_slot {
+	void *creator_priv;
+	struct port_priv_item *first;
+};
+
 struct port_obj {
 	struct teamd_port port; /* must be first */
 	struct list_item list;
 	struct list_item priv_list;
+	struct port_priv_slot *slots;
+	unsigned int slot_count;
 };
 
+static struct port_priv_slot *port_priv_slot_get(struct port_obj *port_obj,
+						 void *creator_priv)
+{
+	unsigned int i;
+
+	for (i = 0; i < port_obj->slot_count; i++)
+		if (port_obj->slots[i].creator_priv == creator_priv)
+			return &port_obj->slots[i];
+	return NULL;
+}
+
+static struct port_priv_slot *port_priv_slot_add(struct port_obj *port_obj,
+						 void *creator_priv)
+{
+	struct port_priv_slot *slots;
+	struct port_priv_slot *slot;
+
+	slots = realloc(port_obj->slots,
+			(port_obj->slot_count + 1) * sizeof(*slots));
+	if (!slots)
+		return NULL;
+	port_obj->slots = slots;
+	slot = &slots[port_obj->slot_count++];
+	slot->creator_priv = creator_priv;
+	slot->first = NULL;
+	return slot;
+}
+
 #define _port(port_obj) (&(port_obj)->port)
 
 int teamd_port_priv_create_and_get(void **ppriv, struct teamd_port *tdport,
@@ -48,14 +89,24 @@ int teamd_port_priv_create_and_get(void **ppriv, struct teamd_port *tdport,
 				   void *creator_priv)
 {
 	struct port_priv_item *ppitem;
+	struct port_priv_slot *slot;
 	struct port_obj *port_obj;
 
+	port_obj = get_container(tdport, struct port_obj, port);
+	slot = port_priv_slot_get(port_obj, creator_priv);
+	if (!slot) {
+		slot = port_priv_slot_add(port_obj, creator_priv);
+		if (!slot)
+			return -ENOMEM;
+	}
 	ppitem = myzalloc(sizeof(*ppitem) + pp->priv_size);
 	if (!ppitem)
 		return -ENOMEM;
 	ppitem->pp = pp;
 	ppitem->creator_priv = creator_priv;
-	port_obj = get_container(tdport, struct port_obj, port);
+	/* Same order as in priv_list, newest first */
+	ppitem->creator_next = slot->first;
+	slot->first = ppitem;
 	list_add(&port_obj->priv_list, &ppitem->list);
 	if (ppriv)
 		*ppriv = ppitem->priv;
@@ -70,20 +121,19 @@ int teamd_port_priv_create(struct teamd_port *tdport,
 void *teamd_get_next_port_priv_by_creator(struct teamd_port *tdport,
 					  void *creator_priv, void *priv)
 {
-	struct port_priv_item *ppitem = NULL;
+	struct port_priv_item *ppitem;
+	struct port_priv_slot *slot;
 	struct port_obj *port_obj;
 
-	if (priv)
+	if (priv) {
 		ppitem = get_container(priv, struct port_priv_item, priv);
-	port_obj = get_container(tdport, struct port_obj, port);
-
-next_ppitem:
-	ppitem = list_get_next_node_entry(&port_obj->priv_list, ppitem, list);
-	if (!ppitem)
-		return NULL;
-	if (ppitem->creator_priv != creator_priv)
-		goto next_ppitem;
-	return ppitem->priv;
+		ppitem = ppitem->creator_next;
+	} else {
+		port_obj = get_container(tdport, struct port_obj, port);
+		slot = port_priv_slot_get(port_obj, creator_priv);
+		ppitem = slot ? slot->first : NULL;
+	}
+	return ppitem ? ppitem->priv : NULL;
 }
 
 void *teamd_get_first_port_priv_by_creator(struct teamd_port *tdport,
@@ -155,6 +205,7 @@ static struct port_obj *port_obj_alloc(struct teamd_context *ctx,
 	list_init(&port_obj->priv_list);
 	tdport = _port(port_obj);
 	tdport->ifindex = ifindex;
+	tdport->link_up = true; /* no link watch yet */
 	team_ifinfo = team_get_port_ifinfo(team_port);
 	tdport->ifname = team_get_ifinfo_ifname(team_ifinfo);
 	tdport->team_port = team_port;
@@ -165,6 +216,7 @@ static struct port_obj *port_obj_alloc(struct teamd_context *ctx,
 static void port_obj_free(struct port_obj *port_obj)
 {
 	port_priv_free_all(port_obj);
+	free(port_obj->slots);
 	free(port_obj);
 }
 
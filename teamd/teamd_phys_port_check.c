@@ -24,6 +24,7 @@
 #include <unistd.h>
 
 #include "teamd.h"
+#include "teamd_phys_port_check.h"
 
 struct pcie_addr {
 	uint16_t domain;
@@ -98,6 +99,18 @@ static bool teamd_phys_port_ifinfo_cmp(struct teamd_port *tdport1,
 	return false;
 }
 
+/* Tells if both ports use the same physical port */
+bool teamd_phys_port_same(struct teamd_port *tdport1,
+			  struct teamd_port *tdport2)
+{
+	/* Once all drivers implement ndo_get_phys_port_id() function,
+	 * teamd_phys_port_sriovsysfs_cmp() would not be needed to be
+	 * called here.
+	 */
+	return teamd_phys_port_ifinfo_cmp(tdport1, tdport2) ||
+	       teamd_phys_port_sriovsysfs_cmp(tdport1, tdport2);
+}
+
 static int teamd_phys_port_check_event_watch_port_added(struct teamd_context *ctx,
 							struct teamd_port *tdport,
 							void *priv)
@@ -107,12 +120,7 @@ static int teamd_phys_port_check_event_watch_port_added(struct teamd_context *ct
 	teamd_for_each_tdport(cur_tdport, ctx) {
 		if (cur_tdport == tdport)
 			continue;
-		/* Once all drivers implement ndo_get_phys_port_id() function,
-		 * teamd_phys_port_sriovsysfs_cmp() would not be needed to be
-		 * called here.
-		 */
-		if (teamd_phys_port_ifinfo_cmp(tdport, cur_tdport) ||
-		    teamd_phys_port_sriovsysfs_cmp(tdport, cur_tdport))
+		if (teamd_phys_port_same(tdport, cur_tdport))
 			teamd_log_warn("%s: device is using the same physical port as device %s. Note that teaming multiple devices which use the same physical port makes no sense.",
 				       tdport->ifname, cur_tdport->ifname);
 	}
@@ -24,5 +24,7 @@
 
 int teamd_phys_port_check_init(struct teamd_context *ctx);
 void teamd_phys_port_check_fini(struct teamd_context *ctx);
+bool teamd_phys_port_same(struct teamd_port *tdport1,
+			  struct teamd_port *tdport2);
 
 #endif /* _TEAMD_PHYS_PORT_CHECK_H_ */
@@ -25,7 +25,9 @@
 #include <sys/socket.h>
 #include <linux/netdevice.h>
 #include <limits.h>
+#include <time.h>
 #include <private/misc.h>
+#include <private/list.h>
 #include <team.h>
 
 #include "teamd.h"
@@ -47,15 +49,63 @@ struct ab_hwaddr_policy {
 			    struct teamd_port *tdport);
 };
 
+/*
+ * Failover tracing. Every stage of the switch from a failed active port to
+ * a new one is timestamped and the last failovers are kept in a ring.
+ */
+enum ab_failover_stage {
+	AB_FAILOVER_STAGE_DETECT, /* link watch noticed active port down */
+	AB_FAILOVER_STAGE_HANDLER, /* link watch handler processed it */
+	AB_FAILOVER_STAGE_CLEAR, /* old active port cleared */
+	AB_FAILOVER_STAGE_SET_ACTIVE, /* team_set_active_port() completed */
+	AB_FAILOVER_STAGE_HWADDR, /* hwaddr policy applied */
+	AB_FAILOVER_STAGE_COUNT,
+};
+
+#define AB_FAILOVER_RING_SIZE 16
+
+struct ab_failover {
+	unsigned int seq;
+	char from[IFNAMSIZ];
+	char to[IFNAMSIZ];
+	struct timespec ts[AB_FAILOVER_STAGE_COUNT];
+};
+
 struct ab {
 	uint32_t active_ifindex;
+	uint32_t prestaged_ifindex; /* standby port enabled ahead of time */
 	char active_orig_hwaddr[MAX_ADDR_LEN];
 	const struct ab_hwaddr_policy *hwaddr_policy;
+	bool fast_switch;
+#define AB_DFLT_FAST_SWITCH false
+	bool latency_aware;
+#define AB_DFLT_LATENCY_AWARE false
+	unsigned int latency_granularity; /* us */
+#define AB_DFLT_LATENCY_GRANULARITY 1000
+	unsigned int latency_preempt_count;
+#define AB_DFLT_LATENCY_PREEMPT_COUNT 3
+	uint32_t latency_ref_ifindex; /* active port of the last latency check */
 	struct teamd_workq link_watch_handler_workq;
+	struct list_item standby_list; /* ports ordered by rank, best first */
+	struct {
+		bool in_progress;
+		struct ab_failover cur;
+		struct ab_failover ring[AB_FAILOVER_RING_SIZE];
+		unsigned int count;
+	} failover;
 };
 
 struct ab_port {
 	struct teamd_port *tdport;
+	struct list_item list; /* node in ab->standby_list */
+	struct {
+		bool up;
+		int prio;
+		uint32_t speed;
+		uint8_t duplex;
+		uint32_t latency; /* in units of latency_granularity */
+	} rank;
+	unsigned int latency_better_count; /* consecutive checks */
 	struct {
 		bool sticky;
 #define		AB_DFLT_PORT_STICKY false
@@ -224,6 +274,74 @@ found:
 	return 0;
 }
 
+static void ab_failover_stamp(struct ab *ab, enum ab_failover_stage stage)
+{
+	if (ab->failover.in_progress)
+		clock_gettime(CLOCK_MONOTONIC, &ab->failover.cur.ts[stage]);
+}
+
+static void ab_failover_start(struct ab *ab, struct teamd_port *tdport,
+			      struct timespec *handler_ts)
+{
+	struct ab_failover *failover = &ab->failover.cur;
+
+	memset(failover, 0, sizeof(*failover));
+	strncpy(failover->from, tdport->ifname, sizeof(failover->from) - 1);
+	failover->ts[AB_FAILOVER_STAGE_DETECT] = tdport->link_changed_ts;
+	if (timespec_is_zero(&failover->ts[AB_FAILOVER_STAGE_DETECT]))
+		failover->ts[AB_FAILOVER_STAGE_DETECT] = *handler_ts;
+	failover->ts[AB_FAILOVER_STAGE_HANDLER] = *handler_ts;
+	ab->failover.in_progress = true;
+}
+
+/* Failover which did not end up with a new active port is not recorded */
+static void ab_failover_cancel(struct ab *ab)
+{
+	ab->failover.in_progress = false;
+}
+
+static long ab_failover_stage_us(struct ab_failover *failover,
+				 enum ab_failover_stage stage)
+{
+	return timespec_diff_us(&failover->ts[stage], &failover->ts[stage - 1]);
+}
+
+static long ab_failover_total_us(struct ab_failover *failover)
+{
+	return timespec_diff_us(&failover->ts[AB_FAILOVER_STAGE_COUNT - 1],
+				&failover->ts[AB_FAILOVER_STAGE_DETECT]);
+}
+
+static int ab_failover_state_register(struct teamd_context *ctx,
+				      struct ab *ab, unsigned int slot);
+
+/* Called once new active port is set */
+static void ab_failover_finish(struct teamd_context *ctx, struct ab *ab,
+			       struct teamd_port *tdport)
+{
+	struct ab_failover *failover;
+	unsigned int slot;
+	int err;
+
+	if (!ab->failover.in_progress)
+		return;
+	ab->failover.in_progress = false;
+	slot = ab->failover.count % AB_FAILOVER_RING_SIZE;
+	failover = &ab->failover.ring[slot];
+	*failover = ab->failover.cur;
+	failover->seq = ab->failover.count;
+	strncpy(failover->to, tdport->ifname, sizeof(failover->to) - 1);
+	if (ab->failover.count < AB_FAILOVER_RING_SIZE) {
+		err = ab_failover_state_register(ctx, ab, slot);
+		if (err)
+			teamd_log_warn("Failed to register failover state.");
+	}
+	ab->failover.count++;
+	teamd_log_dbg("Failover \"%s\" -> \"%s\" took %ld us.",
+		      failover->from, failover->to,
+		      ab_failover_total_us(failover));
+}
+
 static int ab_clear_active_port(struct teamd_context *ctx, struct ab *ab,
 				struct teamd_port *tdport)
 {
@@ -265,12 +383,15 @@ static int ab_set_active_port(struct teamd_context *ctx, struct ab *ab,
 			      tdport->ifname);
 		goto err_set_active_port;
 	}
+	ab_failover_stamp(ab, AB_FAILOVER_STAGE_SET_ACTIVE);
 	if (ab->hwaddr_policy->active_set) {
 		err =  ab->hwaddr_policy->active_set(ctx, ab, tdport);
 		if (err)
 			goto err_hwaddr_policy_active_set;
 	}
+	ab_failover_stamp(ab, AB_FAILOVER_STAGE_HWADDR);
 	ab->active_ifindex = tdport->ifindex;
+	ab_failover_finish(ctx, ab, tdport);
 	teamd_log_info("Changed active port to \"%s\".", tdport->ifname);
 	return 0;
 
@@ -280,36 +401,143 @@ err_hwaddr_policy_active_set:
 	return err;
 }
 
-struct ab_port_state_info {
-	struct teamd_port *tdport;
-	uint32_t speed;
-	uint8_t duplex;
-	int prio;
-};
+/* Returns true in case ab_port1 is strictly better than ab_port2 */
+static bool ab_port_better(struct ab_port *ab_port1, struct ab_port *ab_port2)
+{
+	if (ab_port1->rank.up != ab_port2->rank.up)
+		return ab_port1->rank.up;
+	if (ab_port1->rank.prio != ab_port2->rank.prio)
+		return ab_port1->rank.prio > ab_port2->rank.prio;
+	if (ab_port1->rank.latency != ab_port2->rank.latency)
+		return ab_port1->rank.latency < ab_port2->rank.latency;
+	if (ab_port1->rank.speed != ab_port2->rank.speed)
+		return ab_port1->rank.speed > ab_port2->rank.speed;
+	return ab_port1->rank.duplex > ab_port2->rank.duplex;
+}
 
-static void ab_best_port_check_set(struct teamd_context *ctx,
-				   struct ab_port_state_info *best,
-				   struct teamd_port *tdport)
+/*
+ * Returns true in case ab_port1 is better than ab_port2 only because of
+ * lower latency.
+ */
+static bool ab_port_latency_better(struct ab_port *ab_port1,
+				   struct ab_port *ab_port2)
 {
-	struct team_port *port = tdport->team_port;
-	uint32_t speed;
-	uint8_t duplex;
-	int prio;
+	return ab_port1->rank.up == ab_port2->rank.up &&
+	       ab_port1->rank.prio == ab_port2->rank.prio &&
+	       ab_port1->rank.latency < ab_port2->rank.latency;
+}
 
-	if (!teamd_link_watch_port_up(ctx, tdport) || best->tdport == tdport)
-		return;
+static void ab_standby_list_insert(struct ab *ab, struct ab_port *ab_port)
+{
+	struct ab_port *cur;
+
+	/* Keep the insertion order among equally ranked ports */
+	list_for_each_node_entry(cur, &ab->standby_list, list) {
+		if (ab_port_better(ab_port, cur)) {
+			list_add_tail(&cur->list, &ab_port->list);
+			return;
+		}
+	}
+	list_add_tail(&ab->standby_list, &ab_port->list);
+}
 
-	speed = team_get_port_speed(port);
-	duplex = team_get_port_duplex(port);
-	prio = teamd_port_prio(ctx, tdport);
+/*
+ * Probe round trip time of the port quantized by latency_granularity so
+ * small jitter does not reorder the ports. Ports without any measurement
+ * rank behind the measured ones.
+ */
+static uint32_t ab_port_latency(struct teamd_context *ctx, struct ab *ab,
+				struct teamd_port *tdport)
+{
+	unsigned int rtt;
+
+	if (!ab->latency_aware)
+		return 0;
+	rtt = teamd_link_watch_port_rtt(ctx, tdport);
+	if (!rtt)
+		return UINT32_MAX;
+	return rtt / ab->latency_granularity;
+}
+
+static void ab_port_rank_update(struct teamd_context *ctx, struct ab *ab,
+				struct ab_port *ab_port)
+{
+	struct teamd_port *tdport = ab_port->tdport;
+
+	list_del(&ab_port->list);
+	ab_port->rank.up = teamd_link_watch_port_up(ctx, tdport);
+	ab_port->rank.prio = teamd_port_prio(ctx, tdport);
+	ab_port->rank.speed = team_get_port_speed(tdport->team_port);
+	ab_port->rank.duplex = team_get_port_duplex(tdport->team_port);
+	ab_port->rank.latency = ab_port_latency(ctx, ab, tdport);
+	ab_standby_list_insert(ab, ab_port);
+}
+
+static void ab_tdport_rank_update(struct teamd_context *ctx, struct ab *ab,
+				  struct teamd_port *tdport)
+{
+	struct ab_port *ab_port = ab_port_get(ab, tdport);
+
+	/* Link watch events may come before the port priv is created */
+	if (ab_port)
+		ab_port_rank_update(ctx, ab, ab_port);
+}
+
+/*
+ * Returns the port to be promoted in case the active one fails. Ports
+ * which are down are at the tail of the list, so at most the active port
+ * needs to be skipped.
+ */
+static struct ab_port *ab_standby_port_get(struct ab *ab)
+{
+	struct ab_port *ab_port;
+
+	list_for_each_node_entry(ab_port, &ab->standby_list, list) {
+		if (ab_port->tdport->ifindex == ab->active_ifindex)
+			continue;
+		return ab_port->rank.up ? ab_port : NULL;
+	}
+	return NULL;
+}
+
+/*
+ * Fast switch. Disabling of the old active port, enabling of the new one
+ * and setting it active are done in a single netlink transaction so the
+ * switch costs one kernel round trip. Hwaddr policy is applied after that.
+ */
+static int ab_switch_active_port(struct teamd_context *ctx, struct ab *ab,
+				 struct teamd_port *active_tdport,
+				 struct teamd_port *tdport)
+{
+	uint32_t old_ifindex = 0;
+	int err;
 
-	if (!best->tdport || (prio > best->prio) || (speed > best->speed) ||
-	    (speed == best->speed && duplex > best->duplex)) {
-		best->tdport = tdport;
-		best->prio = prio;
-		best->speed = speed;
-		best->duplex = duplex;
+	if (active_tdport && teamd_port_present(ctx, active_tdport))
+		old_ifindex = active_tdport->ifindex;
+	ab->active_ifindex = 0;
+	err = team_switch_active_port(ctx->th, old_ifindex, tdport->ifindex);
+	if (err) {
+		teamd_log_err("%s: Failed to switch active port.",
+			      tdport->ifname);
+		return err;
+	}
+	ab->active_ifindex = tdport->ifindex;
+	ab_failover_stamp(ab, AB_FAILOVER_STAGE_CLEAR);
+	ab_failover_stamp(ab, AB_FAILOVER_STAGE_SET_ACTIVE);
+	if (old_ifindex && ab->hwaddr_policy->active_clear) {
+		err = ab->hwaddr_policy->active_clear(ctx, ab, active_tdport);
+		if (err)
+			return err;
 	}
+	if (ab->hwaddr_policy->active_set) {
+		err = ab->hwaddr_policy->active_set(ctx, ab, tdport);
+		if (err)
+			return err;
+	}
+	ab_failover_stamp(ab, AB_FAILOVER_STAGE_HWADDR);
+	ab_failover_finish(ctx, ab, tdport);
+	teamd_log_info("Changed active port to \"%s\".", tdport->ifname);
+	return 0;
 }
 
 static int ab_change_active_port(struct teamd_context *ctx, struct ab *ab,
@@ -318,10 +546,15 @@ static int ab_change_active_port(struct teamd_context *ctx, struct ab *ab,
 {
 	int err;
 
-	err = ab_clear_active_port(ctx, ab, active_tdport);
-	if (err && !TEAMD_ENOENT(err))
-		return err;
-	err = ab_set_active_port(ctx, ab, new_active_tdport);
+	if (ab->fast_switch) {
+		err = ab_switch_active_port(ctx, ab, active_tdport,
+					    new_active_tdport);
+	} else {
+		err = ab_clear_active_port(ctx, ab, active_tdport);
+		if (err && !TEAMD_ENOENT(err))
+			return err;
+		err = ab_set_active_port(ctx, ab, new_active_tdport);
+	}
 	if (err) {
 		if (TEAMD_ENOENT(err))
 			/* Queue another best port selection */
@@ -332,67 +565,126 @@ static int ab_change_active_port(struct teamd_context *ctx, struct ab *ab,
 	return 0;
 }
 
-static int ab_link_watch_handler(struct teamd_context *ctx, struct ab *ab)
+/*
+ * In fast switch mode the best standby port is kept enabled ahead of time
+ * so it is ready to take over. That is harmless as activebackup mode in
+ * kernel transmits and receives only on the active port.
+ */
+static int ab_standby_prestage(struct teamd_context *ctx, struct ab *ab)
 {
 	struct teamd_port *tdport;
-	struct teamd_port *active_tdport;
-	struct ab_port_state_info best;
+	struct ab_port *best;
+	uint32_t ifindex;
 	int err;
-	uint32_t active_ifindex;
 
-	memset(&best, 0, sizeof(best));
-	best.prio = INT_MIN;
+	if (!ab->fast_switch)
+		return 0;
+	best = ab_standby_port_get(ab);
+	ifindex = best ? best->tdport->ifindex : 0;
+	if (ifindex == ab->prestaged_ifindex)
+		return 0;
+
+	tdport = teamd_get_port(ctx, ab->prestaged_ifindex);
+	ab->prestaged_ifindex = 0;
+	if (tdport && tdport->ifindex != ab->active_ifindex &&
+	    teamd_port_present(ctx, tdport)) {
+		err = team_set_port_enabled(ctx->th, tdport->ifindex, false);
+		if (err && !TEAMD_ENOENT(err)) {
+			teamd_log_err("%s: Failed to disable standby port.",
+				      tdport->ifname);
+			return err;
+		}
+	}
+	if (!best)
+		return 0;
+	err = team_set_port_enabled(ctx->th, ifindex, true);
+	if (err) {
+		if (TEAMD_ENOENT(err))
+			return 0;
+		teamd_log_err("%s: Failed to enable standby port.",
+			      best->tdport->ifname);
+		return err;
+	}
+	ab->prestaged_ifindex = ifindex;
+	teamd_log_dbg("Prestaged standby port \"%s\".", best->tdport->ifname);
+	return 0;
+}
+
+static int __ab_link_watch_handler(struct teamd_context *ctx, struct ab *ab)
+{
+	struct teamd_port *active_tdport;
+	struct ab_port *best;
+	struct timespec now;
+	int err;
 
+	clock_gettime(CLOCK_MONOTONIC, &now);
 	active_tdport = teamd_get_port(ctx, ab->active_ifindex);
 	if (active_tdport) {
 		teamd_log_dbg("Current active port: \"%s\" (ifindex \"%d\", prio \"%d\").",
 			      active_tdport->ifname, active_tdport->ifindex,
-			      teamd_port_prio(ctx, active_tdport));
-
-		err = team_get_active_port(ctx->th, &active_ifindex);
-		if (err) {
-			teamd_log_err("Failed to get active port.");
-			return err;
-		}
+			      ab_port_get(ab, active_tdport)->rank.prio);
 
 		/*
-		 * When active port went down or it is other than currently set,
-		 * clear it and proceed as if none was set in the first place.
+		 * When active port went down, clear it and proceed as if
+		 * none was set in the first place.
 		 */
-		if (!teamd_link_watch_port_up(ctx, active_tdport) ||
-		    active_ifindex != active_tdport->ifindex) {
+		if (!teamd_link_watch_port_up(ctx, active_tdport)) {
+			ab_failover_start(ab, active_tdport, &now);
+			best = ab_standby_port_get(ab);
+			if (ab->fast_switch && best)
+				/* Old active port is cleared by the switch */
+				return ab_change_active_port(ctx, ab,
+							     active_tdport,
+							     best->tdport);
 			err = ab_clear_active_port(ctx, ab, active_tdport);
 			if (err)
 				return err;
+			ab_failover_stamp(ab, AB_FAILOVER_STAGE_CLEAR);
 			active_tdport = NULL;
 		}
 	}
 
 	/*
-	 * Find the best port amond all ports. Prefer the currently active
+	 * Standby list head is the best port. Prefer the currently active
 	 * port, if there's any. This is because other port might have the
 	 * same prio, speed and duplex. We do not want to change in that case
 	 */
-	if (active_tdport && teamd_port_present(ctx, active_tdport))
-		ab_best_port_check_set(ctx, &best, active_tdport);
-	teamd_for_each_tdport(tdport, ctx)
-		ab_best_port_check_set(ctx, &best, tdport);
+	best = ab_standby_port_get(ab);
+	if (!best || (active_tdport &&
+		      !ab_port_better(best, ab_port_get(ab, active_tdport))))
+		return 0;
 
-	if (!best.tdport || best.tdport == active_tdport)
+	/* Latency alone preempts only once it is lower for a while */
+	if (active_tdport &&
+	    ab_port_latency_better(best, ab_port_get(ab, active_tdport)) &&
+	    best->latency_better_count < ab->latency_preempt_count)
 		return 0;
 
 	teamd_log_dbg("Found best port: \"%s\" (ifindex \"%d\", prio \"%d\").",
-		      best.tdport->ifname, best.tdport->ifindex, best.prio);
+		      best->tdport->ifname, best->tdport->ifindex,
+		      best->rank.prio);
 
 	if (!active_tdport || !ab_is_port_sticky(ab, active_tdport)) {
 		err = ab_change_active_port(ctx, ab, active_tdport,
-					    best.tdport);
+					    best->tdport);
 		if (err)
 			return err;
 	}
 	return 0;
 }
 
+static int ab_link_watch_handler(struct teamd_context *ctx, struct ab *ab)
+{
+	int err;
+
+	err = __ab_link_watch_handler(ctx, ab);
+	/* No standby port to switch to or the switch failed */
+	ab_failover_cancel(ab);
+	if (err)
+		return err;
+	return ab_standby_prestage(ctx, ab);
+}
+
 static int ab_link_watch_handler_work(struct teamd_context *ctx,
 				      struct teamd_workq *workq)
 {
@@ -435,6 +727,7 @@ static int ab_port_added(struct teamd_context *ctx,
 	int err;
 
 	ab_port->tdport = tdport;
+	list_init(&ab_port->list);
 	err = ab_port_load_config(ctx, ab_port);
 	if (err) {
 		teamd_log_err("Failed to load port config.");
@@ -447,8 +740,12 @@ static int ab_port_added(struct teamd_context *ctx,
 		return TEAMD_ENOENT(err) ? 0 : err;
 	}
 
-	if (ab->hwaddr_policy->port_added)
-		return ab->hwaddr_policy->port_added(ctx, ab, tdport);
+	if (ab->hwaddr_policy->port_added) {
+		err = ab->hwaddr_policy->port_added(ctx, ab, tdport);
+		if (err)
+			return err;
+	}
+	ab_port_rank_update(ctx, ab, ab_port);
 	return 0;
 }
 
@@ -456,8 +753,15 @@ static void ab_port_removed(struct teamd_context *ctx,
 			    struct teamd_port *tdport,
 			    void *priv, void *creator_priv)
 {
+	struct ab_port *ab_port = priv;
 	struct ab *ab = creator_priv;
 
+	list_del(&ab_port->list);
+	/* Kernel unsets active port once it is removed */
+	if (ab->active_ifindex == tdport->ifindex)
+		ab->active_ifindex = 0;
+	if (ab->prestaged_ifindex == tdport->ifindex)
+		ab->prestaged_ifindex = 0;
 	ab_link_watch_handler(ctx, ab);
 }
 
@@ -475,31 +779,78 @@ static int ab_event_watch_port_added(struct teamd_context *ctx,
 	return teamd_port_priv_create(tdport, &ab_port_priv, ab);
 }
 
+static int ab_event_watch_port_changed(struct teamd_context *ctx,
+				       struct teamd_port *tdport, void *priv)
+{
+	struct ab *ab = priv;
+
+	/* Speed or duplex might have changed */
+	ab_tdport_rank_update(ctx, ab, tdport);
+	return 0;
+}
+
 static int ab_event_watch_port_link_changed(struct teamd_context *ctx,
 					    struct teamd_port *tdport,
 					    void *priv)
 {
-	return ab_link_watch_handler(ctx, priv);
+	struct ab *ab = priv;
+
+	ab_tdport_rank_update(ctx, ab, tdport);
+	return ab_link_watch_handler(ctx, ab);
 }
 
 static int ab_event_watch_prio_option_changed(struct teamd_context *ctx,
 					      struct team_option *option,
 					      void *priv)
 {
-	return ab_link_watch_handler(ctx, priv);
+	struct ab *ab = priv;
+	struct teamd_port *tdport;
+
+	tdport = teamd_get_port(ctx, team_get_option_port_ifindex(option));
+	if (tdport)
+		ab_tdport_rank_update(ctx, ab, tdport);
+	return ab_link_watch_handler(ctx, ab);
 }
 
 static const struct teamd_event_watch_ops ab_event_watch_ops = {
 	.hwaddr_changed = ab_event_watch_hwaddr_changed,
 	.port_added = ab_event_watch_port_added,
+	.port_changed = ab_event_watch_port_changed,
 	.port_link_changed = ab_event_watch_port_link_changed,
 	.option_changed = ab_event_watch_prio_option_changed,
 	.option_changed_match_name = "priority",
 };
 
+static int ab_event_watch_active_port_option_changed(struct teamd_context *ctx,
+						     struct team_option *option,
+						     void *priv)
+{
+	struct ab *ab = priv;
+	int err;
+
+	if (team_get_option_value_u32(option) == ab->active_ifindex)
+		return 0;
+
+	/*
+	 * Active port was changed from outside, clear it and proceed
+	 * as if none was set in the first place.
+	 */
+	err = ab_clear_active_port(ctx, ab,
+				   teamd_get_port(ctx, ab->active_ifindex));
+	if (err)
+		return err;
+	return ab_link_watch_handler(ctx, ab);
+}
+
+static const struct teamd_event_watch_ops ab_active_port_event_watch_ops = {
+	.option_changed = ab_event_watch_active_port_option_changed,
+	.option_changed_match_name = "activeport",
+};
+
 static int ab_load_config(struct teamd_context *ctx, struct ab *ab)
 {
 	int err;
+	int tmp;
 	const char *hwaddr_policy_name;
 
 	err = teamd_config_string_get(ctx, &hwaddr_policy_name, "$.runner.hwaddr_policy");
@@ -512,9 +863,109 @@ static int ab_load_config(struct teamd_context *ctx, struct ab *ab)
 		return err;
 	}
 	teamd_log_dbg("Using hwaddr_policy \"%s\".", ab->hwaddr_policy->name);
+
+	err = teamd_config_bool_get(ctx, &ab->fast_switch,
+				    "$.runner.fast_switch");
+	if (err)
+		ab->fast_switch = AB_DFLT_FAST_SWITCH;
+	teamd_log_dbg("Using fast_switch \"%d\".", ab->fast_switch);
+
+	err = teamd_config_bool_get(ctx, &ab->latency_aware,
+				    "$.runner.latency_aware");
+	if (err)
+		ab->latency_aware = AB_DFLT_LATENCY_AWARE;
+	teamd_log_dbg("Using latency_aware \"%d\".", ab->latency_aware);
+
+	err = teamd_config_int_get(ctx, &tmp, "$.runner.latency_granularity");
+	if (err) {
+		ab->latency_granularity = AB_DFLT_LATENCY_GRANULARITY;
+	} else if (tmp <= 0) {
+		teamd_log_err("\"latency_granularity\" must be positive number.");
+		return -EINVAL;
+	} else {
+		ab->latency_granularity = tmp;
+	}
+	teamd_log_dbg("Using latency_granularity \"%u\".",
+		      ab->latency_granularity);
+
+	err = teamd_config_int_get(ctx, &tmp, "$.runner.latency_preempt_count");
+	if (err) {
+		ab->latency_preempt_count = AB_DFLT_LATENCY_PREEMPT_COUNT;
+	} else if (tmp < 0) {
+		teamd_log_err("\"latency_preempt_count\" must not be negative number.");
+		return -EINVAL;
+	} else {
+		ab->latency_preempt_count = tmp;
+	}
+	teamd_log_dbg("Using latency_preempt_count \"%u\".",
+		      ab->latency_preempt_count);
+	return 0;
+}
+
+/*
+ * Probe rtt changes are not reported by events, so with latency awareness
+ * enabled ports are periodically re-ranked. Number of consecutive checks
+ * each port had lower latency than the active one is counted, so a single
+ * sample does not make the active port flap.
+ */
+#define AB_LATENCY_CB_NAME "ab_latency"
+#define AB_LATENCY_INTERVAL 1
+
+static int ab_callback_latency(struct teamd_context *ctx, int events,
+			       void *priv)
+{
+	struct ab *ab = priv;
+	struct teamd_port *tdport;
+	struct teamd_port *active_tdport;
+	struct ab_port *active_ab_port = NULL;
+	struct ab_port *ab_port;
+
+	teamd_for_each_tdport(tdport, ctx)
+		ab_tdport_rank_update(ctx, ab, tdport);
+
+	active_tdport = teamd_get_port(ctx, ab->active_ifindex);
+	if (active_tdport)
+		active_ab_port = ab_port_get(ab, active_tdport);
+	list_for_each_node_entry(ab_port, &ab->standby_list, list) {
+		/* Counting restarts when the active port changed */
+		if (ab->latency_ref_ifindex != ab->active_ifindex)
+			ab_port->latency_better_count = 0;
+		if (active_ab_port && ab_port != active_ab_port &&
+		    ab_port_latency_better(ab_port, active_ab_port))
+			ab_port->latency_better_count++;
+		else
+			ab_port->latency_better_count = 0;
+	}
+	ab->latency_ref_ifindex = ab->active_ifindex;
+	teamd_workq_schedule_work(ctx, &ab->link_watch_handler_workq);
 	return 0;
 }
 
+static int ab_latency_init(struct teamd_context *ctx, struct ab *ab)
+{
+	struct timespec interval = { AB_LATENCY_INTERVAL, 0 };
+	int err;
+
+	if (!ab->latency_aware)
+		return 0;
+	err = teamd_loop_callback_timer_add_set(ctx, AB_LATENCY_CB_NAME, ab,
+						ab_callback_latency,
+						&interval, &interval);
+	if (err) {
+		teamd_log_err("Failed to add latency timer.");
+		return err;
+	}
+	teamd_loop_callback_enable(ctx, AB_LATENCY_CB_NAME, ab);
+	return 0;
+}
+
+static void ab_latency_fini(struct teamd_context *ctx, struct ab *ab)
+{
+	if (!ab->latency_aware)
+		return;
+	teamd_loop_callback_del(ctx, AB_LATENCY_CB_NAME, ab);
+}
+
 static int ab_state_active_port_get(struct teamd_context *ctx,
 				    struct team_state_gsc *gsc,
 				    void *priv)
@@ -541,6 +992,7 @@ static int ab_active_port_set_work(struct teamd_context *ctx,
 	uint32_t ifindex;
 	struct teamd_port *tdport;
 	struct teamd_port *active_tdport;
+	int err;
 
 	info = get_container(workq, struct ab_active_port_set_info, workq);
 	ab = info->ab;
@@ -551,7 +1003,10 @@ static int ab_active_port_set_work(struct teamd_context *ctx,
 		/* Port disapeared in between, ignore */
 		return 0;
 	active_tdport = teamd_get_port(ctx, ab->active_ifindex);
-	return ab_change_active_port(ctx, ab, active_tdport, tdport);
+	err = ab_change_active_port(ctx, ab, active_tdport, tdport);
+	if (err)
+		return err;
+	return ab_standby_prestage(ctx, ab);
 }
 
 static int ab_state_active_port_set(struct teamd_context *ctx,
@@ -575,6 +1030,151 @@ static int ab_state_active_port_set(struct teamd_context *ctx,
 	return 0;
 }
 
+static int ab_failover_state_seq_get(struct teamd_context *ctx,
+				     struct team_state_gsc *gsc,
+				     void *priv)
+{
+	struct ab_failover *failover = priv;
+
+	gsc->data.int_val = failover->seq;
+	return 0;
+}
+
+static int ab_failover_state_from_get(struct teamd_context *ctx,
+				      struct team_state_gsc *gsc,
+				      void *priv)
+{
+	struct ab_failover *failover = priv;
+
+	gsc->data.str_val.ptr = failover->from;
+	return 0;
+}
+
+static int ab_failover_state_to_get(struct teamd_context *ctx,
+				    struct team_state_gsc *gsc,
+				    void *priv)
+{
+	struct ab_failover *failover = priv;
+
+	gsc->data.str_val.ptr = failover->to;
+	return 0;
+}
+
+static int ab_failover_state_total_get(struct teamd_context *ctx,
+				       struct team_state_gsc *gsc,
+				       void *priv)
+{
+	gsc->data.int_val = ab_failover_total_us(priv);
+	return 0;
+}
+
+static int ab_failover_state_handler_get(struct teamd_context *ctx,
+					 struct team_state_gsc *gsc,
+					 void *priv)
+{
+	gsc->data.int_val = ab_failover_stage_us(priv,
+						 AB_FAILOVER_STAGE_HANDLER);
+	return 0;
+}
+
+static int ab_failover_state_clear_get(struct teamd_context *ctx,
+				       struct team_state_gsc *gsc,
+				       void *priv)
+{
+	gsc->data.int_val = ab_failover_stage_us(priv,
+						 AB_FAILOVER_STAGE_CLEAR);
+	return 0;
+}
+
+static int ab_failover_state_set_active_get(struct teamd_context *ctx,
+					    struct team_state_gsc *gsc,
+					    void *priv)
+{
+	gsc->data.int_val = ab_failover_stage_us(priv,
+						 AB_FAILOVER_STAGE_SET_ACTIVE);
+	return 0;
+}
+
+static int ab_failover_state_hwaddr_get(struct teamd_context *ctx,
+					struct team_state_gsc *gsc,
+					void *priv)
+{
+	gsc->data.int_val = ab_failover_stage_us(priv,
+						 AB_FAILOVER_STAGE_HWADDR);
+	return 0;
+}
+
+static const struct teamd_state_val ab_failover_state_vals[] = {
+	{
+		.subpath = "seq",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = ab_failover_state_seq_get,
+	},
+	{
+		.subpath = "from",
+		.type = TEAMD_STATE_ITEM_TYPE_STRING,
+		.getter = ab_failover_state_from_get,
+	},
+	{
+		.subpath = "to",
+		.type = TEAMD_STATE_ITEM_TYPE_STRING,
+		.getter = ab_failover_state_to_get,
+	},
+	{
+		.subpath = "total_us",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = ab_failover_state_total_get,
+	},
+	{
+		.subpath = "handler_us",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = ab_failover_state_handler_get,
+	},
+	{
+		.subpath = "clear_us",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = ab_failover_state_clear_get,
+	},
+	{
+		.subpath = "set_active_us",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = ab_failover_state_set_active_get,
+	},
+	{
+		.subpath = "hwaddr_us",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = ab_failover_state_hwaddr_get,
+	},
+};
+
+static const struct teamd_state_val ab_failover_state_vg = {
+	.vals = ab_failover_state_vals,
+	.vals_count = ARRAY_SIZE(ab_failover_state_vals),
+};
+
+/*
+ * Ring slots are registered as they get used for the first time. Items are
+ * named by slot, the failover a slot holds changes as the ring wraps, its
+ * sequence number is exposed as "seq".
+ */
+static int ab_failover_state_register(struct teamd_context *ctx,
+				      struct ab *ab, unsigned int slot)
+{
+	return teamd_state_val_register_ex(ctx, &ab_failover_state_vg,
+					   &ab->failover.ring[slot], NULL,
+					   "runner.failovers.slot_%u", slot);
+}
+
+static void ab_failover_state_unregister(struct teamd_context *ctx,
+					 struct ab *ab)
+{
+	int i;
+
+	for (i = 0; i < AB_FAILOVER_RING_SIZE; i++)
+		teamd_state_val_unregister(ctx, &ab_failover_state_vg,
+					   &ab->failover.ring[i]);
+}
+
 static const struct teamd_state_val ab_state_vals[] = {
 	{
 		.subpath = "active_port",
@@ -614,20 +1214,34 @@ static int ab_init(struct teamd_context *ctx, void *priv)
 		teamd_log_err("Failed to load config values.");
 		return err;
 	}
+	list_init(&ab->standby_list);
 	err = teamd_event_watch_register(ctx, &ab_event_watch_ops, ab);
 	if (err) {
 		teamd_log_err("Failed to register event watch.");
 		return err;
 	}
+	err = teamd_event_watch_register(ctx, &ab_active_port_event_watch_ops,
+					 ab);
+	if (err) {
+		teamd_log_err("Failed to register active port event watch.");
+		goto event_watch_unregister;
+	}
 	err = teamd_state_val_register(ctx, &ab_state_vg, ab);
 	if (err) {
 		teamd_log_err("Failed to register state value group.");
-		goto event_watch_unregister;
+		goto active_port_event_watch_unregister;
 	}
 	teamd_workq_init_work(&ab->link_watch_handler_workq,
 			      ab_link_watch_handler_work);
+	err = ab_latency_init(ctx, ab);
+	if (err)
+		goto state_val_unregister;
 	return 0;
 
+state_val_unregister:
+	teamd_state_val_unregister(ctx, &ab_state_vg, ab);
+active_port_event_watch_unregister:
+	teamd_event_watch_unregister(ctx, &ab_active_port_event_watch_ops, ab);
 event_watch_unregister:
 	teamd_event_watch_unregister(ctx, &ab_event_watch_ops, ab);
 	return err;
@@ -637,7 +1251,10 @@ static void ab_fini(struct teamd_context *ctx, void *priv)
 {
 	struct ab *ab = priv;
 
+	ab_latency_fini(ctx, ab);
+	ab_failover_state_unregister(ctx, ab);
 	teamd_state_val_unregister(ctx, &ab_state_vg, ab);
+	teamd_event_watch_unregister(ctx, &ab_active_port_event_watch_ops, ab);
 	teamd_event_watch_unregister(ctx, &ab_event_watch_ops, ab);
 }
 
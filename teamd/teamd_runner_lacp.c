@@ -21,8 +21,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
 #include <limits.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <linux/if_ether.h>
 #include <sys/socket.h>
 #include <linux/netdevice.h>
@@ -127,9 +129,20 @@ static const char *lacp_agg_select_policy_names_list[] = {
 
 struct lacp_port;
 
+struct lacp_agg {
+	struct list_item list; /* node in lacp->agg_list */
+	struct lacp *lacp;
+	struct lacp_port *lead; /* leading port of aggregator */
+	struct list_item port_list;
+	unsigned int port_count;
+	uint32_t bandwidth;
+	unsigned int sticky_count;
+};
+
 struct lacp {
 	struct teamd_context *ctx;
-	struct lacp_port *selected_agg_lead; /* leading port of selected aggregator */
+	struct lacp_agg *selected_agg;
+	struct list_item agg_list;
 	bool carrier_up;
 	struct {
 		bool active;
@@ -142,7 +155,24 @@ struct lacp {
 #define		LACP_CFG_DFLT_MIN_PORTS 1
 		enum lacp_agg_select_policy agg_select_policy;
 #define		LACP_CFG_DFLT_AGG_SELECT_POLICY LACP_AGG_SELECT_LACP_PRIO
+		bool tx_batch_enabled;
+#define		LACP_CFG_DFLT_TX_BATCH_ENABLED false
+		int tx_batch_spread;
+#define		LACP_CFG_DFLT_TX_BATCH_SPREAD 4
+#define		LACP_TX_BATCH_SPREAD_MAX 100
+		bool rx_ring_enabled;
+#define		LACP_CFG_DFLT_RX_RING_ENABLED false
 	} cfg;
+	struct {
+		int sock; /* unbound socket used to send LACPDUs on all ports */
+		uint64_t tick;
+	} tx_batch;
+	struct {
+		int sock; /* unbound socket receiving LACPDUs of all ports */
+		void *map;
+		size_t map_size;
+		unsigned int block_index;
+	} rx_ring;
 	struct teamd_balancer *tb;
 };
 
@@ -168,10 +198,27 @@ struct lacp_port {
 	struct lacpdu_info actor;
 	struct lacpdu_info partner;
 	struct lacpdu_info __partner_last; /* last state before update */
+	struct lacpdu lacpdu; /* prebuilt frame, up to date if lacpdu_cached */
+	bool lacpdu_cached;
+	bool lacpdu_usable;
 	bool periodic_on;
-	struct lacp_port *agg_lead; /* leading port of aggregator.
-				     * NULL in case this port is not selected */
+	struct {
+		bool periodic_enabled;
+		int periodic_ms;
+		bool kick; /* periodic transmission restarted, send on next tick */
+		bool ntt; /* need to transmit, postponed by rate limit */
+		struct timespec last[3]; /* times of last transmissions */
+		unsigned int last_index;
+	} tx;
+	struct lacp_agg *agg; /* aggregator this port is member of.
+			       * NULL in case this port is not selected */
+	struct list_item agg_port_list; /* node in agg->port_list */
+	uint32_t agg_speed; /* speed accounted in agg->bandwidth */
 	enum lacp_port_state state;
+	struct {
+		struct timespec start; /* zero in case port is not coming up */
+		int distributing_ms; /* last measured time, -1 if none yet */
+	} bringup;
 	struct {
 		uint32_t speed;
 		uint8_t	duplex;
@@ -198,29 +245,35 @@ static struct lacp_port *lacp_port_get(struct lacp *lacp,
 	return teamd_get_first_port_priv_by_creator(tdport, lacp);
 }
 
-static uint32_t lacp_agg_id(struct lacp_port *agg_lead)
+/* Called whenever actor or partner info changes */
+static void lacp_port_lacpdu_invalidate(struct lacp_port *lacp_port)
+{
+	lacp_port->lacpdu_cached = false;
+}
+
+static uint32_t lacp_agg_id(struct lacp_agg *agg)
 {
-	return agg_lead ? agg_lead->tdport->ifindex : 0;
+	return agg ? agg->lead->tdport->ifindex : 0;
 }
 
-static bool lacp_agg_selected(struct lacp_port *agg_lead)
+static bool lacp_agg_selected(struct lacp_agg *agg)
 {
-	return agg_lead ? agg_lead == agg_lead->lacp->selected_agg_lead : false;
+	return agg ? agg == agg->lacp->selected_agg : false;
 }
 
 static uint32_t lacp_port_agg_id(struct lacp_port *lacp_port)
 {
-	return lacp_agg_id(lacp_port->agg_lead);
+	return lacp_agg_id(lacp_port->agg);
 }
 
 static uint32_t lacp_port_agg_selected(struct lacp_port *lacp_port)
 {
-	return lacp_agg_selected(lacp_port->agg_lead);
+	return lacp_agg_selected(lacp_port->agg);
 }
 
 static bool lacp_port_is_agg_lead(struct lacp_port *lacp_port)
 {
-	return lacp_port->agg_lead == lacp_port;
+	return lacp_port->agg && lacp_port->agg->lead == lacp_port;
 }
 
 static const char *lacp_get_agg_select_policy_name(struct lacp *lacp)
@@ -294,6 +347,32 @@ static int lacp_load_config(struct teamd_context *ctx, struct lacp *lacp)
 	}
 	teamd_log_dbg("Using agg_select_policy \"%s\".",
 		      lacp_get_agg_select_policy_name(lacp));
+
+	err = teamd_config_bool_get(ctx, &lacp->cfg.tx_batch_enabled,
+				    "$.runner.tx_batch.enabled");
+	if (err)
+		lacp->cfg.tx_batch_enabled = LACP_CFG_DFLT_TX_BATCH_ENABLED;
+	teamd_log_dbg("Using tx_batch.enabled \"%d\".",
+		      lacp->cfg.tx_batch_enabled);
+
+	err = teamd_config_int_get(ctx, &tmp, "$.runner.tx_batch.spread");
+	if (err) {
+		lacp->cfg.tx_batch_spread = LACP_CFG_DFLT_TX_BATCH_SPREAD;
+	} else if (tmp < 1 || tmp > LACP_TX_BATCH_SPREAD_MAX) {
+		teamd_log_err("\"tx_batch.spread\" value is out of its limits.");
+		return -EINVAL;
+	} else {
+		lacp->cfg.tx_batch_spread = tmp;
+	}
+	teamd_log_dbg("Using tx_batch.spread \"%d\".",
+		      lacp->cfg.tx_batch_spread);
+
+	err = teamd_config_bool_get(ctx, &lacp->cfg.rx_ring_enabled,
+				    "$.runner.rx_ring.enabled");
+	if (err)
+		lacp->cfg.rx_ring_enabled = LACP_CFG_DFLT_RX_RING_ENABLED;
+	teamd_log_dbg("Using rx_ring.enabled \"%d\".",
+		      lacp->cfg.rx_ring_enabled);
 	return 0;
 }
 
@@ -325,7 +404,7 @@ static bool lacp_port_unselectable_state(struct lacp_port *lacp_port)
 
 static bool lacp_port_selected(struct lacp_port *lacp_port)
 {
-	return lacp_port->agg_lead;
+	return lacp_port->agg;
 }
 
 static int lacp_port_should_be_enabled(struct lacp_port *lacp_port)
@@ -333,7 +412,7 @@ static int lacp_port_should_be_enabled(struct lacp_port *lacp_port)
 	struct lacp *lacp = lacp_port->lacp;
 
 	if (lacp_port_selected(lacp_port) &&
-	    lacp_port->agg_lead == lacp->selected_agg_lead)
+	    lacp_port->agg == lacp->selected_agg)
 		return true;
 	return false;
 }
@@ -343,16 +422,45 @@ static int lacp_port_should_be_disabled(struct lacp_port *lacp_port)
 	struct lacp *lacp = lacp_port->lacp;
 
 	if (!lacp_port_selected(lacp_port) ||
-	    lacp_port->agg_lead != lacp->selected_agg_lead)
+	    lacp_port->agg != lacp->selected_agg)
 		return true;
 	return false;
 }
 
+static void lacp_port_bringup_check(struct lacp_port *lacp_port)
+{
+	struct timespec now;
+
+	if (timespec_is_zero(&lacp_port->bringup.start) ||
+	    !lacp_port_should_be_enabled(lacp_port))
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	lacp_port->bringup.distributing_ms =
+		timespec_diff_ms(&now, &lacp_port->bringup.start);
+	memset(&lacp_port->bringup.start, 0, sizeof(lacp_port->bringup.start));
+	teamd_log_dbg("%s: Port reached distributing in %d ms.",
+		      lacp_port->tdport->ifname,
+		      lacp_port->bringup.distributing_ms);
+}
+
 static int lacp_port_update_enabled(struct lacp_port *lacp_port)
 {
-	return teamd_port_check_enable(lacp_port->ctx, lacp_port->tdport,
-				       lacp_port_should_be_enabled(lacp_port),
-				       lacp_port_should_be_disabled(lacp_port));
+	bool should_disable = lacp_port_should_be_disabled(lacp_port);
+	bool enabled;
+	int err;
+
+	lacp_port_bringup_check(lacp_port);
+	err = teamd_port_enabled(lacp_port->ctx, lacp_port->tdport, &enabled);
+	if (err)
+		return err;
+	err = teamd_port_check_enable(lacp_port->ctx, lacp_port->tdport,
+				      lacp_port_should_be_enabled(lacp_port),
+				      should_disable);
+	if (err || !enabled || !should_disable)
+		return err;
+	/* Move hashes of the port away right away, not at next rebalance */
+	return teamd_balancer_port_disabled(lacp_port->lacp->tb,
+					    lacp_port->tdport);
 }
 
 static bool lacp_ports_aggregable(struct lacp_port *lacp_port1,
@@ -367,25 +475,31 @@ static bool lacp_ports_aggregable(struct lacp_port *lacp_port1,
 	return true;
 }
 
+static struct lacp_port *lacp_agg_other_port(struct lacp_agg *agg,
+					     struct lacp_port *except_lacp_port)
+{
+	struct lacp_port *lacp_port;
+
+	list_for_each_node_entry(lacp_port, &agg->port_list, agg_port_list)
+		if (lacp_port != except_lacp_port)
+			return lacp_port;
+	return NULL;
+}
+
 static bool lacp_port_correct_aggregation(struct lacp_port *checked_lacp_port)
 {
-	struct teamd_port *tdport;
 	struct lacp_port *lacp_port;
 
-	/* Find first port in same aggregator and see if checked port is
+	/* Take any other port in same aggregator and see if checked port is
 	 * aggregable with that. That's enough because all of the ports
 	 * in aggregator besides the checked one are aggregable with each other.
 	 */
 
-	teamd_for_each_tdport(tdport, checked_lacp_port->ctx) {
-		lacp_port = lacp_port_get(checked_lacp_port->lacp, tdport);
-		if (!lacp_port_selected(lacp_port) ||
-		    lacp_port->agg_lead != checked_lacp_port->agg_lead ||
-		    lacp_port == checked_lacp_port)
-			continue;
-		return lacp_ports_aggregable(lacp_port, checked_lacp_port);
-	}
-	return true;
+	lacp_port = lacp_agg_other_port(checked_lacp_port->agg,
+					checked_lacp_port);
+	if (!lacp_port)
+		return true;
+	return lacp_ports_aggregable(lacp_port, checked_lacp_port);
 }
 
 static void get_lacp_port_prio_info(struct lacp_port *lacp_port,
@@ -480,192 +594,181 @@ static int lacp_update_carrier(struct lacp *lacp)
 	return lacp_set_carrier(lacp, false);
 }
 
-static uint32_t lacp_get_agg_bandwidth(struct lacp_port *agg_lead)
+static struct lacp_agg *lacp_get_best_agg_by_bandwidth(struct lacp *lacp)
 {
-	struct teamd_port *tdport;
-	struct lacp_port *lacp_port;
-	uint32_t speed = 0;
-
-	teamd_for_each_tdport(tdport, agg_lead->ctx) {
-		lacp_port = lacp_port_get(agg_lead->lacp, tdport);
-		if (lacp_port->agg_lead == agg_lead)
-			speed += team_get_port_speed(tdport->team_port);
-	}
-	return speed;
-}
-
-static struct lacp_port *lacp_get_best_agg_by_bandwidth(struct lacp *lacp)
-{
-	struct teamd_port *tdport;
-	struct lacp_port *lacp_port;
-	uint32_t speed;
+	struct lacp_agg *agg;
 	uint32_t best_speed = 0;
-	struct lacp_port *best_agg_lead = NULL;
+	struct lacp_agg *best_agg = NULL;
 
-	teamd_for_each_tdport(tdport, lacp->ctx) {
-		lacp_port = lacp_port_get(lacp, tdport);
-		if (!lacp_port_selected(lacp_port))
-			continue;
-		speed = lacp_get_agg_bandwidth(lacp_port->agg_lead);
-		if (speed > best_speed) {
-			best_speed = speed;
-			best_agg_lead = lacp_port->agg_lead;
+	list_for_each_node_entry(agg, &lacp->agg_list, list) {
+		if (agg->bandwidth > best_speed) {
+			best_speed = agg->bandwidth;
+			best_agg = agg;
 		}
 	}
-	return best_agg_lead;
-}
-
-static unsigned int lacp_get_agg_port_count(struct lacp_port *agg_lead)
-{
-	struct teamd_port *tdport;
-	struct lacp_port *lacp_port;
-	unsigned int port_count = 0;
-
-	teamd_for_each_tdport(tdport, agg_lead->ctx) {
-		lacp_port = lacp_port_get(agg_lead->lacp, tdport);
-		if (lacp_port->agg_lead == agg_lead)
-			port_count++;
-	}
-	return port_count;
+	return best_agg;
 }
 
-static struct lacp_port *lacp_get_best_agg_by_port_count(struct lacp *lacp)
+static struct lacp_agg *lacp_get_best_agg_by_port_count(struct lacp *lacp)
 {
-	struct teamd_port *tdport;
-	struct lacp_port *lacp_port;
-	unsigned int port_count;
+	struct lacp_agg *agg;
 	unsigned int best_port_count = 0;
-	struct lacp_port *best_agg_lead = NULL;
+	struct lacp_agg *best_agg = NULL;
 
-	teamd_for_each_tdport(tdport, lacp->ctx) {
-		lacp_port = lacp_port_get(lacp, tdport);
-		if (!lacp_port_selected(lacp_port))
-			continue;
-		port_count = lacp_get_agg_port_count(lacp_port->agg_lead);
-		if (port_count > best_port_count) {
-			best_port_count = port_count;
-			best_agg_lead = lacp_port->agg_lead;
+	list_for_each_node_entry(agg, &lacp->agg_list, list) {
+		if (agg->port_count > best_port_count) {
+			best_port_count = agg->port_count;
+			best_agg = agg;
 		}
 	}
-	return best_agg_lead;
+	return best_agg;
 }
 
-static struct lacp_port *lacp_get_best_agg_by_best_port(struct lacp *lacp)
+static struct lacp_agg *lacp_get_best_agg_by_best_port(struct lacp *lacp)
 {
-	struct teamd_port *tdport;
-	struct lacp_port *lacp_port;
-	struct lacp_port *best_agg_lead = NULL;
+	struct lacp_agg *agg;
+	struct lacp_agg *best_agg = NULL;
 
-	teamd_for_each_tdport(tdport, lacp->ctx) {
-		lacp_port = lacp_port_get(lacp, tdport);
-		if (!lacp_port_selected(lacp_port))
-			continue;
-		if (lacp_port_better(lacp_port->agg_lead, best_agg_lead))
-			best_agg_lead = lacp_port->agg_lead;
+	list_for_each_node_entry(agg, &lacp->agg_list, list) {
+		if (lacp_port_better(agg->lead,
+				     best_agg ? best_agg->lead : NULL))
+			best_agg = agg;
 	}
-	return best_agg_lead;
+	return best_agg;
 }
 
-static bool lacp_agg_sticky(struct lacp_port *agg_lead)
+static bool lacp_agg_sticky(struct lacp_agg *agg)
 {
-	struct teamd_port *tdport;
-	struct lacp_port *lacp_port;
-
-	teamd_for_each_tdport(tdport, agg_lead->ctx) {
-		lacp_port = lacp_port_get(agg_lead->lacp, tdport);
-		if (lacp_port->agg_lead == agg_lead &&
-		    lacp_port->cfg.sticky)
-			return true;
-	}
-	return false;
+	return agg->sticky_count;
 }
 
-static struct lacp_port *lacp_get_next_agg(struct lacp *lacp)
+static struct lacp_agg *lacp_get_next_agg(struct lacp *lacp)
 {
-	struct lacp_port *next_agg_lead = lacp->selected_agg_lead;
+	struct lacp_agg *next_agg = lacp->selected_agg;
 
 	switch (lacp->cfg.agg_select_policy) {
 	case LACP_AGG_SELECT_LACP_PRIO:
-		next_agg_lead = lacp_get_best_agg_by_best_port(lacp);
+		next_agg = lacp_get_best_agg_by_best_port(lacp);
 		break;
 	case LACP_AGG_SELECT_LACP_PRIO_STABLE:
-		if (!lacp->selected_agg_lead)
-			next_agg_lead = lacp_get_best_agg_by_best_port(lacp);
+		if (!lacp->selected_agg)
+			next_agg = lacp_get_best_agg_by_best_port(lacp);
 		break;
 	case LACP_AGG_SELECT_BANDWIDTH:
-		next_agg_lead = lacp_get_best_agg_by_bandwidth(lacp);
+		next_agg = lacp_get_best_agg_by_bandwidth(lacp);
 		break;
 	case LACP_AGG_SELECT_COUNT:
-		next_agg_lead = lacp_get_best_agg_by_port_count(lacp);
+		next_agg = lacp_get_best_agg_by_port_count(lacp);
 		break;
 	case LACP_AGG_SELECT_PORT_CONFIG:
-		if (!lacp->selected_agg_lead ||
-		    !lacp_agg_sticky(lacp->selected_agg_lead))
-			next_agg_lead = lacp_get_best_agg_by_best_port(lacp);
+		if (!lacp->selected_agg ||
+		    !lacp_agg_sticky(lacp->selected_agg))
+			next_agg = lacp_get_best_agg_by_best_port(lacp);
 		break;
 	}
-	return next_agg_lead;
+	return next_agg;
 }
 
-static struct lacp_port *lacp_get_agg_lead(struct lacp_port *for_lacp_port)
+/* Find existing aggregator the port can be aggregated into. */
+static struct lacp_agg *lacp_get_agg(struct lacp_port *for_lacp_port)
 {
 	struct lacp *lacp = for_lacp_port->lacp;
-	struct teamd_port *tdport;
+	struct lacp_agg *agg;
 	struct lacp_port *lacp_port;
 
-	teamd_for_each_tdport(tdport, lacp->ctx) {
-		lacp_port = lacp_port_get(lacp, tdport);
-		if (!lacp_port_selected(lacp_port) ||
-		    lacp_port == for_lacp_port)
-			continue;
-		if (lacp_ports_aggregable(lacp_port, for_lacp_port))
-			return lacp_port->agg_lead;
+	/* All ports in aggregator are aggregable with each other so it is
+	 * enough to check one of them.
+	 */
+	list_for_each_node_entry(agg, &lacp->agg_list, list) {
+		lacp_port = lacp_agg_other_port(agg, for_lacp_port);
+		if (lacp_port && lacp_ports_aggregable(lacp_port, for_lacp_port))
+			return agg;
 	}
-	/* If no suitable aggregator found, the port is self-lead. */
-	return for_lacp_port;
+	return NULL;
 }
 
-static void lacp_switch_agg_lead(struct lacp_port *agg_lead,
-				 struct lacp_port *new_agg_lead)
+static struct lacp_agg *lacp_agg_create(struct lacp *lacp)
 {
-	struct lacp *lacp = agg_lead->lacp;
-	struct teamd_port *tdport;
-	struct lacp_port *lacp_port;
+	struct lacp_agg *agg;
 
-	teamd_log_dbg("Renaming aggregator %u to %u",
-		      lacp_agg_id(agg_lead), lacp_agg_id(new_agg_lead));
-	if (lacp->selected_agg_lead == agg_lead)
-		lacp->selected_agg_lead = new_agg_lead;
-	teamd_for_each_tdport(tdport, lacp->ctx) {
-		lacp_port = lacp_port_get(lacp, tdport);
-		if (lacp_port->agg_lead == agg_lead)
-			lacp_port->agg_lead = new_agg_lead;
-	}
+	agg = myzalloc(sizeof(*agg));
+	if (!agg)
+		return NULL;
+	agg->lacp = lacp;
+	list_init(&agg->port_list);
+	list_add_tail(&lacp->agg_list, &agg->list);
+	return agg;
+}
+
+static void lacp_agg_destroy(struct lacp_agg *agg)
+{
+	struct lacp *lacp = agg->lacp;
+
+	if (lacp->selected_agg == agg)
+		lacp->selected_agg = NULL;
+	list_del(&agg->list);
+	free(agg);
+}
+
+static void lacp_agg_port_add(struct lacp_agg *agg,
+			      struct lacp_port *lacp_port)
+{
+	lacp_port->agg = agg;
+	lacp_port->agg_speed = team_get_port_speed(lacp_port->tdport->team_port);
+	list_add_tail(&agg->port_list, &lacp_port->agg_port_list);
+	agg->port_count++;
+	agg->bandwidth += lacp_port->agg_speed;
+	if (lacp_port->cfg.sticky)
+		agg->sticky_count++;
 }
 
-static void lacp_port_agg_select(struct lacp_port *lacp_port)
+static void lacp_agg_port_del(struct lacp_agg *agg,
+			      struct lacp_port *lacp_port)
 {
-	struct lacp_port *agg_lead;
+	list_del(&lacp_port->agg_port_list);
+	agg->port_count--;
+	agg->bandwidth -= lacp_port->agg_speed;
+	if (lacp_port->cfg.sticky)
+		agg->sticky_count--;
+	lacp_port->agg = NULL;
+}
+
+static void lacp_switch_agg_lead(struct lacp_agg *agg,
+				 struct lacp_port *new_agg_lead)
+{
+	teamd_log_dbg("Renaming aggregator %u to %u", lacp_agg_id(agg),
+		      new_agg_lead->tdport->ifindex);
+	agg->lead = new_agg_lead;
+}
+
+static int lacp_port_agg_select(struct lacp_port *lacp_port)
+{
+	struct lacp_agg *agg;
 
 	teamd_log_dbg("%s: Selecting LACP port", lacp_port->tdport->ifname);
-	agg_lead = lacp_get_agg_lead(lacp_port);
-	lacp_port->agg_lead = agg_lead;
-	if (lacp_port_better(lacp_port, agg_lead))
-		lacp_switch_agg_lead(agg_lead, lacp_port);
+	agg = lacp_get_agg(lacp_port);
+	if (!agg) {
+		/* If no suitable aggregator found, the port is self-lead. */
+		agg = lacp_agg_create(lacp_port->lacp);
+		if (!agg)
+			return -ENOMEM;
+		agg->lead = lacp_port;
+	}
+	lacp_agg_port_add(agg, lacp_port);
+	if (agg->lead != lacp_port && lacp_port_better(lacp_port, agg->lead))
+		lacp_switch_agg_lead(agg, lacp_port);
 	teamd_log_dbg("%s: LACP port selected into aggregator %u",
 		      lacp_port->tdport->ifname, lacp_port_agg_id(lacp_port));
+	return 0;
 }
 
-static struct lacp_port *lacp_find_new_agg_lead(struct lacp_port *old_agg_lead)
+static struct lacp_port *lacp_find_new_agg_lead(struct lacp_agg *agg)
 {
-	struct teamd_port *tdport;
 	struct lacp_port *lacp_port;
 	struct lacp_port *new_agg_lead = NULL;
 
-	teamd_for_each_tdport(tdport, old_agg_lead->ctx) {
-		lacp_port = lacp_port_get(old_agg_lead->lacp, tdport);
-		if (lacp_port->agg_lead == old_agg_lead &&
-		    lacp_port_better(lacp_port, new_agg_lead))
+	list_for_each_node_entry(lacp_port, &agg->port_list, agg_port_list) {
+		if (lacp_port_better(lacp_port, new_agg_lead))
 			new_agg_lead = lacp_port;
 	}
 	return new_agg_lead;
@@ -673,23 +776,37 @@ static struct lacp_port *lacp_find_new_agg_lead(struct lacp_port *old_agg_lead)
 
 static void lacp_port_agg_unselect(struct lacp_port *lacp_port)
 {
-	struct lacp_port *agg_lead = lacp_port->agg_lead;
+	struct lacp_agg *agg = lacp_port->agg;
 
 	teamd_log_dbg("%s: Unselecting LACP port", lacp_port->tdport->ifname);
 	teamd_log_dbg("%s: LACP port unselected from aggregator %u",
 		      lacp_port->tdport->ifname, lacp_port_agg_id(lacp_port));
-	lacp_port->agg_lead = NULL;
-	if (lacp_port == agg_lead) {
-		/* In case currently unselected port is aggregator lead lead,
+	lacp_agg_port_del(agg, lacp_port);
+	if (!agg->port_count) {
+		lacp_agg_destroy(agg);
+	} else if (lacp_port == agg->lead) {
+		/* In case currently unselected port is aggregator lead,
 		 * find new one.
 		 */
-		struct lacp_port *new_agg_lead;
-
-		new_agg_lead = lacp_find_new_agg_lead(agg_lead);
-		lacp_switch_agg_lead(agg_lead, new_agg_lead);
+		lacp_switch_agg_lead(agg, lacp_find_new_agg_lead(agg));
 	}
 }
 
+/* Called when port speed might have changed to keep aggregator bandwidth
+ * in sync.
+ */
+static void lacp_port_agg_bandwidth_update(struct lacp_port *lacp_port,
+					   uint32_t speed)
+{
+	struct lacp_agg *agg = lacp_port->agg;
+
+	if (!agg || lacp_port->agg_speed == speed)
+		return;
+	agg->bandwidth -= lacp_port->agg_speed;
+	agg->bandwidth += speed;
+	lacp_port->agg_speed = speed;
+}
+
 static int lacp_ports_update_enabled(struct lacp *lacp)
 {
 	struct teamd_port *tdport;
@@ -706,16 +823,16 @@ static int lacp_ports_update_enabled(struct lacp *lacp)
 }
 
 static int lacp_selected_agg_update(struct lacp *lacp,
-				    struct lacp_port *next_agg_lead)
+				    struct lacp_agg *next_agg)
 {
 	int err;
 
-	if (!next_agg_lead)
-		next_agg_lead = lacp_get_next_agg(lacp);
-	if (lacp->selected_agg_lead != next_agg_lead)
+	if (!next_agg)
+		next_agg = lacp_get_next_agg(lacp);
+	if (lacp->selected_agg != next_agg)
 		teamd_log_dbg("Selecting aggregator %u",
-			      lacp_agg_id(next_agg_lead));
-	lacp->selected_agg_lead = next_agg_lead;
+			      lacp_agg_id(next_agg));
+	lacp->selected_agg = next_agg;
 
 	err = lacp_ports_update_enabled(lacp);
 	if (err)
@@ -732,12 +849,14 @@ static bool lacp_port_mergeable(struct lacp_port *lacp_port)
 	 * alone in aggragator and is aggregable with some other port.
 	 */
 	return lacp_port_is_agg_lead(lacp_port) &&
-	       lacp_get_agg_port_count(lacp_port) == 1 &&
-	       lacp_get_agg_lead(lacp_port) != lacp_port;
+	       lacp_port->agg->port_count == 1 &&
+	       lacp_get_agg(lacp_port);
 }
 
 static int lacp_port_agg_update(struct lacp_port *lacp_port)
 {
+	int err;
+
 	if (lacp_port_selected(lacp_port) &&
 	    (lacp_port_unselectable_state(lacp_port) ||
 	     !lacp_port_loopback_free(lacp_port) ||
@@ -747,8 +866,11 @@ static int lacp_port_agg_update(struct lacp_port *lacp_port)
 
 	if (!lacp_port_selected(lacp_port) &&
 	    (lacp_port_selectable_state(lacp_port) &&
-	     lacp_port_loopback_free(lacp_port)))
-		lacp_port_agg_select(lacp_port);
+	     lacp_port_loopback_free(lacp_port))) {
+		err = lacp_port_agg_select(lacp_port);
+		if (err)
+			return err;
+	}
 
 	return lacp_selected_agg_update(lacp_port->lacp, NULL);
 }
@@ -760,14 +882,17 @@ static int __slow_addr_add_del(struct lacp_port *lacp_port, bool add)
 	struct ifreq ifr;
 	struct sockaddr *sa;
 	char *devname = lacp_port->tdport->ifname;
+	int sock;
 	int ret;
 
+	sock = lacp_port->lacp->cfg.rx_ring_enabled ?
+	       lacp_port->lacp->rx_ring.sock : lacp_port->sock;
 	memset(&ifr, 0, sizeof(struct ifreq));
 	sa = (struct sockaddr *) &ifr.ifr_addr;
 	sa->sa_family = AF_UNSPEC;
 	memcpy(sa->sa_data, slow_addr, sizeof(slow_addr));
 	memcpy(ifr.ifr_name, devname, strlen(devname));
-	ret = ioctl(lacp_port->sock, add ? SIOCADDMULTI : SIOCDELMULTI, &ifr);
+	ret = ioctl(sock, add ? SIOCADDMULTI : SIOCDELMULTI, &ifr);
 	if (ret == -1) {
 		teamd_log_err("ioctl %s failed.",
 			      add ? "SIOCADDMULTI" : "SIOCDELMULTI");
@@ -828,6 +953,12 @@ static int lacp_port_periodic_set(struct lacp_port *lacp_port)
 	teamd_log_dbg("%s: Setting periodic timer to \"%s\".",
 		      lacp_port->tdport->ifname, fast_on ? "fast": "slow");
 	ms = fast_on ? LACP_PERIODIC_SHORT: LACP_PERIODIC_LONG;
+	if (lacp_port->lacp->cfg.tx_batch_enabled) {
+		/* Same as timer reset, transmit as soon as possible. */
+		lacp_port->tx.periodic_ms = ms;
+		lacp_port->tx.kick = true;
+		return 0;
+	}
 	ms_to_timespec(&ts, ms);
 	err = teamd_loop_callback_timer_set(lacp_port->ctx,
 					    LACP_PERIODIC_CB_NAME,
@@ -845,14 +976,34 @@ static bool lacp_port_should_be_active(struct lacp_port *lacp_port)
 	       (lacp_port->lacp->cfg.active);
 }
 
+static void lacp_port_periodic_enable(struct lacp_port *lacp_port)
+{
+	if (lacp_port->lacp->cfg.tx_batch_enabled) {
+		if (!lacp_port->tx.periodic_enabled)
+			lacp_port->tx.kick = true;
+		lacp_port->tx.periodic_enabled = true;
+		return;
+	}
+	teamd_loop_callback_enable(lacp_port->ctx,
+				   LACP_PERIODIC_CB_NAME, lacp_port);
+}
+
+static void lacp_port_periodic_disable(struct lacp_port *lacp_port)
+{
+	if (lacp_port->lacp->cfg.tx_batch_enabled) {
+		lacp_port->tx.periodic_enabled = false;
+		return;
+	}
+	teamd_loop_callback_disable(lacp_port->ctx,
+				    LACP_PERIODIC_CB_NAME, lacp_port);
+}
+
 static void lacp_port_periodic_cb_change_enabled(struct lacp_port *lacp_port)
 {
 	if (lacp_port_should_be_active(lacp_port) && lacp_port->periodic_on)
-		teamd_loop_callback_enable(lacp_port->ctx,
-					   LACP_PERIODIC_CB_NAME, lacp_port);
+		lacp_port_periodic_enable(lacp_port);
 	else
-		teamd_loop_callback_disable(lacp_port->ctx,
-					    LACP_PERIODIC_CB_NAME, lacp_port);
+		lacp_port_periodic_disable(lacp_port);
 }
 
 static void lacp_port_periodic_on(struct lacp_port *lacp_port)
@@ -872,6 +1023,7 @@ static int lacp_port_partner_update(struct lacp_port *lacp_port)
 	uint8_t state_changed;
 	int err;
 
+	lacp_port_lacpdu_invalidate(lacp_port);
 	state_changed = lacp_port->partner.state ^
 			lacp_port->__partner_last.state;
 
@@ -892,6 +1044,7 @@ static void lacp_port_actor_system_update(struct lacp_port *lacp_port)
 	struct lacpdu_info *actor = &lacp_port->actor;
 
 	memcpy(actor->system, lacp_port->ctx->hwaddr, ETH_ALEN);
+	lacp_port_lacpdu_invalidate(lacp_port);
 }
 
 static void lacp_port_actor_init(struct lacp_port *lacp_port)
@@ -905,7 +1058,8 @@ static void lacp_port_actor_init(struct lacp_port *lacp_port)
 	lacp_port_actor_system_update(lacp_port);
 }
 
-static void lacp_port_actor_update(struct lacp_port *lacp_port)
+/* Returns true in case actor state changed */
+static bool lacp_port_actor_update(struct lacp_port *lacp_port)
 {
 	uint8_t state = 0;
 
@@ -924,7 +1078,11 @@ static void lacp_port_actor_update(struct lacp_port *lacp_port)
 		state |= INFO_STATE_AGGREGATION;
 	teamd_log_dbg("%s: lacp info state: 0x%02X.", lacp_port->tdport->ifname,
 						      state);
+	if (lacp_port->actor.state == state)
+		return false;
 	lacp_port->actor.state = state;
+	lacp_port_lacpdu_invalidate(lacp_port);
+	return true;
 }
 
 static int lacpdu_send(struct lacp_port *lacp_port);
@@ -945,8 +1103,7 @@ static int lacp_port_set_state(struct lacp_port *lacp_port,
 	case PORT_STATE_CURRENT:
 		break;
 	case PORT_STATE_EXPIRED:
-		teamd_loop_callback_enable(lacp_port->ctx,
-					   LACP_PERIODIC_CB_NAME, lacp_port);
+		lacp_port_periodic_enable(lacp_port);
 		/*
 		 * This is a transient state; the LACP_Timeout settings allow
 		 * the Actor to transmit LACPDUs rapidly in an attempt to
@@ -977,16 +1134,23 @@ static int lacp_port_set_state(struct lacp_port *lacp_port,
 		       lacp_port->tdport->ifname,
 		       lacp_port_state_name[lacp_port->state],
 		       lacp_port_state_name[new_state]);
+	if (lacp_port->state == PORT_STATE_DISABLED)
+		clock_gettime(CLOCK_MONOTONIC, &lacp_port->bringup.start);
+	else if (new_state == PORT_STATE_DISABLED)
+		memset(&lacp_port->bringup.start, 0,
+		       sizeof(lacp_port->bringup.start));
 	lacp_port->state = new_state;
 
 	err = lacp_port_agg_update(lacp_port);
 	if (err)
 		return err;
 
-	lacp_port_actor_update(lacp_port);
-	if (lacp_port->periodic_on)
-		return 0;
-	return lacpdu_send(lacp_port);
+	/* Need To Transmit, do not wait for the periodic timer to let
+	 * partner know about actor state change.
+	 */
+	if (lacp_port_actor_update(lacp_port) || !lacp_port->periodic_on)
+		return lacpdu_send(lacp_port);
+	return 0;
 }
 
 static enum lacp_port_state lacp_port_get_state(struct lacp_port *lacp_port)
@@ -1019,76 +1183,267 @@ static int lacp_port_link_update(struct lacp_port *lacp_port)
 		if (err)
 			return err;
 	}
+	lacp_port_agg_bandwidth_update(lacp_port, speed);
 	lacp_port->__link_last.up = linkup;
 	lacp_port->__link_last.speed = speed;
 	lacp_port->__link_last.duplex = duplex;
 	return 0;
 }
 
-static int lacpdu_send(struct lacp_port *lacp_port)
+static bool lacpdu_build(struct lacp_port *lacp_port, struct lacpdu *lacpdu)
 {
-	struct lacpdu lacpdu;
-	struct sockaddr_ll ll_my;
-	struct sockaddr_ll ll_slow;
 	char *hwaddr;
 	unsigned char hwaddr_len;
+
+	hwaddr = team_get_ifinfo_orig_hwaddr(lacp_port->tdport->team_ifinfo);
+	hwaddr_len = team_get_ifinfo_orig_hwaddr_len(lacp_port->tdport->team_ifinfo);
+	if (hwaddr_len != ETH_ALEN)
+		return false;
+
+	lacpdu_init(lacpdu);
+	lacpdu->actor = lacp_port->actor;
+	lacpdu->partner = lacp_port->partner;
+	memcpy(lacpdu->hdr.ether_shost, hwaddr, hwaddr_len);
+	memcpy(lacpdu->hdr.ether_dhost, slow_addr, ETH_ALEN);
+	lacpdu->hdr.ether_type = htons(ETH_P_SLOW);
+	return true;
+}
+
+/* Returns prebuilt LACPDU frame, rebuilds it only if it was invalidated.
+ * NULL is returned in case there is nothing to send.
+ */
+static struct lacpdu *lacp_port_lacpdu_get(struct lacp_port *lacp_port)
+{
+	if (!lacp_port->lacpdu_cached) {
+		lacp_port->lacpdu_usable = lacpdu_build(lacp_port,
+							&lacp_port->lacpdu);
+		lacp_port->lacpdu_cached = true;
+	}
+	return lacp_port->lacpdu_usable ? &lacp_port->lacpdu : NULL;
+}
+
+/*
+ * Returns LACPDU to be sent or NULL if nothing would go out now. Send on
+ * port with link down is silently dropped, so it is not tried at all to
+ * keep transmission records accurate.
+ */
+static struct lacpdu *lacp_port_tx_lacpdu_get(struct lacp_port *lacp_port)
+{
+	if (!team_is_port_link_up(lacp_port->tdport->team_port))
+		return NULL;
+	return lacp_port_lacpdu_get(lacp_port);
+}
+
+/*
+ * No more than three LACPDUs may be transmitted in any fast periodic
+ * time interval (IEEE Std 802.3ad-2000 43.4.16).
+ */
+static bool lacp_port_tx_allowed(struct lacp_port *lacp_port,
+				 struct timespec *now)
+{
+	struct timespec *oldest = &lacp_port->tx.last[lacp_port->tx.last_index];
+
+	if (timespec_is_zero(oldest))
+		return true;
+	return timespec_diff_ms(now, oldest) >= LACP_PERIODIC_SHORT;
+}
+
+static void lacp_port_tx_done(struct lacp_port *lacp_port,
+			      struct timespec *now)
+{
+	lacp_port->tx.last[lacp_port->tx.last_index] = *now;
+	lacp_port->tx.last_index = (lacp_port->tx.last_index + 1) %
+				   ARRAY_SIZE(lacp_port->tx.last);
+	lacp_port->tx.ntt = false;
+	lacp_port->tx.kick = false;
+}
+
+#define LACP_NTT_CB_NAME "lacp_ntt"
+
+/*
+ * Transmission is not allowed now, retry once the oldest of the last
+ * three transmissions gets out of the fast periodic interval.
+ */
+static int lacp_port_ntt_postpone(struct lacp_port *lacp_port,
+				  struct timespec *now)
+{
+	struct timespec *oldest = &lacp_port->tx.last[lacp_port->tx.last_index];
+	struct timespec ts;
 	int err;
-	bool admin_state;
 
-	admin_state = team_get_ifinfo_admin_state(lacp_port->ctx->ifinfo);
-	if (!admin_state)
+	if (lacp_port->tx.ntt)
 		return 0;
-
-	err = teamd_getsockname_hwaddr(lacp_port->sock, &ll_my, 0);
-	if (err)
+	lacp_port->tx.ntt = true;
+	if (lacp_port->lacp->cfg.tx_batch_enabled)
+		return 0; /* next tx tick takes care of it */
+	ms_to_timespec(&ts, LACP_PERIODIC_SHORT -
+			    timespec_diff_ms(now, oldest));
+	err = teamd_loop_callback_timer_set(lacp_port->ctx, LACP_NTT_CB_NAME,
+					    lacp_port, NULL, &ts);
+	if (err) {
+		teamd_log_err("Failed to set ntt timer.");
 		return err;
-	ll_slow = ll_my;
-	memcpy(ll_slow.sll_addr, slow_addr, ll_slow.sll_halen);
+	}
+	teamd_loop_callback_enable(lacp_port->ctx, LACP_NTT_CB_NAME, lacp_port);
+	return 0;
+}
 
-	memcpy(lacp_port->actor.system, lacp_port->ctx->hwaddr, ETH_ALEN);
+/*
+ * Tx batching. Periodic transmissions of all ports are aligned to shared
+ * ticks of the runner and due LACPDUs are sent by sendmmsg() once per tick.
+ */
 
-	hwaddr = team_get_ifinfo_orig_hwaddr(lacp_port->tdport->team_ifinfo);
-	hwaddr_len = team_get_ifinfo_orig_hwaddr_len(lacp_port->tdport->team_ifinfo);
-	if (hwaddr_len != ETH_ALEN)
-		return 0;
+#define LACP_TX_TICK_CB_NAME "lacp_tx_tick"
+#define LACP_TX_BATCH_MAX 64
+
+struct lacp_tx_batch {
+	struct sockaddr_ll addr[LACP_TX_BATCH_MAX];
+	struct iovec iov[LACP_TX_BATCH_MAX];
+	struct mmsghdr msg[LACP_TX_BATCH_MAX];
+	struct lacp_port *ports[LACP_TX_BATCH_MAX];
+	unsigned int count;
+	struct timespec now;
+};
+
+static int lacp_tx_batch_tick_ms(struct lacp *lacp)
+{
+	return LACP_PERIODIC_SHORT / lacp->cfg.tx_batch_spread;
+}
+
+static void lacp_port_tx_addr_fill(struct lacp_port *lacp_port,
+				   struct sockaddr_ll *addr)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sll_family = AF_PACKET;
+	addr->sll_protocol = htons(ETH_P_SLOW);
+	addr->sll_ifindex = lacp_port->tdport->ifindex;
+	addr->sll_halen = ETH_ALEN;
+	memcpy(addr->sll_addr, slow_addr, ETH_ALEN);
+}
+
+/* Ports are spread over ticks of their periodic interval by ifindex. */
+static bool lacp_port_tx_periodic_due(struct lacp_port *lacp_port)
+{
+	struct lacp *lacp = lacp_port->lacp;
+	unsigned int ticks;
 
-	lacpdu_init(&lacpdu);
-	lacpdu.actor = lacp_port->actor;
-	lacpdu.partner = lacp_port->partner;
-	memcpy(lacpdu.hdr.ether_shost, hwaddr, hwaddr_len);
-	memcpy(lacpdu.hdr.ether_dhost, ll_slow.sll_addr, ll_slow.sll_halen);
-	lacpdu.hdr.ether_type = htons(ETH_P_SLOW);
+	if (!lacp_port->tx.periodic_enabled)
+		return false;
+	if (lacp_port->tx.kick)
+		return true;
+	ticks = lacp_port->tx.periodic_ms / lacp_tx_batch_tick_ms(lacp);
+	return lacp->tx_batch.tick % ticks ==
+	       lacp_port->tdport->ifindex % ticks;
+}
+
+static int lacp_tx_batch_flush(struct lacp *lacp, struct lacp_tx_batch *batch)
+{
+	unsigned int i;
+	int err;
 
-	err = teamd_send(lacp_port->sock, &lacpdu, sizeof(lacpdu), 0);
+	if (!batch->count)
+		return 0;
+	for (i = 0; i < batch->count; i++) {
+		memset(&batch->msg[i], 0, sizeof(batch->msg[i]));
+		batch->msg[i].msg_hdr.msg_name = &batch->addr[i];
+		batch->msg[i].msg_hdr.msg_namelen = sizeof(batch->addr[i]);
+		batch->msg[i].msg_hdr.msg_iov = &batch->iov[i];
+		batch->msg[i].msg_hdr.msg_iovlen = 1;
+	}
+	err = teamd_sendmmsg(lacp->tx_batch.sock, batch->msg, batch->count, 0,
+			     NULL);
+	if (!err)
+		for (i = 0; i < batch->count; i++)
+			lacp_port_tx_done(batch->ports[i], &batch->now);
+	batch->count = 0;
 	return err;
 }
 
-static int lacpdu_recv(struct lacp_port *lacp_port)
+static int lacp_tx_batch_add(struct lacp *lacp, struct lacp_tx_batch *batch,
+			     struct lacp_port *lacp_port)
 {
-	struct lacpdu lacpdu;
-	struct sockaddr_ll ll_from;
+	unsigned int i = batch->count;
+	struct lacpdu *lacpdu;
+
+	lacpdu = lacp_port_tx_lacpdu_get(lacp_port);
+	if (!lacpdu)
+		return 0;
+	/* Frame is not copied, it stays unchanged until the batch is sent */
+	batch->iov[i].iov_base = lacpdu;
+	batch->iov[i].iov_len = sizeof(*lacpdu);
+	lacp_port_tx_addr_fill(lacp_port, &batch->addr[i]);
+	batch->ports[i] = lacp_port;
+	if (++batch->count == LACP_TX_BATCH_MAX)
+		return lacp_tx_batch_flush(lacp, batch);
+	return 0;
+}
+
+/* Send LACPDU using socket which is not bound to the port. */
+static int lacpdu_sendto(struct lacp_port *lacp_port, int sock,
+			 struct lacpdu *lacpdu)
+{
+	struct sockaddr_ll ll_slow;
+
+	lacp_port_tx_addr_fill(lacp_port, &ll_slow);
+	return teamd_sendto(sock, lacpdu, sizeof(*lacpdu), 0,
+			    (struct sockaddr *) &ll_slow, sizeof(ll_slow));
+}
+
+static int lacpdu_send(struct lacp_port *lacp_port)
+{
+	struct lacp *lacp = lacp_port->lacp;
+	struct lacpdu *lacpdu;
+	struct timespec now;
+	bool admin_state;
 	int err;
 
-	err = teamd_recvfrom(lacp_port->sock, &lacpdu, sizeof(lacpdu), 0,
-			     (struct sockaddr *) &ll_from, sizeof(ll_from));
-	if (err <= 0)
+	admin_state = team_get_ifinfo_admin_state(lacp_port->ctx->ifinfo);
+	if (!admin_state)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (!lacp_port_tx_allowed(lacp_port, &now))
+		return lacp_port_ntt_postpone(lacp_port, &now);
+
+	lacpdu = lacp_port_tx_lacpdu_get(lacp_port);
+	if (!lacpdu)
+		return 0;
+	if (lacp->cfg.tx_batch_enabled)
+		err = lacpdu_sendto(lacp_port, lacp->tx_batch.sock, lacpdu);
+	else if (lacp->cfg.rx_ring_enabled)
+		err = lacpdu_sendto(lacp_port, lacp->rx_ring.sock, lacpdu);
+	else
+		err = teamd_send(lacp_port->sock, lacpdu, sizeof(*lacpdu), 0);
+	if (err)
 		return err;
+	lacp_port_tx_done(lacp_port, &now);
+	return 0;
+}
+
+static int lacpdu_process(struct lacp_port *lacp_port, struct lacpdu *lacpdu)
+{
+	int err;
 
-	if (!lacpdu_check(&lacpdu)) {
+	if (!lacpdu_check(lacpdu)) {
 		teamd_log_warn("malformed LACP PDU came.");
 		return 0;
 	}
 
 	/* Check if we have correct info about the other side */
-	if (memcmp(&lacpdu.actor, &lacp_port->partner,
+	if (memcmp(&lacpdu->actor, &lacp_port->partner,
 		   sizeof(struct lacpdu_info))) {
-		lacp_port->partner = lacpdu.actor;
+		lacp_port->partner = lacpdu->actor;
 		err = lacp_port_partner_update(lacp_port);
 		if (err)
 			return err;
 		err = lacp_port_agg_update(lacp_port);
 		if (err)
 			return err;
+		if (lacp_port_actor_update(lacp_port)) {
+			err = lacpdu_send(lacp_port);
+			if (err)
+				return err;
+		}
 	}
 
 	err = lacp_port_set_state(lacp_port, PORT_STATE_CURRENT);
@@ -1097,7 +1452,7 @@ static int lacpdu_recv(struct lacp_port *lacp_port)
 
 	/* Check if the other side has correct info about us */
 	if (!lacp_port->periodic_on &&
-	    memcmp(&lacpdu.partner, &lacp_port->actor,
+	    memcmp(&lacpdu->partner, &lacp_port->actor,
 		   sizeof(struct lacpdu_info))) {
 		err = lacpdu_send(lacp_port);
 		if (err)
@@ -1112,6 +1467,221 @@ static int lacpdu_recv(struct lacp_port *lacp_port)
 	return 0;
 }
 
+static int lacpdu_recv(struct lacp_port *lacp_port)
+{
+	struct lacpdu lacpdu;
+	struct sockaddr_ll ll_from;
+	int err;
+
+	err = teamd_recvfrom(lacp_port->sock, &lacpdu, sizeof(lacpdu), 0,
+			     (struct sockaddr *) &ll_from, sizeof(ll_from));
+	if (err <= 0)
+		return err;
+	return lacpdu_process(lacp_port, &lacpdu);
+}
+
+/*
+ * Shared rx ring. LACPDUs of all ports are received by a single packet
+ * socket with TPACKET_V3 memory mapped ring and demultiplexed to ports
+ * by ifindex.
+ */
+
+#define LACP_RX_RING_CB_NAME "lacp_rx_ring"
+#define LACP_RX_RING_BLOCK_SIZE (1 << 15)
+#define LACP_RX_RING_BLOCK_NR 8
+#define LACP_RX_RING_FRAME_SIZE 2048
+#define LACP_RX_RING_BLOCK_TOV 20 /* ms */
+
+/*
+ * Team device delivers LACPDUs to exact match only, meaning to the packet
+ * sockets bound to the port. Socket bound to ETH_P_SLOW but to no port
+ * would never see them, and a packet socket can be bound to a single port
+ * only. So the unbound socket has to see all frames (ETH_P_ALL) and this
+ * filter picks incoming LACPDUs. Filter runs before anything is copied
+ * into the ring, so cost of other frames is the filter run only. Outgoing
+ * frames are not passed to the socket at all (PACKET_IGNORE_OUTGOING)
+ * where kernel supports that, filter drops them otherwise.
+ */
+
+#ifndef PACKET_IGNORE_OUTGOING
+#define PACKET_IGNORE_OUTGOING 23
+#endif
+
+static struct sock_filter lacp_rx_ring_flt[] = {
+	BPF_STMT(BPF_LD + BPF_B + BPF_ABS, SKF_AD_OFF + SKF_AD_PKTTYPE),
+	BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, PACKET_OUTGOING, 4, 0),
+	BPF_STMT(BPF_LD + BPF_H + BPF_ABS, SKF_AD_OFF + SKF_AD_PROTOCOL),
+	BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, ETH_P_SLOW, 0, 2),
+	BPF_STMT(BPF_LD + BPF_B + BPF_ABS, sizeof(struct ether_header)),
+	BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, 0x01, 1, 0), /* LACP subtype */
+	BPF_STMT(BPF_RET + BPF_K, 0),
+	BPF_STMT(BPF_RET + BPF_K, (u_int) -1),
+};
+
+static const struct sock_fprog lacp_rx_ring_fprog = {
+	.len = ARRAY_SIZE(lacp_rx_ring_flt),
+	.filter = lacp_rx_ring_flt,
+};
+
+static int lacp_rx_ring_frame_process(struct lacp *lacp,
+				      struct tpacket3_hdr *ppd)
+{
+	struct sockaddr_ll *ll_from;
+	struct teamd_port *tdport;
+	struct lacp_port *lacp_port;
+	struct lacpdu *lacpdu;
+	struct lacpdu short_lacpdu;
+
+	ll_from = (struct sockaddr_ll *) ((uint8_t *) ppd +
+		  TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+	tdport = teamd_get_port(lacp->ctx, ll_from->sll_ifindex);
+	if (!tdport || !teamd_port_present(lacp->ctx, tdport))
+		return 0;
+	lacp_port = lacp_port_get(lacp, tdport);
+
+	lacpdu = (struct lacpdu *) ((uint8_t *) ppd + ppd->tp_mac);
+	if (ppd->tp_snaplen < sizeof(*lacpdu)) {
+		memset(&short_lacpdu, 0, sizeof(short_lacpdu));
+		memcpy(&short_lacpdu, lacpdu, ppd->tp_snaplen);
+		lacpdu = &short_lacpdu;
+	}
+	return lacpdu_process(lacp_port, lacpdu);
+}
+
+static int lacp_rx_ring_block_process(struct lacp *lacp,
+				      struct tpacket_block_desc *pbd)
+{
+	struct tpacket3_hdr *ppd;
+	unsigned int i;
+	int err;
+
+	ppd = (struct tpacket3_hdr *) ((uint8_t *) pbd +
+				       pbd->hdr.bh1.offset_to_first_pkt);
+	for (i = 0; i < pbd->hdr.bh1.num_pkts; i++) {
+		err = lacp_rx_ring_frame_process(lacp, ppd);
+		if (err)
+			return err;
+		ppd = (struct tpacket3_hdr *) ((uint8_t *) ppd +
+					       ppd->tp_next_offset);
+	}
+	return 0;
+}
+
+static int lacp_callback_rx_ring(struct teamd_context *ctx, int events,
+				 void *priv)
+{
+	struct lacp *lacp = priv;
+	struct tpacket_block_desc *pbd;
+	int err = 0;
+
+	while (!err) {
+		pbd = (struct tpacket_block_desc *) ((uint8_t *) lacp->rx_ring.map +
+			lacp->rx_ring.block_index * LACP_RX_RING_BLOCK_SIZE);
+		if (!(pbd->hdr.bh1.block_status & TP_STATUS_USER))
+			break;
+		err = lacp_rx_ring_block_process(lacp, pbd);
+		/* Return the block to kernel */
+		__sync_synchronize();
+		pbd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+		lacp->rx_ring.block_index = (lacp->rx_ring.block_index + 1) %
+					    LACP_RX_RING_BLOCK_NR;
+	}
+	return err;
+}
+
+static int lacp_rx_ring_sock_open(struct lacp *lacp)
+{
+	struct tpacket_req3 req;
+	struct sockaddr_ll ll_my;
+	int version = TPACKET_V3;
+	int one = 1;
+	int sock;
+	int ret;
+	int err;
+
+	sock = socket(PF_PACKET, SOCK_RAW, 0);
+	if (sock == -1) {
+		teamd_log_err("Failed to create packet socket.");
+		return -errno;
+	}
+
+	ret = setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER,
+			 &lacp_rx_ring_fprog, sizeof(lacp_rx_ring_fprog));
+	if (ret == -1) {
+		teamd_log_err("Failed to attach filter.");
+		err = -errno;
+		goto close_sock;
+	}
+
+	ret = setsockopt(sock, SOL_PACKET, PACKET_IGNORE_OUTGOING,
+			 &one, sizeof(one));
+	if (ret == -1) {
+		if (errno != ENOPROTOOPT) {
+			teamd_log_err("Failed to ignore outgoing frames.");
+			err = -errno;
+			goto close_sock;
+		}
+		teamd_log_dbg("Outgoing frames are dropped by filter only.");
+	}
+
+	ret = setsockopt(sock, SOL_PACKET, PACKET_VERSION,
+			 &version, sizeof(version));
+	if (ret == -1) {
+		teamd_log_err("Failed to set TPACKET_V3 version.");
+		err = -errno;
+		goto close_sock;
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = LACP_RX_RING_BLOCK_SIZE;
+	req.tp_block_nr = LACP_RX_RING_BLOCK_NR;
+	req.tp_frame_size = LACP_RX_RING_FRAME_SIZE;
+	req.tp_frame_nr = LACP_RX_RING_BLOCK_SIZE / LACP_RX_RING_FRAME_SIZE *
+			  LACP_RX_RING_BLOCK_NR;
+	req.tp_retire_blk_tov = LACP_RX_RING_BLOCK_TOV;
+	ret = setsockopt(sock, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req));
+	if (ret == -1) {
+		teamd_log_err("Failed to set up rx ring.");
+		err = -errno;
+		goto close_sock;
+	}
+
+	lacp->rx_ring.map_size = LACP_RX_RING_BLOCK_SIZE * LACP_RX_RING_BLOCK_NR;
+	lacp->rx_ring.map = mmap(NULL, lacp->rx_ring.map_size,
+				 PROT_READ | PROT_WRITE, MAP_SHARED, sock, 0);
+	if (lacp->rx_ring.map == MAP_FAILED) {
+		teamd_log_err("Failed to map rx ring.");
+		err = -errno;
+		goto close_sock;
+	}
+	lacp->rx_ring.block_index = 0;
+
+	memset(&ll_my, 0, sizeof(ll_my));
+	ll_my.sll_family = AF_PACKET;
+	ll_my.sll_protocol = htons(ETH_P_ALL);
+	ret = bind(sock, (struct sockaddr *) &ll_my, sizeof(ll_my));
+	if (ret == -1) {
+		teamd_log_err("Failed to bind socket.");
+		err = -errno;
+		goto unmap;
+	}
+
+	lacp->rx_ring.sock = sock;
+	return 0;
+
+unmap:
+	munmap(lacp->rx_ring.map, lacp->rx_ring.map_size);
+close_sock:
+	close(sock);
+	return err;
+}
+
+static void lacp_rx_ring_sock_close(struct lacp *lacp)
+{
+	munmap(lacp->rx_ring.map, lacp->rx_ring.map_size);
+	close(lacp->rx_ring.sock);
+}
+
 static int lacp_callback_timeout(struct teamd_context *ctx, int events,
 				 void *priv)
 {
@@ -1142,6 +1712,51 @@ static int lacp_callback_periodic(struct teamd_context *ctx, int events,
 	return lacpdu_send(lacp_port);
 }
 
+static int lacp_callback_ntt(struct teamd_context *ctx, int events,
+			     void *priv)
+{
+	struct lacp_port *lacp_port = priv;
+
+	if (!lacp_port->tx.ntt)
+		return 0;
+	lacp_port->tx.ntt = false;
+	lacp_port_actor_update(lacp_port);
+	return lacpdu_send(lacp_port);
+}
+
+static int lacp_callback_tx_tick(struct teamd_context *ctx, int events,
+				 void *priv)
+{
+	struct lacp *lacp = priv;
+	struct lacp_tx_batch batch;
+	struct teamd_port *tdport;
+	struct lacp_port *lacp_port;
+	struct timespec now;
+	int err;
+
+	lacp->tx_batch.tick++;
+	if (!team_get_ifinfo_admin_state(ctx->ifinfo))
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	batch.count = 0;
+	batch.now = now;
+	teamd_for_each_tdport(tdport, ctx) {
+		lacp_port = lacp_port_get(lacp, tdport);
+		if (!lacp_port->tx.ntt && !lacp_port_tx_periodic_due(lacp_port))
+			continue;
+		if (!lacp_port_tx_allowed(lacp_port, &now)) {
+			lacp_port->tx.ntt = true;
+			continue;
+		}
+		lacp_port_actor_update(lacp_port);
+		err = lacp_tx_batch_add(lacp, &batch, lacp_port);
+		if (err)
+			return err;
+	}
+	return lacp_tx_batch_flush(lacp, &batch);
+}
+
 static int lacp_callback_socket(struct teamd_context *ctx, int events,
 				void *priv)
 {
@@ -1227,30 +1842,38 @@ static int lacp_port_added(struct teamd_context *ctx,
 		return err;
 	}
 
-	err = teamd_packet_sock_open_type(SOCK_RAW, &lacp_port->sock,
-					  tdport->ifindex,
-					  htons(ETH_P_SLOW), NULL, NULL);
-	if (err)
-		return err;
+	if (!lacp->cfg.rx_ring_enabled) {
+		err = teamd_packet_sock_open_type(SOCK_RAW, &lacp_port->sock,
+						  tdport->ifindex,
+						  htons(ETH_P_SLOW), NULL, NULL);
+		if (err)
+			return err;
+	}
 
 	err = slow_addr_add(lacp_port);
 	if (err)
 		goto close_sock;
 
-	err = teamd_loop_callback_fd_add(ctx, LACP_SOCKET_CB_NAME, lacp_port,
-					 lacp_callback_socket,
-					 lacp_port->sock,
-					 TEAMD_LOOP_FD_EVENT_READ);
-	if (err) {
-		teamd_log_err("Failed add socket callback.");
-		goto slow_addr_del;
+	if (!lacp->cfg.rx_ring_enabled) {
+		err = teamd_loop_callback_fd_add(ctx, LACP_SOCKET_CB_NAME,
+						 lacp_port,
+						 lacp_callback_socket,
+						 lacp_port->sock,
+						 TEAMD_LOOP_FD_EVENT_READ);
+		if (err) {
+			teamd_log_err("Failed add socket callback.");
+			goto slow_addr_del;
+		}
 	}
 
-	err = teamd_loop_callback_timer_add(ctx, LACP_PERIODIC_CB_NAME,
-					    lacp_port, lacp_callback_periodic);
-	if (err) {
-		teamd_log_err("Failed add periodic callback timer");
-		goto socket_callback_del;
+	if (!lacp->cfg.tx_batch_enabled) {
+		err = teamd_loop_callback_timer_add(ctx, LACP_PERIODIC_CB_NAME,
+						    lacp_port,
+						    lacp_callback_periodic);
+		if (err) {
+			teamd_log_err("Failed add periodic callback timer");
+			goto socket_callback_del;
+		}
 	}
 	err = lacp_port_periodic_set(lacp_port);
 	if (err)
@@ -1263,34 +1886,52 @@ static int lacp_port_added(struct teamd_context *ctx,
 		goto periodic_callback_del;
 	}
 
+	if (!lacp->cfg.tx_batch_enabled) {
+		err = teamd_loop_callback_timer_add(ctx, LACP_NTT_CB_NAME,
+						    lacp_port,
+						    lacp_callback_ntt);
+		if (err) {
+			teamd_log_err("Failed add ntt callback timer");
+			goto timeout_callback_del;
+		}
+	}
+
 	/* Newly added ports are disabled */
 	err = team_set_port_enabled(ctx->th, tdport->ifindex, false);
 	if (err) {
 		teamd_log_err("%s: Failed to disable port.", tdport->ifname);
 		if (!TEAMD_ENOENT(err))
-			goto timeout_callback_del;
+			goto ntt_callback_del;
 	}
 
 	err = lacp_port_set_mac(ctx, tdport);
 	if (err)
-		goto timeout_callback_del;
+		goto ntt_callback_del;
 
+	lacp_port->bringup.distributing_ms = -1;
 	lacp_port_actor_init(lacp_port);
 	lacp_port_link_update(lacp_port);
 
-	teamd_loop_callback_enable(ctx, LACP_SOCKET_CB_NAME, lacp_port);
+	if (!lacp->cfg.rx_ring_enabled)
+		teamd_loop_callback_enable(ctx, LACP_SOCKET_CB_NAME, lacp_port);
 	return 0;
 
+ntt_callback_del:
+	if (!lacp->cfg.tx_batch_enabled)
+		teamd_loop_callback_del(ctx, LACP_NTT_CB_NAME, lacp_port);
 timeout_callback_del:
 	teamd_loop_callback_del(ctx, LACP_TIMEOUT_CB_NAME, lacp_port);
 periodic_callback_del:
-	teamd_loop_callback_del(ctx, LACP_PERIODIC_CB_NAME, lacp_port);
+	if (!lacp->cfg.tx_batch_enabled)
+		teamd_loop_callback_del(ctx, LACP_PERIODIC_CB_NAME, lacp_port);
 socket_callback_del:
-	teamd_loop_callback_del(ctx, LACP_SOCKET_CB_NAME, lacp_port);
+	if (!lacp->cfg.rx_ring_enabled)
+		teamd_loop_callback_del(ctx, LACP_SOCKET_CB_NAME, lacp_port);
 slow_addr_del:
 	slow_addr_del(lacp_port);
 close_sock:
-	close(lacp_port->sock);
+	if (!lacp->cfg.rx_ring_enabled)
+		close(lacp_port->sock);
 	return err;
 }
 
@@ -1299,13 +1940,19 @@ static void lacp_port_removed(struct teamd_context *ctx,
 			      void *priv, void *creator_priv)
 {
 	struct lacp_port *lacp_port = priv;
+	struct lacp *lacp = creator_priv;
 
 	lacp_port_set_state(lacp_port, PORT_STATE_DISABLED);
+	if (!lacp->cfg.tx_batch_enabled)
+		teamd_loop_callback_del(ctx, LACP_NTT_CB_NAME, lacp_port);
 	teamd_loop_callback_del(ctx, LACP_TIMEOUT_CB_NAME, lacp_port);
-	teamd_loop_callback_del(ctx, LACP_PERIODIC_CB_NAME, lacp_port);
-	teamd_loop_callback_del(ctx, LACP_SOCKET_CB_NAME, lacp_port);
+	if (!lacp->cfg.tx_batch_enabled)
+		teamd_loop_callback_del(ctx, LACP_PERIODIC_CB_NAME, lacp_port);
+	if (!lacp->cfg.rx_ring_enabled)
+		teamd_loop_callback_del(ctx, LACP_SOCKET_CB_NAME, lacp_port);
 	slow_addr_del(lacp_port);
-	close(lacp_port->sock);
+	if (!lacp->cfg.rx_ring_enabled)
+		close(lacp_port->sock);
 }
 
 static const struct teamd_port_priv lacp_port_priv = {
@@ -1328,10 +1975,26 @@ static int lacp_event_watch_hwaddr_changed(struct teamd_context *ctx,
 		if (err)
 			return err;
 		lacp_port_actor_system_update(lacp_port);
+		if (lacp_port->periodic_on) {
+			err = lacpdu_send(lacp_port);
+			if (err)
+				return err;
+		}
 	}
 	return 0;
 }
 
+static int lacp_event_watch_port_hwaddr_changed(struct teamd_context *ctx,
+						struct teamd_port *tdport,
+						void *priv)
+{
+	struct lacp *lacp = priv;
+
+	/* Source address of LACPDU is the port original hwaddr */
+	lacp_port_lacpdu_invalidate(lacp_port_get(lacp, tdport));
+	return 0;
+}
+
 static int lacp_event_watch_admin_state_changed(struct teamd_context *ctx,
 					        void *priv)
 {
@@ -1388,6 +2051,7 @@ static const struct teamd_event_watch_ops lacp_event_watch_ops = {
 	.port_added = lacp_event_watch_port_added,
 	.port_removed = lacp_event_watch_port_removed,
 	.port_changed = lacp_event_watch_port_changed,
+	.port_hwaddr_changed = lacp_event_watch_port_hwaddr_changed,
 	.admin_state_changed = lacp_event_watch_admin_state_changed,
 };
 
@@ -1422,6 +2086,79 @@ static int lacp_carrier_fini(struct teamd_context *ctx, struct lacp *lacp)
 	return 0;
 }
 
+static int lacp_tx_batch_init(struct teamd_context *ctx, struct lacp *lacp)
+{
+	struct timespec ts;
+	int err;
+
+	if (!lacp->cfg.tx_batch_enabled)
+		return 0;
+
+	/* Socket is not bound to any protocol so it does not receive */
+	err = teamd_packet_sock_open_type(SOCK_RAW, &lacp->tx_batch.sock,
+					  0, 0, NULL, NULL);
+	if (err)
+		return err;
+
+	ms_to_timespec(&ts, lacp_tx_batch_tick_ms(lacp));
+	err = teamd_loop_callback_timer_add_set(ctx, LACP_TX_TICK_CB_NAME, lacp,
+						lacp_callback_tx_tick,
+						&ts, &ts);
+	if (err) {
+		teamd_log_err("Failed add tx tick callback timer");
+		goto close_sock;
+	}
+	teamd_loop_callback_enable(ctx, LACP_TX_TICK_CB_NAME, lacp);
+	return 0;
+
+close_sock:
+	close(lacp->tx_batch.sock);
+	return err;
+}
+
+static void lacp_tx_batch_fini(struct teamd_context *ctx, struct lacp *lacp)
+{
+	if (!lacp->cfg.tx_batch_enabled)
+		return;
+	teamd_loop_callback_del(ctx, LACP_TX_TICK_CB_NAME, lacp);
+	close(lacp->tx_batch.sock);
+}
+
+static int lacp_rx_ring_init(struct teamd_context *ctx, struct lacp *lacp)
+{
+	int err;
+
+	if (!lacp->cfg.rx_ring_enabled)
+		return 0;
+
+	err = lacp_rx_ring_sock_open(lacp);
+	if (err)
+		return err;
+
+	err = teamd_loop_callback_fd_add(ctx, LACP_RX_RING_CB_NAME, lacp,
+					 lacp_callback_rx_ring,
+					 lacp->rx_ring.sock,
+					 TEAMD_LOOP_FD_EVENT_READ);
+	if (err) {
+		teamd_log_err("Failed add rx ring callback.");
+		goto sock_close;
+	}
+	teamd_loop_callback_enable(ctx, LACP_RX_RING_CB_NAME, lacp);
+	return 0;
+
+sock_close:
+	lacp_rx_ring_sock_close(lacp);
+	return err;
+}
+
+static void lacp_rx_ring_fini(struct teamd_context *ctx, struct lacp *lacp)
+{
+	if (!lacp->cfg.rx_ring_enabled)
+		return;
+	teamd_loop_callback_del(ctx, LACP_RX_RING_CB_NAME, lacp);
+	lacp_rx_ring_sock_close(lacp);
+}
+
 static int lacp_state_active_get(struct teamd_context *ctx,
 				 struct team_state_gsc *gsc,
 				 void *priv)
@@ -1733,7 +2470,7 @@ static int lacp_port_aggregator_select_work(struct teamd_context *ctx,
 	lacp_port = lacp_port_get(lacp, tdport);
 	if (!lacp_port_selected(lacp_port))
 		return 0;
-	return lacp_selected_agg_update(lacp_port->lacp, lacp_port->agg_lead);
+	return lacp_selected_agg_update(lacp_port->lacp, lacp_port->agg);
 }
 
 static int lacp_port_state_aggregator_selected_set(struct teamd_context *ctx,
@@ -1782,6 +2519,15 @@ static int lacp_port_state_prio_get(struct teamd_context *ctx,
 	return 0;
 }
 
+static int lacp_port_state_time_to_distributing_get(struct teamd_context *ctx,
+						    struct team_state_gsc *gsc,
+						    void *priv)
+{
+	gsc->data.int_val =
+		lacp_port_gsc(gsc, priv)->bringup.distributing_ms;
+	return 0;
+}
+
 static const struct teamd_state_val lacp_port_state_vals[] = {
 	{
 		.subpath = "selected",
@@ -1814,6 +2560,11 @@ static const struct teamd_state_val lacp_port_state_vals[] = {
 		.type = TEAMD_STATE_ITEM_TYPE_INT,
 		.getter = lacp_port_state_prio_get,
 	},
+	{
+		.subpath = "time_to_distributing",
+		.type = TEAMD_STATE_ITEM_TYPE_INT,
+		.getter = lacp_port_state_time_to_distributing_get,
+	},
 	{
 		.subpath = "actor_lacpdu_info",
 		.vals = lacp_port_actor_state_vals,
@@ -1856,6 +2607,7 @@ static int lacp_init(struct teamd_context *ctx, void *priv)
 	}
 
 	lacp->ctx = ctx;
+	list_init(&lacp->agg_list);
 	err = teamd_hash_func_set(ctx);
 	if (err)
 		return err;
@@ -1869,10 +2621,20 @@ static int lacp_init(struct teamd_context *ctx, void *priv)
 		teamd_log_err("Failed to initialize carrier.");
 		return err;
 	}
+	err = lacp_tx_batch_init(ctx, lacp);
+	if (err) {
+		teamd_log_err("Failed to initialize tx batching.");
+		return err;
+	}
+	err = lacp_rx_ring_init(ctx, lacp);
+	if (err) {
+		teamd_log_err("Failed to initialize rx ring.");
+		goto tx_batch_fini;
+	}
 	err = teamd_event_watch_register(ctx, &lacp_event_watch_ops, lacp);
 	if (err) {
 		teamd_log_err("Failed to register event watch.");
-		return err;
+		goto rx_ring_fini;
 	}
 	err = teamd_balancer_init(ctx, &lacp->tb);
 	if (err) {
@@ -1890,6 +2652,10 @@ balancer_fini:
 	teamd_balancer_fini(lacp->tb);
 event_watch_unregister:
 	teamd_event_watch_unregister(ctx, &lacp_event_watch_ops, lacp);
+rx_ring_fini:
+	lacp_rx_ring_fini(ctx, lacp);
+tx_batch_fini:
+	lacp_tx_batch_fini(ctx, lacp);
 	return err;
 }
 
@@ -1900,6 +2666,8 @@ static void lacp_fini(struct teamd_context *ctx, void *priv)
 	teamd_state_val_unregister(ctx, &lacp_state_vg, lacp);
 	teamd_balancer_fini(lacp->tb);
 	teamd_event_watch_unregister(ctx, &lacp_event_watch_ops, lacp);
+	lacp_rx_ring_fini(ctx, lacp);
+	lacp_tx_batch_fini(ctx, lacp);
 	lacp_carrier_fini(ctx, lacp);
 }
 
@@ -55,9 +55,14 @@ static int lb_event_watch_port_link_changed(struct teamd_context *ctx,
 					    struct teamd_port *tdport,
 					    void *priv)
 {
+	struct lb *lb = priv;
 	bool port_up = teamd_link_watch_port_up(ctx, tdport);
+	int err;
 
-	return teamd_port_check_enable(ctx, tdport, port_up, !port_up);
+	err = teamd_port_check_enable(ctx, tdport, port_up, !port_up);
+	if (err || port_up)
+		return err;
+	return teamd_balancer_port_disabled(lb->tb, tdport);
 }
 
 static int lb_event_watch_hwaddr_changed(struct teamd_context *ctx, void *priv)
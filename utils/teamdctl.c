@@ -23,6 +23,7 @@
 #include <stdbool.h>
 #include <getopt.h>
 #include <errno.h>
+#include <limits.h>
 #include <jansson.h>
 #include <private/misc.h>
 #include <teamdctl.h>
@@ -369,12 +370,13 @@ static int stateview_json_port_runner_process(char *runner_name,
 		char *state;
 		int key;
 		int prio;
+		int time_to_distributing = -1;
 		json_t *actor_json;
 		json_t *partner_json;
 
 		pr_out("runner:\n");
 		err = json_unpack(port_json,
-				  "{s:{s:b, s:{s:i, s:b}, s:s, s:i, s:i, s:o, s:o}}",
+				  "{s:{s:b, s:{s:i, s:b}, s:s, s:i, s:i, s?i, s:o, s:o}}",
 				  "runner",
 				  "selected", &selected,
 				  "aggregator", "id", &aggregator_id,
@@ -382,6 +384,7 @@ static int stateview_json_port_runner_process(char *runner_name,
 				  "state", &state,
 				  "key", &key,
 				  "prio", &prio,
+				  "time_to_distributing", &time_to_distributing,
 				  "actor_lacpdu_info", &actor_json,
 				  "partner_lacpdu_info", &partner_json);
 		if (err) {
@@ -395,6 +398,9 @@ static int stateview_json_port_runner_process(char *runner_name,
 		pr_out("state: %s\n", state);
 		pr_out2("key: %d\n", key);
 		pr_out2("priority: %d\n", prio);
+		if (time_to_distributing >= 0)
+			pr_out2("time to distributing: %d ms\n",
+				time_to_distributing);
 		pr_out2("actor LACPDU info:\n");
 		pr_out_indent_inc();
 		err = stateview_json_lacpdu_process(actor_json);
@@ -481,12 +487,75 @@ static int stateview_json_ports_process(char *runner_name, json_t *dump_json)
 	return 0;
 }
 
+static const struct {
+	const char *name;
+	int max_us;
+} failover_hist_buckets[] = {
+	{ "< 1ms", 1000 },
+	{ "< 10ms", 10000 },
+	{ "< 100ms", 100000 },
+	{ "< 1s", 1000000 },
+	{ ">= 1s", INT_MAX },
+};
+
+#define FAILOVER_HIST_BUCKETS_COUNT ARRAY_SIZE(failover_hist_buckets)
+
+static int stateview_json_failovers_process(json_t *failovers_json)
+{
+	unsigned int hist[FAILOVER_HIST_BUCKETS_COUNT] = { 0, };
+	json_t *iter;
+	int err;
+	int i;
+
+	pr_out("failovers:\n");
+	pr_out_indent_inc();
+	for (iter = json_object_iter(failovers_json); iter;
+	     iter = json_object_iter_next(failovers_json, iter)) {
+		json_t *failover_json = json_object_iter_value(iter);
+		char *from;
+		char *to;
+		int total_us;
+		int handler_us;
+		int clear_us;
+		int set_active_us;
+		int hwaddr_us;
+
+		err = json_unpack(failover_json,
+				  "{s:s, s:s, s:i, s:i, s:i, s:i, s:i}",
+				  "from", &from,
+				  "to", &to,
+				  "total_us", &total_us,
+				  "handler_us", &handler_us,
+				  "clear_us", &clear_us,
+				  "set_active_us", &set_active_us,
+				  "hwaddr_us", &hwaddr_us);
+		if (err) {
+			pr_err("Failed to parse JSON failover dump.\n");
+			return -EINVAL;
+		}
+		for (i = 0; i < FAILOVER_HIST_BUCKETS_COUNT; i++) {
+			if (total_us < failover_hist_buckets[i].max_us) {
+				hist[i]++;
+				break;
+			}
+		}
+		pr_out2("%s -> %s: %dus (handler %dus, clear %dus, set active %dus, hwaddr %dus)\n",
+			from, to, total_us, handler_us, clear_us,
+			set_active_us, hwaddr_us);
+	}
+	for (i = 0; i < FAILOVER_HIST_BUCKETS_COUNT; i++)
+		pr_out("%s: %u\n", failover_hist_buckets[i].name, hist[i]);
+	pr_out_indent_dec();
+	return 0;
+}
+
 static int stateview_json_runner_process(char *runner_name, json_t *json)
 {
 	int err;
 
 	if (!strcmp(runner_name, "activebackup")) {
 		char *active_port;
+		json_t *failovers_json;
 
 		pr_out("runner:\n");
 		err = json_unpack(json, "{s:{s:s}}", "runner",
@@ -497,6 +566,12 @@ static int stateview_json_runner_process(char *runner_name, json_t *json)
 		}
 		pr_out_indent_inc();
 		pr_out("active port: %s\n", active_port);
+		if (!json_unpack(json, "{s:{s:o}}", "runner",
+				 "failovers", &failovers_json)) {
+			err = stateview_json_failovers_process(failovers_json);
+			if (err)
+				return err;
+		}
 		pr_out_indent_dec();
 	} else if (!strcmp(runner_name, "lacp")) {
 		int active;
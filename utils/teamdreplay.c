@@ -0,0 +1,606 @@
+/*
+ *   teamdreplay.c - Teamd balancer decision log replay tool
+ *   Copyright (C) 2012-2015 Jiri Pirko <jiri@resnulli.us>
+ *
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <private/misc.h>
+
+#include "../teamd/teamd_balancer_log.h"
+
+enum algorithm {
+	ALGORITHM_RECORDED,
+	ALGORITHM_STATIC,
+	ALGORITHM_GREEDY,
+	ALGORITHM_IDLE_AWARE,
+};
+
+static const char *algorithm_names[] = {
+	[ALGORITHM_RECORDED] = "recorded",
+	[ALGORITHM_STATIC] = "static",
+	[ALGORITHM_GREEDY] = "greedy",
+	[ALGORITHM_IDLE_AWARE] = "idle_aware",
+};
+
+struct replay_params {
+	enum algorithm algorithm;
+	bool weights_set;
+	uint64_t byte_weight;
+	uint64_t packet_weight;
+	unsigned int idle_intervals;
+	uint64_t idle_bytes;
+	unsigned int busy_imbalance;
+	bool verbose;
+};
+
+struct replay_port {
+	uint32_t ifindex;
+	bool enabled;
+	uint64_t load;
+	bool elephant;
+};
+
+struct replay_ctx {
+	struct replay_params *params;
+	uint32_t mapping[TB_LOG_HASH_COUNT];
+	unsigned int idle_age[TB_LOG_HASH_COUNT];
+	struct replay_port ports[TB_LOG_PORT_MAX];
+	unsigned int port_count;
+	uint64_t byte_weight;
+	uint64_t packet_weight;
+	/* results */
+	unsigned int records;
+	unsigned int evaluated;
+	double imbalance_sum;
+	double imbalance_max;
+	uint64_t stranded;
+	unsigned int remaps;
+	unsigned int busy_remaps;
+	uint64_t busy_remap_bytes;
+};
+
+static uint64_t hash_cost(struct replay_ctx *rctx,
+			  const struct tb_log_hash *log_hash)
+{
+	return rctx->byte_weight * log_hash->bytes +
+	       rctx->packet_weight * log_hash->packets;
+}
+
+static struct replay_port *port_get(struct replay_ctx *rctx, uint32_t ifindex)
+{
+	int i;
+
+	for (i = 0; i < rctx->port_count; i++) {
+		if (rctx->ports[i].ifindex == ifindex)
+			return &rctx->ports[i];
+	}
+	return NULL;
+}
+
+static struct replay_port *enabled_port_get(struct replay_ctx *rctx,
+					    uint32_t ifindex)
+{
+	struct replay_port *port = port_get(rctx, ifindex);
+
+	return port && port->enabled ? port : NULL;
+}
+
+static void ports_load(struct replay_ctx *rctx,
+		       const struct tb_log_record *record)
+{
+	int i;
+
+	rctx->port_count = record->port_count < TB_LOG_PORT_MAX ?
+			   record->port_count : TB_LOG_PORT_MAX;
+	for (i = 0; i < rctx->port_count; i++) {
+		rctx->ports[i].ifindex = record->ports[i].ifindex;
+		rctx->ports[i].enabled = record->ports[i].flags &
+					 TB_LOG_PORT_ENABLED;
+	}
+}
+
+static void ports_clear_load(struct replay_ctx *rctx)
+{
+	int i;
+
+	for (i = 0; i < rctx->port_count; i++) {
+		rctx->ports[i].load = 0;
+		rctx->ports[i].elephant = false;
+	}
+}
+
+/* Returns imbalance in percent or -1 if there is nothing to compare */
+static double ports_imbalance(struct replay_ctx *rctx)
+{
+	uint64_t min_load = UINT64_MAX;
+	uint64_t max_load = 0;
+	unsigned int enabled_count = 0;
+	int i;
+
+	for (i = 0; i < rctx->port_count; i++) {
+		if (!rctx->ports[i].enabled)
+			continue;
+		enabled_count++;
+		if (rctx->ports[i].load < min_load)
+			min_load = rctx->ports[i].load;
+		if (rctx->ports[i].load > max_load)
+			max_load = rctx->ports[i].load;
+	}
+	if (enabled_count < 2 || !max_load)
+		return -1;
+	return (double) (max_load - min_load) * 100 / max_load;
+}
+
+/*
+ * Accounts traffic of the interval to ports according to the mapping in
+ * effect during the interval.
+ */
+static double evaluate(struct replay_ctx *rctx,
+		       const struct tb_log_record *record)
+{
+	struct replay_port *port;
+	double imbalance;
+	int i;
+
+	ports_clear_load(rctx);
+	for (i = 0; i < TB_LOG_HASH_COUNT; i++) {
+		uint64_t cost = hash_cost(rctx, &record->hashes[i]);
+
+		port = enabled_port_get(rctx, rctx->mapping[i]);
+		if (port)
+			port->load += cost;
+		else
+			rctx->stranded += cost;
+	}
+	imbalance = ports_imbalance(rctx);
+	if (imbalance >= 0) {
+		rctx->evaluated++;
+		rctx->imbalance_sum += imbalance;
+		if (imbalance > rctx->imbalance_max)
+			rctx->imbalance_max = imbalance;
+	}
+	return imbalance;
+}
+
+static void idle_age_update(struct replay_ctx *rctx,
+			    const struct tb_log_record *record)
+{
+	int i;
+
+	for (i = 0; i < TB_LOG_HASH_COUNT; i++) {
+		if (record->hashes[i].bytes > rctx->params->idle_bytes)
+			rctx->idle_age[i] = 0;
+		else
+			rctx->idle_age[i]++;
+	}
+}
+
+static bool hash_is_idle(struct replay_ctx *rctx, int hash)
+{
+	return rctx->idle_age[hash] >= rctx->params->idle_intervals;
+}
+
+static struct replay_port *least_loaded_port(struct replay_ctx *rctx)
+{
+	struct replay_port *best = NULL;
+	int i;
+
+	for (i = 0; i < rctx->port_count; i++) {
+		if (!rctx->ports[i].enabled)
+			continue;
+		if (!best || rctx->ports[i].load < best->load)
+			best = &rctx->ports[i];
+	}
+	return best;
+}
+
+static int biggest_unprocessed_hash(struct replay_ctx *rctx,
+				    const struct tb_log_record *record,
+				    bool *processed)
+{
+	int best = -1;
+	int i;
+
+	for (i = 0; i < TB_LOG_HASH_COUNT; i++) {
+		if (processed[i])
+			continue;
+		if (best == -1 ||
+		    hash_cost(rctx, &record->hashes[i]) >
+		    hash_cost(rctx, &record->hashes[best]))
+			best = i;
+	}
+	return best;
+}
+
+static void pin_hash(struct replay_ctx *rctx,
+		     const struct tb_log_record *record,
+		     bool *processed, int hash, struct replay_port *port)
+{
+	port->load += hash_cost(rctx, &record->hashes[hash]);
+	processed[hash] = true;
+}
+
+/* Mirrors tb_rebalance() of teamd */
+static void rebalance(struct replay_ctx *rctx,
+		      const struct tb_log_record *record,
+		      uint32_t *new_mapping, double imbalance)
+{
+	bool processed[TB_LOG_HASH_COUNT] = {false};
+	struct replay_port *port;
+	int hash;
+	int i;
+
+	ports_clear_load(rctx);
+
+	if (rctx->params->algorithm == ALGORITHM_IDLE_AWARE &&
+	    imbalance <= rctx->params->busy_imbalance) {
+		for (i = 0; i < TB_LOG_HASH_COUNT; i++) {
+			port = enabled_port_get(rctx, rctx->mapping[i]);
+			if (!port || hash_is_idle(rctx, i))
+				continue;
+			pin_hash(rctx, record, processed, i, port);
+			if (record->hashes[i].flags & TB_LOG_HASH_ELEPHANT)
+				port->elephant = true;
+		}
+	}
+	for (i = 0; i < TB_LOG_HASH_COUNT; i++) {
+		if (processed[i] ||
+		    !(record->hashes[i].flags & TB_LOG_HASH_ELEPHANT))
+			continue;
+		port = enabled_port_get(rctx, rctx->mapping[i]);
+		if (!port || port->elephant)
+			continue;
+		pin_hash(rctx, record, processed, i, port);
+		port->elephant = true;
+	}
+
+	while ((hash = biggest_unprocessed_hash(rctx, record, processed)) != -1 &&
+	       (port = least_loaded_port(rctx))) {
+		uint64_t cost = hash_cost(rctx, &record->hashes[hash]);
+		bool idle = rctx->params->algorithm == ALGORITHM_IDLE_AWARE &&
+			    hash_is_idle(rctx, hash);
+
+		processed[hash] = true;
+		if (rctx->mapping[hash] && !cost && !idle)
+			continue;
+		new_mapping[hash] = port->ifindex;
+		port->load += cost + idle;
+	}
+}
+
+/* Mirrors tb_port_evacuate() of teamd */
+static void evacuate(struct replay_ctx *rctx,
+		     const struct tb_log_record *record,
+		     uint32_t *new_mapping)
+{
+	bool processed[TB_LOG_HASH_COUNT] = {false};
+	struct replay_port *port;
+	int hash;
+	int i;
+
+	ports_clear_load(rctx);
+	for (i = 0; i < TB_LOG_HASH_COUNT; i++) {
+		port = port_get(rctx, rctx->mapping[i]);
+		if (!rctx->mapping[i] || (port && port->enabled)) {
+			processed[i] = true;
+			if (port)
+				port->load += hash_cost(rctx,
+							&record->hashes[i]);
+		}
+	}
+	while ((hash = biggest_unprocessed_hash(rctx, record, processed)) != -1 &&
+	       (port = least_loaded_port(rctx))) {
+		processed[hash] = true;
+		new_mapping[hash] = port->ifindex;
+		port->load += hash_cost(rctx, &record->hashes[hash]) + 1;
+	}
+}
+
+static void replay_record(struct replay_ctx *rctx,
+			  const struct tb_log_record *record)
+{
+	bool evacuation = record->flags & TB_LOG_RECORD_EVACUATION;
+	uint32_t new_mapping[TB_LOG_HASH_COUNT];
+	unsigned int remaps = 0;
+	double imbalance = -1;
+	int i;
+
+	if (!rctx->params->weights_set) {
+		rctx->byte_weight = record->byte_weight;
+		rctx->packet_weight = record->packet_weight;
+	}
+	if (rctx->params->algorithm == ALGORITHM_RECORDED || !rctx->records) {
+		for (i = 0; i < TB_LOG_HASH_COUNT; i++)
+			rctx->mapping[i] = record->hashes[i].old_ifindex;
+	}
+	rctx->records++;
+	ports_load(rctx, record);
+	/* Evacuation records repeat stats of the previous interval */
+	if (!evacuation) {
+		imbalance = evaluate(rctx, record);
+		idle_age_update(rctx, record);
+	}
+
+	memcpy(new_mapping, rctx->mapping, sizeof(new_mapping));
+	switch (rctx->params->algorithm) {
+	case ALGORITHM_RECORDED:
+		for (i = 0; i < TB_LOG_HASH_COUNT; i++)
+			new_mapping[i] = record->hashes[i].new_ifindex;
+		break;
+	case ALGORITHM_STATIC:
+		break;
+	case ALGORITHM_GREEDY:
+	case ALGORITHM_IDLE_AWARE:
+		if (evacuation)
+			evacuate(rctx, record, new_mapping);
+		else
+			rebalance(rctx, record, new_mapping, imbalance);
+		break;
+	}
+
+	for (i = 0; i < TB_LOG_HASH_COUNT; i++) {
+		if (new_mapping[i] == rctx->mapping[i])
+			continue;
+		remaps++;
+		/* Moving hash with traffic in flight may reorder packets */
+		if (rctx->mapping[i] &&
+		    record->hashes[i].bytes > rctx->params->idle_bytes) {
+			rctx->busy_remaps++;
+			rctx->busy_remap_bytes += record->hashes[i].bytes;
+		}
+	}
+	rctx->remaps += remaps;
+	memcpy(rctx->mapping, new_mapping, sizeof(new_mapping));
+
+	if (rctx->params->verbose) {
+		printf("seq %" PRIu64 " time %" PRIu64 " interval %u imbalance ",
+		       record->seq, record->timestamp_ms,
+		       record->balancing_interval);
+		if (imbalance >= 0)
+			printf("%.1f%%", imbalance);
+		else
+			printf("n/a");
+		printf(" remaps %u%s\n", remaps,
+		       evacuation ? " (evacuation)" : "");
+	}
+}
+
+static int replay(struct tb_log_header *header, size_t size,
+		  struct replay_params *params)
+{
+	struct replay_ctx rctx;
+	uint64_t first_seq;
+	uint64_t seq;
+
+	if (header->magic != TB_LOG_MAGIC) {
+		fprintf(stderr, "Not a balancer decision log.\n");
+		return -EINVAL;
+	}
+	if (header->version != TB_LOG_VERSION ||
+	    header->record_size != sizeof(struct tb_log_record)) {
+		fprintf(stderr, "Unsupported log version %u.\n",
+			header->version);
+		return -EINVAL;
+	}
+	if (!header->record_count ||
+	    size < tb_log_size(header->record_count)) {
+		fprintf(stderr, "Log is truncated.\n");
+		return -EINVAL;
+	}
+
+	memset(&rctx, 0, sizeof(rctx));
+	rctx.params = params;
+	rctx.byte_weight = params->byte_weight;
+	rctx.packet_weight = params->packet_weight;
+	first_seq = header->seq > header->record_count ?
+		    header->seq - header->record_count : 0;
+	for (seq = first_seq; seq < header->seq; seq++) {
+		struct tb_log_record *record = tb_log_record_slot(header, seq);
+
+		if (record->seq != seq)
+			continue; /* overwritten meanwhile */
+		replay_record(&rctx, record);
+	}
+
+	printf("algorithm: %s\n", algorithm_names[params->algorithm]);
+	printf("records: %u\n", rctx.records);
+	if (rctx.evaluated) {
+		printf("mean imbalance: %.1f%%\n",
+		       rctx.imbalance_sum / rctx.evaluated);
+		printf("max imbalance: %.1f%%\n", rctx.imbalance_max);
+	}
+	printf("remaps: %u\n", rctx.remaps);
+	printf("busy remaps: %u (%" PRIu64 " bytes possibly reordered)\n",
+	       rctx.busy_remaps, rctx.busy_remap_bytes);
+	printf("stranded load: %" PRIu64 "\n", rctx.stranded);
+	return 0;
+}
+
+static int parse_uint(const char *str, uint64_t *val)
+{
+	char *endptr;
+
+	errno = 0;
+	*val = strtoull(str, &endptr, 10);
+	if (errno || *endptr != '\0' || endptr == str)
+		return -EINVAL;
+	return 0;
+}
+
+static void print_help(const char *argv0) {
+	printf(
+            "%s [options] logfile\n"
+            "\t-h --help                     Show this help\n"
+            "\t-a --algorithm=ALGORITHM      Algorithm to replay with, one of\n"
+            "\t                              recorded, static, greedy, idle_aware\n"
+            "\t                              (default recorded)\n"
+            "\t-m --metric=METRIC            Load metric, one of bytes, packets,\n"
+            "\t                              combined (default as recorded)\n"
+            "\t-w --byte-weight=WEIGHT       Byte weight for combined metric\n"
+            "\t-W --packet-weight=WEIGHT     Packet weight for combined metric\n"
+            "\t-k --idle-intervals=COUNT     Intervals for hash to be idle (default 3)\n"
+            "\t-i --idle-bytes=BYTES         Bytes up to which hash is idle (default 1500)\n"
+            "\t-b --busy-imbalance=PERCENT   Imbalance to move busy hashes (default 50)\n"
+            "\t-v --verbose                  Print result of each record\n",
+            argv0);
+}
+
+int main(int argc, char **argv)
+{
+	char *argv0 = argv[0];
+	static const struct option long_options[] = {
+		{ "help",		no_argument,		NULL, 'h' },
+		{ "algorithm",		required_argument,	NULL, 'a' },
+		{ "metric",		required_argument,	NULL, 'm' },
+		{ "byte-weight",	required_argument,	NULL, 'w' },
+		{ "packet-weight",	required_argument,	NULL, 'W' },
+		{ "idle-intervals",	required_argument,	NULL, 'k' },
+		{ "idle-bytes",		required_argument,	NULL, 'i' },
+		{ "busy-imbalance",	required_argument,	NULL, 'b' },
+		{ "verbose",		no_argument,		NULL, 'v' },
+		{ NULL, 0, NULL, 0 }
+	};
+	struct replay_params params = {
+		.algorithm = ALGORITHM_RECORDED,
+		.byte_weight = 1,
+		.packet_weight = 100,
+		.idle_intervals = 3,
+		.idle_bytes = 1500,
+		.busy_imbalance = 50,
+	};
+	const char *metric = NULL;
+	struct tb_log_header *header;
+	struct stat st;
+	uint64_t val;
+	int opt;
+	int err;
+	int fd;
+	int i;
+
+	while ((opt = getopt_long(argc, argv, "ha:m:w:W:k:i:b:v",
+				  long_options, NULL)) >= 0) {
+
+		switch(opt) {
+		case 'h':
+			print_help(argv0);
+			return EXIT_SUCCESS;
+		case 'a':
+			for (i = 0; i < ARRAY_SIZE(algorithm_names); i++) {
+				if (!strcmp(optarg, algorithm_names[i]))
+					break;
+			}
+			if (i == ARRAY_SIZE(algorithm_names)) {
+				fprintf(stderr, "Unknown algorithm \"%s\".\n",
+					optarg);
+				return EXIT_FAILURE;
+			}
+			params.algorithm = i;
+			break;
+		case 'm':
+			metric = optarg;
+			break;
+		case 'w':
+		case 'W':
+		case 'k':
+		case 'i':
+		case 'b':
+			if (parse_uint(optarg, &val)) {
+				fprintf(stderr, "Invalid number \"%s\".\n",
+					optarg);
+				return EXIT_FAILURE;
+			}
+			if (opt == 'w')
+				params.byte_weight = val;
+			else if (opt == 'W')
+				params.packet_weight = val;
+			else if (opt == 'k')
+				params.idle_intervals = val;
+			else if (opt == 'i')
+				params.idle_bytes = val;
+			else
+				params.busy_imbalance = val;
+			break;
+		case 'v':
+			params.verbose = true;
+			break;
+		case '?':
+			fprintf(stderr, "unknown option.\n");
+			print_help(argv0);
+			return EXIT_FAILURE;
+		default:
+			fprintf(stderr, "unknown option \"%c\".\n", opt);
+			print_help(argv0);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (metric) {
+		params.weights_set = true;
+		if (!strcmp(metric, "bytes")) {
+			params.byte_weight = 1;
+			params.packet_weight = 0;
+		} else if (!strcmp(metric, "packets")) {
+			params.byte_weight = 0;
+			params.packet_weight = 1;
+		} else if (strcmp(metric, "combined")) {
+			fprintf(stderr, "Unknown metric \"%s\".\n", metric);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind >= argc) {
+		fprintf(stderr, "No log file specified.\n");
+		printf("\n");
+		print_help(argv0);
+		return EXIT_FAILURE;
+	}
+
+	fd = open(argv[optind], O_RDONLY);
+	if (fd == -1) {
+		fprintf(stderr, "Failed to open \"%s\": %s\n", argv[optind],
+			strerror(errno));
+		return EXIT_FAILURE;
+	}
+	if (fstat(fd, &st) == -1 || st.st_size < sizeof(*header)) {
+		fprintf(stderr, "Log file is too short.\n");
+		close(fd);
+		return EXIT_FAILURE;
+	}
+	header = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (header == MAP_FAILED) {
+		fprintf(stderr, "Failed to map log file: %s\n",
+			strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	err = replay(header, st.st_size, &params);
+	munmap(header, st.st_size);
+	return err ? EXIT_FAILURE : EXIT_SUCCESS;
+}